@@ -0,0 +1,216 @@
+/* batch_subs.c:
+ *  search for a whole batch of patterns in one pass over the sequences.
+ *
+ * A batch search (sequery < patterns) may hold thousands of patterns,
+ * mostly substitution variants of each other.  Rather than running each
+ * pattern's matcher along each sequence, every fixed-length pattern is
+ * filed under the pairs of adjacent residues that can occur at its most
+ * selective pair of positions: W[FY]P.D is filed under WF and WY.
+ * The sequence is then read once, and at each residue pair only the
+ * patterns filed under it are checked, a residue at a time against
+ * their Shift-And masks.
+ *
+ * Patterns of variable length, or whose rarest pair is still common
+ * (.\{\2\}GG, [ILMFV]...), are searched for with their own matchers, as
+ * before.  Either way every match a one-pattern search would report is
+ * reported, with the same start and length.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "regex_subs.h"
+#include "bitpar_subs.h"
+#include "score_subs.h"
+#include "matcher_subs.h"
+#include "batch_subs.h"
+
+#define NPAIRS (256*256)
+
+ static int
+members(struct shiftand *sa, int j, unsigned char *list)
+{
+	/* put the residues allowed at position j into list, return how many */
+	int c, n = 0;
+
+	for(c = 0; c < 256; c++)
+		if((sa->mask[c] >> j) & 1) list[n++] = c;
+	return n;
+}
+
+ static int
+best_pair(struct shiftand *sa)
+{
+	/* position j of the pair (j, j+1) allowing fewest residue pairs,
+	 * or -1 if even that allows more than BATCH_MAXPAIRS.  Only
+	 * residues below 0x80 are counted, as only those occur in sequences.
+	 */
+	int j, c, n0, n1, cost, best = -1, bestcost = BATCH_MAXPAIRS + 1;
+
+	for(j = 0; j + 1 < sa->len; j++) {
+		n0 = n1 = 0;
+		for(c = 0; c < 128; c++) {
+			n0 += (sa->mask[c] >> j) & 1;
+			n1 += (sa->mask[c] >> (j+1)) & 1;
+			}
+		cost = n0 * n1;
+		if(cost < bestcost) {
+			bestcost = cost;
+			best = j;
+			}
+		}
+	return best;
+}
+
+ struct batch *
+batch_build(struct matcher **m, int npats)
+{
+	/* prepare to search for patterns m[0..npats) together */
+	struct batch *b;
+	struct shiftand *sa;
+	int *off, i, k, l, n0, n1, key, nentries;
+	unsigned char list0[256], list1[256];
+
+	b = (struct batch *) calloc(1, sizeof(struct batch));
+	b->npats = npats;
+	b->m = m;
+	b->rest = (int *) malloc((npats+1) * sizeof(int));
+	b->first = (int *) calloc(NPAIRS + 1, sizeof(int));
+	off = (int *) malloc(npats * sizeof(int));
+
+	/* count the entries under each pair, filing first[key+1] */
+	for(i = 0; i < npats; i++) {
+		off[i] = -1;
+		if(m[i] == NULL) continue;
+		if((sa = m[i]->sa) == NULL || (off[i] = best_pair(sa)) < 0) {
+			b->rest[b->nrest++] = i;
+			continue;
+			}
+		n0 = members(sa, off[i], list0);
+		n1 = members(sa, off[i]+1, list1);
+		for(k = 0; k < n0; k++) for(l = 0; l < n1; l++)
+			b->first[(list0[k]<<8 | list1[l]) + 1]++;
+		}
+	for(key = 0; key < NPAIRS; key++) b->first[key+1] += b->first[key];
+	nentries = b->first[NPAIRS];
+
+	/* fill them in, using first[key] as the next free slot for now */
+	b->entry = (struct batch_entry *)
+	  malloc((nentries+1) * sizeof(struct batch_entry));
+	for(i = 0; i < npats; i++) {
+		if(off[i] < 0) continue;
+		sa = m[i]->sa;
+		n0 = members(sa, off[i], list0);
+		n1 = members(sa, off[i]+1, list1);
+		for(k = 0; k < n0; k++) for(l = 0; l < n1; l++) {
+			key = list0[k]<<8 | list1[l];
+			b->entry[b->first[key]].pat = i;
+			b->entry[b->first[key]].off = off[i];
+			b->first[key]++;
+			}
+		}
+	for(key = NPAIRS; key > 0; key--) b->first[key] = b->first[key-1];
+	b->first[0] = 0;
+
+	free(off);
+	return b;
+}
+
+ struct matcher **
+batch_clone(struct batch *b)
+{
+	/* matchers for another thread: copies of those searched for one at
+	 * a time, the originals for the rest (whose Shift-And masks are
+	 * only read).
+	 */
+	struct matcher **m;
+	int r;
+
+	m = (struct matcher **) malloc((b->npats+1) * sizeof(struct matcher *));
+	memcpy(m, b->m, b->npats * sizeof(struct matcher *));
+	for(r = 0; r < b->nrest; r++)
+		m[b->rest[r]] = matcher_clone(b->m[b->rest[r]]);
+	return m;
+}
+
+ void
+batch_unclone(struct batch *b, struct matcher **m)
+{
+	int r;
+
+	for(r = 0; r < b->nrest; r++) matcher_free(m[b->rest[r]]);
+	free(m);
+}
+
+ static void
+add_hit(struct batch_hits *h, int pat, int bgn, int len)
+{
+	if(h->nhits == h->hitalloc) {
+		h->hitalloc = h->hitalloc ? 2 * h->hitalloc : 256;
+		h->hit = (struct batch_hit *) realloc(h->hit,
+		  h->hitalloc * sizeof(struct batch_hit));
+		}
+	h->hit[h->nhits].pat = pat;
+	h->hit[h->nhits].bgn = bgn;
+	h->hit[h->nhits].len = len;
+	h->nhits++;
+}
+
+ int
+batch_scan(struct batch *b, struct matcher **m, struct batch_hits *h,
+  char *string, int len)
+{
+	/* find every match of every pattern in string[0..len), as repeated
+	 * matcher_match() calls each starting one past the last match would,
+	 * using matchers m (b->m or from batch_clone()).  Leaves them in
+	 * h->hit[0..n) and returns n.  The hits of any one pattern are in
+	 * order of position.
+	 */
+	unsigned char *s = (unsigned char *) string;
+	struct batch_entry *e, *end;
+	struct shiftand *sa;
+	int p, j, st, r, bgn, mlen;
+
+	h->nhits = 0;
+
+	for(p = 0; p + 1 < len; p++) {
+		r = s[p]<<8 | s[p+1];
+		end = &b->entry[b->first[r+1]];
+		for(e = &b->entry[b->first[r]]; e < end; e++) {
+			st = p - e->off;
+			sa = m[e->pat]->sa;
+			if(st < 0 || st + sa->len > len) continue;
+			for(j = 0; j < sa->len; j++)
+				if(!((sa->mask[s[st+j]] >> j) & 1)) break;
+			if(j == sa->len) add_hit(h, e->pat, st, sa->len);
+			}
+		}
+
+	for(r = 0; r < b->nrest; r++) {
+		p = 0;
+		while(p < len && matcher_match(m[b->rest[r]], string+p,
+		  len-p, &bgn, &mlen) && mlen > 0) {
+			add_hit(h, b->rest[r], p + bgn, mlen);
+			p += bgn + 1;
+			}
+		}
+
+	return h->nhits;
+}
+
+ void
+batch_free(struct batch *b)
+{
+	/* the matchers themselves belong to the caller */
+	if(b == NULL) return;
+	free(b->first);
+	free(b->entry);
+	free(b->rest);
+	free(b);
+}
@@ -0,0 +1,45 @@
+/* batch_subs.h:
+ *  search for a whole batch of patterns in one pass over the sequences.
+ *  Requires <stdint.h>, "regex_subs.h", "bitpar_subs.h" and
+ *  "matcher_subs.h".
+ */
+
+static char batch_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define BATCH_MAXPAIRS 100	/* most residue pairs a pattern is filed under */
+
+struct batch_hit {
+	int pat;		/* which pattern of the batch */
+	int bgn, len;		/* where, as from matcher_match() */
+	};
+
+struct batch_entry {
+	int pat;		/* pattern filed under this pair of residues */
+	int off;		/* position of the pair within the pattern */
+	};
+
+struct batch {
+	int npats;
+	struct matcher **m;	/* the patterns; NULL ones are left out */
+	int *first;		/* entries for pair (a,b) are entry[first[a<<8|b]] */
+	struct batch_entry *entry; /* ... up to entry[first[(a<<8|b)+1]] */
+	int *rest;		/* patterns searched for one at a time */
+	int nrest;
+	};
+
+/* Hits in the last sequence scanned, one of these for each thread
+ * scanning.  The threads also need their own copies (batch_clone())
+ * of the matchers run one at a time; the rest they may share.
+ */
+struct batch_hits {
+	struct batch_hit *hit;
+	int nhits, hitalloc;
+	};
+
+struct batch * batch_build(struct matcher **m, int npats);
+struct matcher ** batch_clone(struct batch *b);
+void batch_unclone(struct batch *b, struct matcher **m);
+int batch_scan(struct batch *b, struct matcher **m, struct batch_hits *h,
+  char *string, int len);
+void batch_free(struct batch *b);
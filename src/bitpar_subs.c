@@ -0,0 +1,341 @@
+/* bitpar_subs.c:
+ *  bit-parallel ("Shift-And") matcher for fixed-length patterns.
+ *
+ * Most sequery patterns, once their digits and lower-case letters are
+ * expanded, are a fixed string of residue classes with no repetition:
+ * 23.D -> [YFW][STP].D.  For these there is no need for an automaton.
+ * Each residue c is given a word mask[c] with bit j set if c may stand
+ * at position j of a match; then, one residue at a time,
+ *	D = ((D << 1) | 1) & mask[c]
+ * keeps in bit j whether the last j+1 residues match the first j+1
+ * positions, and a match ends wherever bit len-1 comes on.  Allowing
+ * up to k edits (sequery -k) takes k+1 such words, one per number of
+ * edits, still a few operations per residue.
+ *
+ * On x86 processors with SSE4.1 or AVX2, short patterns are instead
+ * tested at 16 or 32 starting residues at once: for each pattern
+ * position, a vector of residues is looked up in two 16-entry tables
+ * (residues 0x40-0x4F and 0x50-0x5F, which hold 'A' to 'Z') and the
+ * results ANDed together; the first bit left standing is the leftmost
+ * match.  Patterns with classes outside that range use the word kernel.
+ * Setting SEQUERY_NOSIMD in the environment, or compiling with
+ * -DNO_SIMD, also forces the word kernel.
+ *
+ * The word kernel can also read a database packed by pack_subs.c: the
+ * masks are then looked up by residue code, from each pattern piece's
+ * 32-bit class mask, and a word of 12 or 32 residues is run through
+ * with one test for a match at the end of it.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "regex_subs.h"
+#include "bitpar_subs.h"
+#include "resnum_subs.h"
+#include "pack_subs.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NO_SIMD)
+#define X86_SIMD
+#include <immintrin.h>
+#endif
+
+ struct shiftand *
+shiftand_build(struct regex *re)
+{
+	/* return a matcher for "re", or NULL if it is not of fixed length
+	 * (or is anchored, or too long), so the DFA has to be used.
+	 */
+	struct shiftand *sa;
+	struct re_piece *p;
+	int i, j, k, c, len = 0, simd;
+
+	if(re->bol || re->eol || re->npieces == 0) return NULL;
+	for(i = 0; i < re->npieces; i++) {
+		p = &re->piece[i];
+		if(p->max != p->min) return NULL;
+		len += p->min;
+		}
+	if(len < 1 || len > SA_MAXLEN) return NULL;
+
+	sa = (struct shiftand *) calloc(1, sizeof(struct shiftand));
+	sa->len = len;
+	simd = len <= SA_SIMDLEN;
+	for(i = j = 0; i < re->npieces; i++) {
+		p = &re->piece[i];
+		for(k = 0; k < p->min; k++, j++) {
+			for(c = 0; c < 256; c++)
+				if(RE_ISMEMBER(p, c)) sa->mask[c] |= (uint64_t) 1 << j;
+			for(c = 0; c < 32; c++)
+				if(p->codes & 1U << c) sa->code_mask[c] |= (uint64_t) 1 << j;
+			if(j >= SA_SIMDLEN) continue;
+			sa->dot[j] = 1;
+			for(c = 1; c < 256; c++) if(!RE_ISMEMBER(p, c)) sa->dot[j] = 0;
+			if(sa->dot[j]) continue;
+			for(c = 0; c < 128; c++)
+				if(RE_ISMEMBER(p, c) && (c & 0xE0) != 0x40) simd = 0;
+			/* [...] classes ignore the eighth bit, single residues do not */
+			sa->fold[j] = 1;
+			for(c = 128; c < 256; c++) {
+				if(!RE_ISMEMBER(p, c) != !RE_ISMEMBER(p, c & 0177)) sa->fold[j] = 0;
+				if(RE_ISMEMBER(p, c) && !sa->fold[j]) simd = 0;
+				}
+			for(c = 0; c < 16; c++) {
+				sa->lo[j][c] = RE_ISMEMBER(p, 0x40+c) ? 0xFF : 0;
+				sa->hi[j][c] = RE_ISMEMBER(p, 0x50+c) ? 0xFF : 0;
+				}
+			}
+		}
+
+	for(c = 0; c < 4; c++)
+		sa->nt_mask[c] = sa->code_mask[PACK_CODE5(pack_nucleotides[c])];
+
+	sa->kernel = SA_SCALAR;
+#ifdef X86_SIMD
+	if(simd && getenv("SEQUERY_NOSIMD") == NULL) {
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2")) sa->kernel = SA_AVX2;
+		else if(__builtin_cpu_supports("sse4.1")) sa->kernel = SA_SSE41;
+		}
+#endif
+	return sa;
+}
+
+#ifdef X86_SIMD
+/* Vector kernels: return the leftmost match start found among whole
+ * blocks of starting residues, or -1-i where i is the first start left
+ * for the word kernel.  They only load residues in string[0..len).
+ */
+
+__attribute__((target("avx2")))
+ static int
+scan_avx2(struct shiftand *sa, unsigned char *s, int len)
+{
+	const __m256i k40 = _mm256_set1_epi8(0x40);
+	const __m256i kE0 = _mm256_set1_epi8((char) 0xE0);
+	const __m256i k7F = _mm256_set1_epi8(0x7F);
+	__m256i acc, t, lo, hi, m;
+	unsigned bits;
+	int i, j, n = sa->len;
+
+	for(i = 0; i + 32 + n - 1 <= len; i += 32) {
+		acc = _mm256_set1_epi8(-1);
+		for(j = 0; j < n; j++) {
+			if(sa->dot[j]) continue;
+			t = _mm256_loadu_si256((const __m256i *) (s + i + j));
+			if(sa->fold[j]) t = _mm256_and_si256(t, k7F);
+			lo = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+			  _mm_loadu_si128((const __m128i *) sa->lo[j])), t);
+			hi = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+			  _mm_loadu_si128((const __m128i *) sa->hi[j])), t);
+			/* bit 4 of the residue picks the table */
+			m = _mm256_blendv_epi8(lo, hi, _mm256_slli_epi16(t, 3));
+			m = _mm256_and_si256(m,
+			  _mm256_cmpeq_epi8(_mm256_and_si256(t, kE0), k40));
+			acc = _mm256_and_si256(acc, m);
+			if(_mm256_testz_si256(acc, acc)) break;
+			}
+		if((bits = (unsigned) _mm256_movemask_epi8(acc)) != 0)
+			return i + __builtin_ctz(bits);
+		}
+	return -1 - i;
+}
+
+__attribute__((target("sse4.1")))
+ static int
+scan_sse41(struct shiftand *sa, unsigned char *s, int len)
+{
+	const __m128i k40 = _mm_set1_epi8(0x40);
+	const __m128i kE0 = _mm_set1_epi8((char) 0xE0);
+	const __m128i k7F = _mm_set1_epi8(0x7F);
+	__m128i acc, t, lo, hi, m;
+	unsigned bits;
+	int i, j, n = sa->len;
+
+	for(i = 0; i + 16 + n - 1 <= len; i += 16) {
+		acc = _mm_set1_epi8(-1);
+		for(j = 0; j < n; j++) {
+			if(sa->dot[j]) continue;
+			t = _mm_loadu_si128((const __m128i *) (s + i + j));
+			if(sa->fold[j]) t = _mm_and_si128(t, k7F);
+			lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) sa->lo[j]), t);
+			hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) sa->hi[j]), t);
+			m = _mm_blendv_epi8(lo, hi, _mm_slli_epi16(t, 3));
+			m = _mm_and_si128(m, _mm_cmpeq_epi8(_mm_and_si128(t, kE0), k40));
+			acc = _mm_and_si128(acc, m);
+			if(_mm_testz_si128(acc, acc)) break;
+			}
+		if((bits = (unsigned) _mm_movemask_epi8(acc)) != 0)
+			return i + __builtin_ctz(bits);
+		}
+	return -1 - i;
+}
+#endif
+
+ int
+shiftand_match(struct shiftand *sa, char *string, int len, int *p_bgn, int *p_len)
+{
+	/* look for the pattern in string[0..len); if found return 1 and set
+	 * *p_bgn and *p_len to the leftmost match, as dfa_match() does.
+	 */
+	unsigned char *s = (unsigned char *) string;
+	uint64_t D = 0, hit = (uint64_t) 1 << (sa->len-1);
+	int p = 0;
+
+#ifdef X86_SIMD
+	if(sa->kernel != SA_SCALAR) {
+		p = sa->kernel == SA_AVX2 ? scan_avx2(sa, s, len) : scan_sse41(sa, s, len);
+		if(p >= 0) {
+			*p_bgn = p;
+			*p_len = sa->len;
+			return 1;
+			}
+		p = -1 - p;
+		}
+#endif
+	for(; p < len; p++) {
+		D = ((D << 1) | 1) & sa->mask[s[p]];
+		if(D & hit) {
+			*p_bgn = p - sa->len + 1;
+			*p_len = sa->len;
+			return 1;
+			}
+		}
+	return 0;
+}
+
+ static inline int
+scan_packed(uint64_t *table, uint64_t *w, int bits, int per, uint64_t hit,
+  int from, int len)
+{
+	/* where the first match in codes [from..len) of words w ends, or -1.
+	 * Called with constant bits and per, so the word loop is unrolled.
+	 */
+	uint64_t D = 0, D0, h, x, code = ((uint64_t) 1 << bits) - 1;
+	int p = from, b;
+
+	w += from / per;
+	if(from % per != 0) {
+		x = *w++ >> (bits * (from % per));
+		for(b = from % per; b < per && p < len; b++, p++, x >>= bits) {
+			D = ((D << 1) | 1) & table[x & code];
+			if(D & hit) return p;
+			}
+		}
+	for(; p + per <= len; p += per, w++) {
+		D0 = D;
+		h = 0;
+		x = *w;
+#ifdef __GNUC__
+#pragma GCC unroll 32
+#endif
+		for(b = 0; b < per; b++) {
+			D = ((D << 1) | 1) & table[(x >> (bits * b)) & code];
+			h |= D;
+			}
+		if(h & hit) {
+			/* it is in this word: find where */
+			for(D = D0; ; p++, x >>= bits) {
+				D = ((D << 1) | 1) & table[x & code];
+				if(D & hit) return p;
+				}
+			}
+		}
+	for(x = p < len ? *w : 0; p < len; p++, x >>= bits) {
+		D = ((D << 1) | 1) & table[x & code];
+		if(D & hit) return p;
+		}
+	return -1;
+}
+
+ int
+shiftand_match_packed(struct shiftand *sa, uint64_t *words, int bits,
+  int from, int len, int *p_bgn, int *p_len)
+{
+	/* as shiftand_match() on residues [from..len) of a sequence packed
+	 * in "words" with codes of "bits" bits; *p_bgn is from "from".
+	 */
+	uint64_t hit = (uint64_t) 1 << (sa->len-1);
+	int p;
+
+	if(bits == PACK_2BIT)
+		p = scan_packed(sa->nt_mask, words, PACK_2BIT, 64/PACK_2BIT, hit, from, len);
+	else
+		p = scan_packed(sa->code_mask, words, PACK_5BIT, 64/PACK_5BIT, hit, from, len);
+	if(p < 0) return 0;
+	*p_bgn = p - sa->len + 1 - from;
+	*p_len = sa->len;
+	return 1;
+}
+
+ int
+approx_match(struct shiftand *sa, int k, char *string, int len,
+  int *p_bgn, int *p_len, int *p_edits)
+{
+	/* look for the pattern with at most k residues changed, inserted or
+	 * left out (Wu and Manber's extension of Shift-And: a word of bits
+	 * D[d] for each number of edits d, so that bit j of D[d] keeps
+	 * whether the first j+1 positions match a string just read with no
+	 * more than d edits).  If found return 1 and set *p_bgn and *p_len
+	 * to the match and *p_edits to its edits: the first match ending
+	 * with the fewest edits of those ending within k residues of it,
+	 * beginning where it has the fewest edits and is nearest the
+	 * pattern's length.
+	 */
+	unsigned char *s = (unsigned char *) string;
+	uint64_t D[SA_MAXK+1], prev, old, hit = (uint64_t) 1 << (sa->len-1);
+	int cost[SA_MAXLEN+1], next[SA_MAXLEN+1];
+	int p, d, j, first = -1, best = -1, best_d = k+1, lo, bgn;
+
+	/* before any residue, the first d positions are left out */
+	for(d = 0; d <= k; d++) D[d] = ((uint64_t) 1 << d) - 1;
+
+	for(p = 0; p < len; p++) {
+		prev = D[0];
+		D[0] = ((D[0] << 1) | 1) & sa->mask[s[p]];
+		for(d = 1; d <= k; d++) {
+			old = D[d];
+			/* matched, changed, inserted, or a position left out */
+			D[d] = (((old << 1) | 1) & sa->mask[s[p]]) |
+			  (prev << 1) | prev | (D[d-1] << 1) | 1;
+			prev = old;
+			}
+		for(d = 0; d < best_d; d++)
+			if(D[d] & hit) {
+				best_d = d;
+				best = p;
+				if(first < 0) first = p;
+				break;
+				}
+		if(best_d == 0 || (first >= 0 && p >= first + k)) break;
+		}
+	if(best < 0) return 0;
+
+	/* where it begins: cost[j] is the edits matching positions j..len-1
+	 * with string[bgn..best], for each bgn going back from best
+	 */
+	for(j = 0; j <= sa->len; j++) cost[j] = sa->len - j;
+	lo = best - sa->len - k + 1;
+	if(lo < 0) lo = 0;
+	*p_bgn = best + 1;
+	for(bgn = best; bgn >= lo; bgn--) {
+		next[sa->len] = best - bgn + 1;
+		for(j = sa->len - 1; j >= 0; j--) {
+			next[j] = cost[j+1] + !((sa->mask[s[bgn]] >> j) & 1);
+			if(cost[j] + 1 < next[j]) next[j] = cost[j] + 1;
+			if(next[j+1] + 1 < next[j]) next[j] = next[j+1] + 1;
+			}
+		memcpy(cost, next, sizeof(cost));
+		if(cost[0] == best_d && (*p_bgn > best || best - bgn + 1 <= sa->len))
+			*p_bgn = bgn;
+		}
+	*p_len = best - *p_bgn + 1;
+	*p_edits = best_d;
+	return 1;
+}
@@ -0,0 +1,37 @@
+/* bitpar_subs.h:
+ *  bit-parallel matching of fixed-length patterns, e.g. YW[RA][YWF]AQ or
+ *  [FY]P.D, in which every piece matches exactly one residue (or a
+ *  fixed number of them), exactly or with a few residues changed,
+ *  inserted or left out.  Requires <stdint.h> and "regex_subs.h".
+ */
+
+static char bitpar_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define SA_MAXLEN 64	/* longest pattern: one bit per residue in a word */
+#define SA_SIMDLEN 16	/* longest pattern worth the vector kernels */
+#define SA_MAXK 16	/* most edits approx_match() allows */
+
+struct shiftand {
+	int len;		/* residues in a match */
+	uint64_t mask[256];	/* bit j set if residue may be at position j */
+	uint64_t code_mask[32];	/* the same by 5-bit code (pack_subs.h) */
+	uint64_t nt_mask[4];	/* ... and by 2-bit code */
+	int kernel;		/* SA_SCALAR, SA_SSE41 or SA_AVX2 */
+	/* for the vector kernels, residues 0x40-0x5F only ('@', 'A'-'Z', ...): */
+	char dot[SA_SIMDLEN];		/* position j matches anything */
+	char fold[SA_SIMDLEN];		/* position j ignores the eighth bit */
+	unsigned char lo[SA_SIMDLEN][16];	/* 0xFF if 0x40+k matches position j */
+	unsigned char hi[SA_SIMDLEN][16];	/* 0xFF if 0x50+k matches position j */
+	};
+
+#define SA_SCALAR 0
+#define SA_SSE41 1
+#define SA_AVX2 2
+
+struct shiftand * shiftand_build(struct regex *re);
+int shiftand_match(struct shiftand *sa, char *string, int len, int *p_bgn, int *p_len);
+int shiftand_match_packed(struct shiftand *sa, uint64_t *words, int bits,
+  int from, int len, int *p_bgn, int *p_len);
+int approx_match(struct shiftand *sa, int k, char *string, int len,
+  int *p_bgn, int *p_len, int *p_edits);
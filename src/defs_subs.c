@@ -0,0 +1,141 @@
+/* defs_subs.c:
+ *  read and keep sequery's definition files; see defs_subs.h.
+ *
+ * The files are parsed just as replace_wild() and replace_defs() in
+ * sequery.c always parsed them, but into tables that grow as needed
+ * rather than the 12 wild cards and 40 substitutions there was room
+ * for before.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "defs_subs.h"
+
+extern char * pgmname;
+
+static struct defs *defs_list; /* every file read so far */
+
+ static uint64_t
+hash_bytes(uint64_t h, char *s, size_t n)
+{
+	while(n-- > 0) h = (h ^ (unsigned char) *s++) * 1099511628211ULL;
+	return h;
+}
+
+ static void
+stamp(struct defs *dp, struct stat *st)
+{
+	if(st == NULL) {
+		dp->dev = 0;
+		dp->ino = 0;
+		dp->mtime = 0;
+		dp->mtime_ns = 0;
+		dp->size = 0;
+		return;
+		}
+	dp->dev = st->st_dev;
+	dp->ino = st->st_ino;
+	dp->mtime = st->st_mtim.tv_sec;
+	dp->mtime_ns = st->st_mtim.tv_nsec;
+	dp->size = st->st_size;
+}
+
+ static int
+changed(struct defs *dp)
+{
+	/* true if the file is not the one last read */
+	struct stat st;
+
+	if(stat(dp->filename, &st) < 0) return dp->ino != 0 || dp->size != 0;
+	return st.st_dev != dp->dev || st.st_ino != dp->ino ||
+	  st.st_mtim.tv_sec != dp->mtime || st.st_mtim.tv_nsec != dp->mtime_ns ||
+	  st.st_size != dp->size;
+}
+
+ static void
+add(struct defs *dp, int key, char *text)
+{
+	if(dp->n == dp->max) {
+		dp->max = dp->max ? 2 * dp->max : 16;
+		dp->key = realloc(dp->key, dp->max);
+		dp->text = (char **) realloc(dp->text, dp->max * sizeof(char *));
+		}
+	dp->key[dp->n] = key;
+	dp->text[dp->n++] = strdup(text);
+}
+
+ static void
+load(struct defs *dp)
+{
+	/* (re)read dp->filename */
+	char buf[200], key[2], text[200];
+	struct stat st;
+	FILE *f;
+	int i, linenumber = 0;
+
+	for(i = 0; i < dp->n; i++) free(dp->text[i]);
+	dp->n = 0;
+	if((f = fopen(dp->filename, "r")) == NULL || fstat(fileno(f), &st) < 0) {
+		if(f != NULL) fclose(f);
+		stamp(dp, NULL);
+		}
+	else {
+		stamp(dp, &st);
+		while(NULL != fgets(buf, DEFS_LINE, f)) {
+			linenumber++;
+			if(buf[0] == '\n') continue; /* skip empties */
+			if(buf[0] == '#') continue; /* skip comments */
+			if(dp->kind == DEFS_WILD) {
+				if(1 == sscanf(buf, "%s", text)) add(dp, '\0', text);
+				}
+			else if(2 == sscanf(buf, "%1s %s", key, text))
+				add(dp, key[0], text);
+			else {
+				fprintf(stderr,
+				  "%s: format problem in file %s, line %d :%s",
+				  pgmname, dp->filename, linenumber, buf);
+				fprintf(stderr, " line ignored.\n");
+				}
+			}
+		fclose(f);
+		}
+
+	dp->hash = hash_bytes(14695981039346656037ULL, (char *) &dp->kind,
+	  sizeof(dp->kind));
+	for(i = 0; i < dp->n; i++) {
+		dp->hash = hash_bytes(dp->hash, &dp->key[i], 1);
+		dp->hash = hash_bytes(dp->hash, dp->text[i], strlen(dp->text[i]) + 1);
+		}
+}
+
+ struct defs *
+defs_get(char *filename, int kind, int check)
+{
+	/* the definitions of "kind" in "filename", read if they never have
+	 * been or, if "check" is set, if the file has changed since.
+	 * A file that cannot be read has no definitions.
+	 */
+	struct defs *dp;
+
+	for(dp = defs_list; dp != NULL; dp = dp->next)
+		if(dp->kind == kind && strcmp(dp->filename, filename) == 0) {
+			if(check && changed(dp)) load(dp);
+			return dp;
+			}
+	dp = (struct defs *) calloc(1, sizeof(struct defs));
+	dp->filename = strdup(filename);
+	dp->kind = kind;
+	load(dp);
+	dp->next = defs_list;
+	defs_list = dp;
+	return dp;
+}
@@ -0,0 +1,40 @@
+/* defs_subs.h:
+ *  the definition files by which sequery expands a pattern: wild cards
+ *  ("wilddef.dat", a class for each digit) and substitutions
+ *  ("sequery.defs", an expansion for each lower-case letter).
+ *
+ * Each file is read once and kept, and read again only when it has
+ * been changed or replaced since (its device, inode, time or size are
+ * not what they were), so that an interactive sequery need not parse
+ * both files for every pattern.  "hash" identifies what was read, for
+ * telling whether a pattern expanded earlier would expand the same now.
+ * Requires <stdint.h> and <sys/types.h>.
+ */
+
+static char defs_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define DEFS_WILD 0	/* kinds of definition file */
+#define DEFS_SUBST 1
+
+#define DEFS_LINE 100	/* lines are read in pieces of this much, less 1 */
+
+struct defs {
+	char *filename;
+	int kind;
+	int n;			/* entries */
+	int max;
+	char *key;		/* DEFS_SUBST: the letter of each entry */
+	char **text;		/* each wild card class, or expansion */
+	uint64_t hash;		/* of kind and entries */
+
+	/* the file as last read; all 0 if there was none */
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	long mtime_ns;
+	off_t size;
+	struct defs *next;
+	};
+
+struct defs * defs_get(char *filename, int kind, int check);
@@ -0,0 +1,388 @@
+/* delta_subs.c:
+ *  read, apply and append the delta segments of a sequence database;
+ *  see delta_subs.h for what they hold.
+ *
+ * When entries of the PDB are added, replaced or made obsolete, only
+ * their chains need be made into a segment and appended with
+ * sequery-mkdb -a, rather than the whole sequence file, its image and
+ * indexes being made again.  seqfile_open() applies the segments as it
+ * reads the sequence file, so sequery sees the database as one; the
+ * segments, being small, are always read whole.  sequery-mkdb -c
+ * merges them back into the sequence file when convenient.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "resnum_subs.h"
+#include "seqfile_subs.h"
+#include "delta_subs.h"
+
+extern char * pgmname;
+
+ static struct delta_key *
+find_key(struct delta *d, char *name, char *chain)
+{
+	/* the slot of (name, chain) in d->key[], or the empty one it would go in */
+	uint32_t h = 2166136261U;
+	char *s;
+	int k;
+
+	for(s = name; *s; s++) h = (h ^ (unsigned char) *s) * 16777619U;
+	h = (h ^ '/') * 16777619U;
+	for(s = chain; *s; s++) h = (h ^ (unsigned char) *s) * 16777619U;
+	for(k = h & (d->n_keys - 1); d->key[k].name[0] != '\0';
+	  k = (k + 1) & (d->n_keys - 1))
+		if(strcmp(d->key[k].name, name) == 0 && strcmp(d->key[k].chain, chain) == 0)
+			break;
+	return &d->key[k];
+}
+
+ static void
+mention(struct delta *d, char *name, char *chain, int seg)
+{
+	/* note that segment "seg" adds or removes (name, chain) */
+	struct delta_key *kp = find_key(d, name, chain);
+
+	if(kp->name[0] == '\0') {
+		strncpy(kp->name, name, sizeof(kp->name) - 1);
+		strncpy(kp->chain, chain, sizeof(kp->chain) - 1);
+		}
+	if(seg > kp->seg) kp->seg = seg;
+}
+
+ int
+delta_hides(struct delta *d, struct seq *seqp, int seg)
+{
+	/* true if sequence seqp, of segment "seg" (0 for the sequence file
+	 * itself), is replaced or removed by a later segment
+	 */
+	struct delta_key *kp;
+
+	if(d == NULL) return 0;
+	kp = find_key(d, seqp->name, seqp->chain);
+	if(kp->name[0] != '\0' && kp->seg > seg) return 1;
+	kp = find_key(d, seqp->name, "");
+	return kp->name[0] != '\0' && kp->seg > seg;
+}
+
+ static long
+next_record(char *text, long size, long pos)
+{
+	/* offset of the record after the one at text[pos], or size.
+	 * As in seqfile_next(), a record begins at the start of a line with
+	 * a non-blank character; its continuation lines begin with blanks.
+	 */
+	char *nl;
+
+	for(;;) {
+		if((nl = memchr(text + pos, '\n', size - pos)) == NULL) return size;
+		pos = nl + 1 - text;
+		if(pos < size && !isspace((unsigned char) text[pos])) return pos;
+		}
+}
+
+ static int
+record_key(char *text, long size, struct seq *seqp)
+{
+	/* read the name and chain of the record at text[0..size) into
+	 * *seqp as fget_seq() would; false if it has none
+	 */
+	char line[256], *nl;
+	long n;
+
+	if((nl = memchr(text, '\n', size)) != NULL) size = nl - text;
+	n = size < sizeof(line) - 1 ? size : sizeof(line) - 1;
+	memcpy(line, text, n);
+	line[n] = '\0';
+	if(2 != sscanf(line, "%8s %1s", seqp->name, seqp->chain)) return 0;
+	(void) struptolow(seqp->name);
+	return 1;
+}
+
+ static struct delta *
+read_delta(char *filename, int *n_segs)
+{
+	/* read delta file "filename".  Returns NULL with *n_segs 0 if there
+	 * is none, or NULL with *n_segs -1, after a message, if it cannot
+	 * be used.
+	 */
+	struct delta *d;
+	struct seq *seq;
+	struct stat st;
+	FILE *f;
+	char *text, *line, *end, name[12], chain[2], buf[256];
+	long size, pos, n_lines;
+	int seg, n, i, lineno;
+
+	*n_segs = 0;
+	if((f = fopen(filename, "r")) == NULL) return NULL;
+	*n_segs = -1;
+	if(fstat(fileno(f), &st) < 0) {
+		perror(filename);
+		fclose(f);
+		return NULL;
+		}
+	size = st.st_size;
+	text = malloc(size + 1);
+	if(size > 0 && fread(text, size, 1, f) != 1) {
+		perror(filename);
+		fclose(f);
+		free(text);
+		return NULL;
+		}
+	fclose(f);
+	for(pos = n_lines = 0; pos < size; pos++) if(text[pos] == '\n') n_lines++;
+
+	d = (struct delta *) calloc(1, sizeof(struct delta));
+	d->filename = strdup(filename);
+	for(d->n_keys = 64; d->n_keys < 2 * (n_lines + 1); d->n_keys *= 2) ;
+	d->key = (struct delta_key *) calloc(d->n_keys, sizeof(struct delta_key));
+	d->text = (char **) calloc(1, sizeof(char *));
+	d->text_len = (long *) calloc(1, sizeof(long));
+
+	/* sort the lines into segments, keeping the tombstones aside */
+	text[size] = '\0';
+	seg = lineno = 0;
+	for(line = text; line < text + size; line = end) {
+		lineno++;
+		if((end = memchr(line, '\n', text + size - line)) == NULL) end = text + size;
+		else end++;
+		if(strncmp(line, DELTA_MARK, strlen(DELTA_MARK)) == 0 &&
+		  isspace((unsigned char) line[strlen(DELTA_MARK)]))
+			seg++;
+		else if(seg == 0) seg = 1; /* lines before any mark */
+		if(seg > d->n_segs) {
+			d->text = (char **) realloc(d->text, (seg + 1) * sizeof(char *));
+			d->text_len = (long *) realloc(d->text_len, (seg + 1) * sizeof(long));
+			d->text[seg] = malloc(size + 2);
+			d->text_len[seg] = 0;
+			d->n_segs = seg;
+			}
+		if(line[0] == '#') continue; /* the mark, or a comment */
+		if(line[0] == '-') {
+			n = end - line < sizeof(buf) ? end - line : sizeof(buf) - 1;
+			memcpy(buf, line, n);
+			buf[n] = '\0';
+			n = sscanf(buf + 1, "%8s %1s", name, chain);
+			if(n < 1) {
+				fprintf(stderr, "%s: %s, line %d: no name to remove\n",
+				  pgmname, filename, lineno);
+				delta_close(d);
+				free(text);
+				return NULL;
+				}
+			(void) struptolow(name);
+			mention(d, name, n == 2 ? chain : "", seg);
+			continue;
+			}
+		memcpy(d->text[seg] + d->text_len[seg], line, end - line);
+		d->text_len[seg] += end - line;
+		}
+	free(text);
+
+	/* read each segment's chains, all of which must be readable */
+	for(seg = 1; seg <= d->n_segs; seg++) {
+		if(d->text_len[seg] > 0 && d->text[seg][d->text_len[seg]-1] != '\n')
+			d->text[seg][d->text_len[seg]++] = '\n';
+		d->text[seg] = realloc(d->text[seg], d->text_len[seg] + 1);
+		d->text[seg][d->text_len[seg]] = '\0';
+		for(pos = 0, n_lines = 0; pos < d->text_len[seg];
+		  pos = next_record(d->text[seg], d->text_len[seg], pos))
+			if(!isspace((unsigned char) d->text[seg][pos])) n_lines++;
+		n = 0;
+		seq = NULL;
+		if(d->text_len[seg] > 0 &&
+		  ((f = fmemopen(d->text[seg], d->text_len[seg], "r")) == NULL ||
+		  (seq = seqfile_read(f, &n)) == NULL)) {
+			fprintf(stderr, "%s: out of memory reading %s\n", pgmname, filename);
+			delta_close(d);
+			return NULL;
+			}
+		if(seq != NULL) fclose(f);
+		if(n != n_lines) {
+			fprintf(stderr, "%s: %s, segment %d: %ld records, only %d of them sequences\n",
+			  pgmname, filename, seg, n_lines, n);
+			delta_close(d);
+			return NULL;
+			}
+		d->seq = (struct seq *) realloc(d->seq, (d->n_seqs + n + 1) * sizeof(struct seq));
+		d->seg = (int *) realloc(d->seg, (d->n_seqs + n + 1) * sizeof(int));
+		for(i = 0; i < n; i++) {
+			d->seq[d->n_seqs] = seq[i];
+			d->seg[d->n_seqs++] = seg;
+			mention(d, seq[i].name, seq[i].chain, seg);
+			}
+		free(seq);
+		}
+	*n_segs = d->n_segs;
+	return d;
+}
+
+ struct delta *
+delta_open(char *seqfilename, int *n_segs)
+{
+	/* read the delta segments of sequence file "seqfilename", if any:
+	 * as read_delta() above
+	 */
+	char filename[1024+16];
+
+	sprintf(filename, "%s%s", seqfilename, DELTA_SUFFIX);
+	return read_delta(filename, n_segs);
+}
+
+ struct seq *
+delta_apply(struct delta *d, struct seq *seq, int n_seqs, int *n_all)
+{
+	/* the database made of sequence file seq[0..n_seqs) and the
+	 * segments: a malloc'ed array of *n_all copies of the sequences
+	 * of either, which still belong to them
+	 */
+	struct seq *all;
+	int i;
+
+	all = (struct seq *) malloc((n_seqs + d->n_seqs + 1) * sizeof(struct seq));
+	*n_all = 0;
+	for(i = 0; i < n_seqs; i++)
+		if(!delta_hides(d, &seq[i], 0)) all[(*n_all)++] = seq[i];
+	for(i = 0; i < d->n_seqs; i++)
+		if(!delta_hides(d, &d->seq[i], d->seg[i])) all[(*n_all)++] = d->seq[i];
+	return all;
+}
+
+ static void
+write_records(FILE *out, struct delta *d, char *text, long size, int seg)
+{
+	/* copy the records of segment "seg", text[0..size), that are not
+	 * hidden onto out
+	 */
+	struct seq key;
+	long pos, next;
+
+	for(pos = 0; pos < size; pos = next) {
+		next = next_record(text, size, pos);
+		if(record_key(text + pos, next - pos, &key) && delta_hides(d, &key, seg))
+			continue;
+		fwrite(text + pos, next - pos, 1, out);
+		}
+}
+
+ int
+delta_write_text(FILE *out, struct delta *d, char *text, long size)
+{
+	/* write ASCII sequence file text[0..size) with the segments merged
+	 * into it onto out, each record just as it was written.
+	 * Returns 0, or -1 on a write error.
+	 */
+	int seg;
+
+	write_records(out, d, text, size, 0);
+	if(size > 0 && text[size-1] != '\n') putc('\n', out);
+	for(seg = 1; seg <= d->n_segs; seg++)
+		write_records(out, d, d->text[seg], d->text_len[seg], seg);
+	return (fflush(out) == 0 && !ferror(out)) ? 0 : -1;
+}
+
+ int
+delta_append(char *seqfilename, char *deltafilename)
+{
+	/* append the chains and tombstones of file "deltafilename" to the
+	 * delta file of "seqfilename" as a new segment, writing it anew
+	 * under a temporary name that is then renamed.  Returns the number
+	 * of the segment, or -1 after a message.
+	 */
+	char filename[1024+16], tmpfilename[1024+32], buf[65536];
+	struct delta *d;
+	struct stat st;
+	FILE *in, *out;
+	size_t n;
+	int n_segs, n_new, last = '\n';
+
+	if(stat(seqfilename, &st) < 0) {
+		perror(seqfilename);
+		return -1;
+		}
+	sprintf(filename, "%s%s", seqfilename, DELTA_SUFFIX);
+	sprintf(tmpfilename, "%s.new", filename);
+	d = read_delta(filename, &n_segs);
+	if(n_segs < 0) return -1;
+	delta_close(d);
+	if((in = fopen(deltafilename, "r")) == NULL) {
+		perror(deltafilename);
+		return -1;
+		}
+	if((out = fopen(tmpfilename, "w")) == NULL) {
+		perror(tmpfilename);
+		fclose(in);
+		return -1;
+		}
+
+	/* the old segments, as they are */
+	if(n_segs > 0) {
+		FILE *old = fopen(filename, "r");
+
+		while(old != NULL && (n = fread(buf, 1, sizeof(buf), old)) > 0) {
+			fwrite(buf, 1, n, out);
+			last = buf[n-1];
+			}
+		if(old != NULL) fclose(old);
+		if(last != '\n') putc('\n', out);
+		}
+	fprintf(out, "%s %d\n", DELTA_MARK, n_segs + 1);
+	last = '\n';
+	while((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		fwrite(buf, 1, n, out);
+		last = buf[n-1];
+		}
+	if(last != '\n') putc('\n', out);
+	fclose(in);
+	if(fclose(out) != 0) {
+		perror(tmpfilename);
+		unlink(tmpfilename);
+		return -1;
+		}
+
+	/* it must read back as one more segment */
+	d = read_delta(tmpfilename, &n_new);
+	delta_close(d);
+	if(n_new != n_segs + 1) {
+		if(n_new >= 0)
+			fprintf(stderr, "%s: %s may not contain \"%s\" lines\n",
+			  pgmname, deltafilename, DELTA_MARK);
+		unlink(tmpfilename);
+		return -1;
+		}
+	if(rename(tmpfilename, filename) != 0) {
+		perror(filename);
+		unlink(tmpfilename);
+		return -1;
+		}
+	return n_segs + 1;
+}
+
+ void
+delta_close(struct delta *d)
+{
+	int i;
+
+	if(d == NULL) return;
+	for(i = 0; i < d->n_seqs; i++) free_seq(&d->seq[i]);
+	for(i = 1; i <= d->n_segs; i++) free(d->text[i]);
+	free(d->text);
+	free(d->text_len);
+	free(d->seq);
+	free(d->seg);
+	free(d->key);
+	free(d->filename);
+	free(d);
+}
@@ -0,0 +1,50 @@
+/* delta_subs.h:
+ *  delta segments of a sequence database ("SEQUENCE_FILE.delta"),
+ *  appended by sequery-mkdb -a and merged back by sequery-mkdb -c.
+ *
+ * A delta file is text, a series of segments, each begun by a line
+ *	#delta N
+ * and holding sequence records in the usual format (chains added or
+ * replaced) and "tombstone" lines
+ *	-NAME		every chain of entry NAME is removed
+ *	-NAME CHAIN	just that chain is removed
+ * A chain of the sequence file (segment 0) or of a segment is hidden
+ * if any later segment has a chain with the same name and chain ID, or
+ * a tombstone for it.  The database is then the chains of the sequence
+ * file that are not hidden, in order, followed by those of each segment
+ * in turn; so applying a segment twice, as when a sequence file has
+ * been compacted but its delta file not yet removed, changes nothing.
+ * Requires "resnum_subs.h".
+ */
+
+static char delta_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define DELTA_SUFFIX ".delta"
+#define DELTA_MARK "#delta"
+
+struct delta_key {
+	char name[12];		/* as fget_seq() leaves it, in lower case */
+	char chain[2];		/* "" for a tombstone of the whole entry */
+	int seg;		/* last segment to add or remove it */
+	};
+
+struct delta {
+	char *filename;
+	int n_segs;
+	struct seq *seq;	/* chains of all the segments, in order */
+	int *seg;		/* ... and the segment of each */
+	int n_seqs;
+	char **text;		/* sequence records of each segment, as written */
+	long *text_len;
+	struct delta_key *key;	/* hash table of names mentioned */
+	int n_keys;		/* ... its size, a power of 2 */
+	};
+
+struct delta * delta_open(char *seqfilename, int *n_segs);
+int delta_hides(struct delta *d, struct seq *seqp, int seg);
+struct seq * delta_apply(struct delta *d, struct seq *seq, int n_seqs, int *n_all);
+int delta_filter(struct delta *d, struct seq *seq, int n_seqs);
+int delta_append(char *seqfilename, char *deltafilename);
+int delta_write_text(FILE *out, struct delta *d, char *text, long size);
+void delta_close(struct delta *d);
@@ -0,0 +1,393 @@
+/* fmi_subs.c:
+ *  write and search FM-indexes of sequence databases.
+ *
+ * sequery-mkdb -f sorts every suffix of the database's text and writes
+ * the suffix array with its Burrows-Wheeler transform (fmi_write()).
+ * sequery maps it with fmi_open() and hands each pattern to fmi_plan(),
+ * which finds the pattern by "backward search": starting from its last
+ * residue, each step narrows a range of suffixes to those that also
+ * begin with the residue before.  A class such as [AGS] splits each
+ * range into one for each of its residues, so a pattern is followed
+ * along every way it can be spelt.  The time taken depends on the
+ * number of places the pattern occurs, not on the size of the database.
+ *
+ * Where the pattern may repeat a varying number of times (x*, .\{m,n\}
+ * and the like), the backward search cannot go on; each part of the
+ * pattern between such gaps is looked up on its own, the rarest gives
+ * the sequences to search in full.  Searches that would branch too
+ * widely (a run of dots) stop early, and the places found are checked
+ * against the whole pattern.
+ * See fmi_subs.h for the layout of the file.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "resnum_subs.h"
+#include "regex_subs.h"
+#include "kix_subs.h"
+#include "fmi_subs.h"
+
+extern char * pgmname;
+
+#define FMI_MAXRANGES 1024	/* most suffix ranges followed at once */
+#define FMI_MAXUNITS 256	/* pattern positions looked at */
+#define FMI_MINGAIN 16		/* use the index only if it rules out 15/16 of the database */
+
+ static void
+suffix_sort(unsigned char *t, uint32_t n, uint32_t *sa)
+{
+	/* sort the suffixes of t[0..n) into sa, by doubling: after the
+	 * pass for h, rank[i] orders suffix i by its first 2h codes
+	 */
+	uint32_t *rank, *tmp, *cnt, *swap;
+	uint32_t i, h, a, b, r, maxrank;
+
+	rank = (uint32_t *) malloc(n * sizeof(uint32_t));
+	tmp = (uint32_t *) malloc(n * sizeof(uint32_t));
+	cnt = (uint32_t *) calloc((n > FMI_NCODES ? n : FMI_NCODES) + 1, sizeof(uint32_t));
+
+	for(i = 0; i < n; i++) cnt[t[i]+1]++;
+	for(r = 1; r <= FMI_NCODES; r++) cnt[r] += cnt[r-1];
+	for(i = 0; i < n; i++) sa[cnt[t[i]]++] = i;
+	rank[sa[0]] = 0;
+	for(i = 1; i < n; i++)
+		rank[sa[i]] = rank[sa[i-1]] + (t[sa[i]] != t[sa[i-1]]);
+	maxrank = rank[sa[n-1]];
+
+#define SECOND(i) ((i) + h < n ? rank[(i) + h] : UINT32_MAX)
+	for(h = 1; maxrank < n-1; h *= 2) {
+		/* by second key, suffixes without one first ... */
+		r = 0;
+		for(i = n - h; i < n; i++) tmp[r++] = i;
+		for(i = 0; i < n; i++) if(sa[i] >= h) tmp[r++] = sa[i] - h;
+		/* ... then stably by first key */
+		memset(cnt, 0, (maxrank + 2) * sizeof(uint32_t));
+		for(i = 0; i < n; i++) cnt[rank[i]+1]++;
+		for(r = 1; r <= maxrank + 1; r++) cnt[r] += cnt[r-1];
+		for(i = 0; i < n; i++) sa[cnt[rank[tmp[i]]]++] = tmp[i];
+
+		tmp[sa[0]] = 0;
+		for(i = 1; i < n; i++) {
+			a = sa[i-1];
+			b = sa[i];
+			tmp[b] = tmp[a] + (rank[a] != rank[b] || SECOND(a) != SECOND(b));
+			}
+		maxrank = tmp[sa[n-1]];
+		swap = rank;
+		rank = tmp;
+		tmp = swap;
+		}
+#undef SECOND
+	free(rank);
+	free(tmp);
+	free(cnt);
+}
+
+ int
+fmi_write(FILE *out, char *seqfilename, struct seq *seq, int n_seqs)
+{
+	/* write the FM-index of seq[0..n_seqs), read from seqfilename, onto
+	 * out.  Returns 0, or -1 (with errno set) if out could not take it
+	 * or the database is too big to index.
+	 */
+	struct fmi_header hdr;
+	struct stat st;
+	unsigned char *t, *bwt;
+	uint32_t *sa, *start, (*occ)[FMI_NCODES];
+	uint32_t run[FMI_NCODES];	/* occurrences so far */
+	int64_t n = 0, nblocks, i;
+	int c, k, len;
+
+	for(k = 0; k < n_seqs; k++) n += strlen(seq[k].sequence) + 1;
+	if(n >= UINT32_MAX) {
+		errno = EFBIG;
+		return -1;
+		}
+
+	t = (unsigned char *) malloc(n + 1);
+	start = (uint32_t *) malloc((n_seqs + 1) * sizeof(uint32_t));
+	for(i = k = 0; k < n_seqs; k++) {
+		start[k] = i;
+		len = strlen(seq[k].sequence);
+		for(c = 0; c < len; c++)
+			t[i++] = KIX_CODE((unsigned char) seq[k].sequence[c]);
+		t[i++] = FMI_SEP;
+		}
+	start[n_seqs] = i;
+
+	sa = (uint32_t *) malloc((n ? n : 1) * sizeof(uint32_t));
+	if(n > 0) suffix_sort(t, n, sa);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memset(run, 0, sizeof(run));
+	bwt = (unsigned char *) malloc(n + 1);
+	nblocks = n / FMI_BLOCK + 1;
+	occ = (uint32_t (*)[FMI_NCODES]) malloc(nblocks * sizeof(*occ));
+	for(i = 0; i < n; i++) {
+		if(i % FMI_BLOCK == 0) memcpy(occ[i / FMI_BLOCK], run, sizeof(run));
+		bwt[i] = sa[i] == 0 ? FMI_SEP : t[sa[i]-1];
+		run[bwt[i]]++;
+		hdr.count[t[i]+1]++;
+		}
+	if(n % FMI_BLOCK == 0) memcpy(occ[n / FMI_BLOCK], run, sizeof(run));
+	free(t);
+
+	memcpy(hdr.magic, FMI_MAGIC, sizeof(hdr.magic));
+	hdr.version = FMI_VERSION;
+	hdr.byteorder = FMI_BYTEORDER;
+	hdr.n_seqs = n_seqs;
+	if(stat(seqfilename, &st) == 0) {
+		hdr.seqfile_size = st.st_size;
+		hdr.seqfile_mtime = st.st_mtime;
+		}
+	hdr.n = n;
+	for(c = 1; c <= FMI_NCODES; c++) hdr.count[c] += hdr.count[c-1];
+	hdr.bwt_off = sizeof(hdr);
+	hdr.occ_off = (hdr.bwt_off + n + 7) & ~7;
+	hdr.sa_off = hdr.occ_off + nblocks * sizeof(*occ);
+	hdr.start_off = hdr.sa_off + n * sizeof(uint32_t);
+
+	fwrite(&hdr, sizeof(hdr), 1, out);
+	fwrite(bwt, 1, n, out);
+	for(i = hdr.bwt_off + n; i < hdr.occ_off; i++) putc(0, out);
+	fwrite(occ, sizeof(*occ), nblocks, out);
+	fwrite(sa, sizeof(uint32_t), n, out);
+	fwrite(start, sizeof(uint32_t), n_seqs + 1, out);
+	free(bwt);
+	free(occ);
+	free(sa);
+	free(start);
+	return ferror(out) ? -1 : 0;
+}
+
+ struct fmi *
+fmi_open(char *seqfilename, int n_seqs)
+{
+	/* map the FM-index of seqfilename, which holds n_seqs sequences.
+	 * Returns NULL, silently if there is no index, or with a
+	 * message if it is out of date or otherwise of no use.
+	 */
+	struct fmi *fm;
+	struct fmi_header hdr;
+	struct stat st, seqst;
+	char *filename;
+	char *base;
+	int fd;
+
+	filename = (char *) malloc(strlen(seqfilename) + sizeof(".fmi"));
+	sprintf(filename, "%s.fmi", seqfilename);
+	if((fd = open(filename, O_RDONLY)) < 0) {
+		free(filename);
+		return NULL;
+		}
+	if(read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	  0 != memcmp(hdr.magic, FMI_MAGIC, sizeof(hdr.magic)) ||
+	  hdr.byteorder != FMI_BYTEORDER || hdr.version != FMI_VERSION ||
+	  fstat(fd, &st) < 0 ||
+	  hdr.start_off + (int64_t) (hdr.n_seqs + 1) * sizeof(uint32_t) > st.st_size) {
+		fprintf(stderr, "%s: %s is not an FM-index this program can use, rebuild it with sequery-mkdb -f\n",
+		  pgmname, filename);
+		goto fail;
+		}
+	if(stat(seqfilename, &seqst) < 0 || seqst.st_size != hdr.seqfile_size ||
+	  seqst.st_mtime != hdr.seqfile_mtime || n_seqs != hdr.n_seqs) {
+		fprintf(stderr, "%s: %s is out of date, not using it; rebuild it with sequery-mkdb -f\n",
+		  pgmname, filename);
+		goto fail;
+		}
+	base = (char *) mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(base == (char *) MAP_FAILED) {
+		perror(filename);
+		goto fail;
+		}
+	close(fd);
+
+	fm = (struct fmi *) calloc(1, sizeof(struct fmi));
+	fm->filename = filename;
+	fm->hdr = (struct fmi_header *) base;
+	fm->size = st.st_size;
+	fm->bwt = (unsigned char *) base + hdr.bwt_off;
+	fm->occ = (uint32_t (*)[FMI_NCODES]) (base + hdr.occ_off);
+	fm->sa = (uint32_t *) (base + hdr.sa_off);
+	fm->start = (uint32_t *) (base + hdr.start_off);
+	return fm;
+
+fail:
+	close(fd);
+	free(filename);
+	return NULL;
+}
+
+ void
+fmi_close(struct fmi *fm)
+{
+	if(fm == NULL) return;
+	munmap((void *) fm->hdr, fm->size);
+	free(fm->filename);
+	free(fm);
+}
+
+ static uint32_t
+occ(struct fmi *fm, int c, uint32_t i)
+{
+	/* occurrences of code c in bwt[0..i) */
+	uint32_t n = fm->occ[i / FMI_BLOCK][c];
+	unsigned char *p = fm->bwt + (i - i % FMI_BLOCK), *end = fm->bwt + i;
+
+	while(p < end) n += *p++ == c;
+	return n;
+}
+
+/* a range of the suffix array: suffixes sa[sp..ep) */
+struct range {
+	uint32_t sp, ep;
+	};
+
+/* the pattern laid out as in kix_plan(): one unit per residue where the
+ * pieces repeat a fixed number of times, a new run after each piece
+ * that may repeat a varying number of times
+ */
+struct unit {
+	uint32_t codes;		/* bit KIX_CODE(c) set if c matches */
+	int run;
+	};
+
+ static int
+backward(struct fmi *fm, struct unit *u, int a, int b, struct range *r,
+  int *p_left, int64_t *p_total)
+{
+	/* backward search for units u[a..b), as far left as it goes
+	 * without following more than FMI_MAXRANGES ranges.  Leaves the
+	 * ranges of suffixes beginning with u[*p_left..b) in r[], returns
+	 * how many; *p_total is the number of suffixes in them.
+	 */
+	struct range next[FMI_MAXRANGES];
+	int64_t *count = fm->hdr->count;
+	int nr = 1, nn, i, k, c, over;
+	uint32_t sp, ep;
+
+	r[0].sp = 0;
+	r[0].ep = fm->hdr->n;
+	*p_left = b;
+	for(k = b-1; k >= a && nr > 0; k--) {
+		nn = over = 0;
+		for(i = 0; i < nr && !over; i++)
+			for(c = 0; c < KIX_NCODES; c++) {
+				if(!((u[k].codes >> c) & 1)) continue;
+				sp = count[c] + occ(fm, c, r[i].sp);
+				ep = count[c] + occ(fm, c, r[i].ep);
+				if(sp >= ep) continue;
+				if(nn == FMI_MAXRANGES) {
+					over = 1;
+					break;
+					}
+				next[nn].sp = sp;
+				next[nn++].ep = ep;
+				}
+		if(over) break;
+		memcpy(r, next, nn * sizeof(struct range));
+		nr = nn;
+		*p_left = k;
+		}
+	for(*p_total = i = 0; i < nr; i++) *p_total += r[i].ep - r[i].sp;
+	return nr;
+}
+
+ static int
+compare_cands(const void *p, const void *q)
+{
+	uint64_t a = *(uint64_t *) p, b = *(uint64_t *) q;
+
+	return a < b ? -1 : a > b;
+}
+
+ int
+fmi_plan(struct fmi *fm, struct regex *re, int fixed,
+  struct kix_cand **p_cand, int *p_ncand)
+{
+	/* work out where pattern re can match, using index fm.  Arguments
+	 * and result as for kix_plan().
+	 */
+	struct unit u[FMI_MAXUNITS];
+	struct range r[FMI_MAXRANGES], best[FMI_MAXRANGES];
+	struct re_piece *pc;
+	int nu = 0, run = 0, nr, nbest = -1, left, bestleft = 0, a, b, i, c, lo, hi, s;
+	int64_t total, besttotal = 0, ncand, j;
+	uint32_t codes, p, st;
+	uint64_t *cand;
+
+	for(pc = re->piece; pc < &re->piece[re->npieces] && nu < FMI_MAXUNITS; pc++) {
+		codes = 0;
+		for(c = 1; c < 256; c++)
+			if(RE_ISMEMBER(pc, c)) codes |= (uint32_t) 1 << KIX_CODE(c);
+		for(i = 0; i < pc->min && nu < FMI_MAXUNITS; i++) {
+			u[nu].codes = codes;
+			u[nu++].run = run;
+			}
+		if(pc->max != pc->min) {
+			if(fixed) break; /* offsets past here unknown */
+			run++;
+			}
+		}
+
+	/* the run that occurs least often */
+	for(a = 0; a < nu; a = b) {
+		for(b = a; b < nu && u[b].run == u[a].run; b++) ;
+		nr = backward(fm, u, a, b, r, &left, &total);
+		if(left == b) continue; /* got nowhere */
+		if(nbest < 0 || total < besttotal) {
+			memcpy(best, r, nr * sizeof(struct range));
+			nbest = nr;
+			bestleft = left;
+			besttotal = total;
+			}
+		}
+	if(nbest < 0 || besttotal > fm->hdr->n / FMI_MINGAIN) return KIX_SCAN;
+
+	/* where those suffixes are */
+	cand = (uint64_t *) malloc((besttotal ? besttotal : 1) * sizeof(uint64_t));
+	ncand = 0;
+	for(i = 0; i < nbest; i++)
+		for(p = best[i].sp; p < best[i].ep; p++) {
+			st = fm->sa[p];
+			for(lo = 0, hi = fm->hdr->n_seqs; hi - lo > 1; ) {
+				s = (lo + hi) / 2;
+				if(fm->start[s] <= st) lo = s;
+				else hi = s;
+				}
+			if(!fixed) cand[ncand++] = (uint64_t) lo << 32;
+			else if(st >= fm->start[lo] + bestleft)
+				cand[ncand++] = (uint64_t) lo << 32 |
+				  (st - bestleft - fm->start[lo]);
+			}
+	qsort(cand, ncand, sizeof(uint64_t), compare_cands);
+
+	*p_cand = (struct kix_cand *) malloc((ncand ? ncand : 1) * sizeof(struct kix_cand));
+	*p_ncand = 0;
+	for(j = 0; j < ncand; j++) {
+		if(j > 0 && cand[j] == cand[j-1]) continue;
+		(*p_cand)[*p_ncand].seq = cand[j] >> 32;
+		(*p_cand)[(*p_ncand)++].start = fixed ? (int) (cand[j] & 0xFFFFFFFF) : -1;
+		}
+	free(cand);
+
+	/* sequences searched in full: worth it only if few of them */
+	if(!fixed && *p_ncand > fm->hdr->n_seqs / FMI_MINGAIN) {
+		free(*p_cand);
+		return KIX_SCAN;
+		}
+	return fixed ? KIX_POSITIONS : KIX_SEQUENCES;
+}
@@ -0,0 +1,63 @@
+/* fmi_subs.h:
+ *  layout of the FM-index ("SEQUENCE_FILE.fmi") written by
+ *  sequery-mkdb -f and mapped read-only by sequery.
+ *
+ * The index is built over the text of every sequence, one after the
+ * other, each followed by a separator; residues are coded as in the
+ * k-mer index (KIX_CODE(): 1..26 for 'A'..'Z', 0 for anything else)
+ * and the separator is FMI_SEP.  A file contains, in order:
+ *	struct fmi_header
+ *	unsigned char bwt[n]		Burrows-Wheeler transform of the text:
+ *					the code before each suffix, in order
+ *					of suffix (FMI_SEP before the first)
+ *	uint32_t occ[n/FMI_BLOCK+1][FMI_NCODES]	occurrences of each code in
+ *					bwt[0..FMI_BLOCK*i)
+ *	uint32_t sa[n]			suffix array: where each suffix begins
+ *	uint32_t start[n_seqs+1]	where each sequence begins in the text
+ * Like images, an index is specific to the byte order of the machine
+ * that made it, and is ignored if the sequence file changes.
+ * Requires <stdio.h>, <stdint.h>, "resnum_subs.h", "regex_subs.h" and
+ * "kix_subs.h".
+ */
+
+static char fmi_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define FMI_MAGIC "SQFM"
+#define FMI_VERSION 1
+#define FMI_BYTEORDER 0x01020304
+
+#define FMI_SEP KIX_NCODES	/* code of the separator after each sequence */
+#define FMI_NCODES (KIX_NCODES+1)
+#define FMI_BLOCK 64		/* bwt positions between occ[] checkpoints */
+
+struct fmi_header {
+	char magic[4];		/* FMI_MAGIC, not '\0'-terminated */
+	int32_t version;	/* FMI_VERSION */
+	int32_t byteorder;	/* FMI_BYTEORDER as written */
+	int32_t n_seqs;		/* sequences indexed */
+	int64_t seqfile_size;	/* sequence file indexed, as stat(2) gave it */
+	int64_t seqfile_mtime;
+	int64_t n;		/* length of the text, separators included */
+	int64_t count[FMI_NCODES+1]; /* suffixes beginning with a code less than c */
+	int64_t bwt_off;
+	int64_t occ_off;
+	int64_t sa_off;
+	int64_t start_off;
+	};
+
+struct fmi {
+	char *filename;
+	struct fmi_header *hdr;	/* the mapped file */
+	size_t size;
+	unsigned char *bwt;
+	uint32_t (*occ)[FMI_NCODES];
+	uint32_t *sa;
+	uint32_t *start;
+	};
+
+int fmi_write(FILE *out, char *seqfilename, struct seq *seq, int n_seqs);
+struct fmi * fmi_open(char *seqfilename, int n_seqs);
+int fmi_plan(struct fmi *fm, struct regex *re, int fixed,
+  struct kix_cand **p_cand, int *p_ncand);
+void fmi_close(struct fmi *fm);
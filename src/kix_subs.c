@@ -0,0 +1,382 @@
+/* kix_subs.c:
+ *  write and use k-mer indexes of sequence databases.
+ *
+ * sequery-mkdb -k writes an index of every KIX_K-residue run in the
+ * database with kix_write().  sequery maps it with kix_open() and, for
+ * each pattern, asks kix_plan() whether the index can narrow down the
+ * search: every match of a pattern such as YW[RA][YWF]AQ contains the
+ * k-mers YW[RA], W[RA][YWF], ..., so only the places where the rarest
+ * of them occur (and, checked against each other, the other rare ones)
+ * need to be looked at.  Patterns made only of common residues and
+ * wide classes are not helped, and are searched for as before.
+ * See kix_subs.h for the layout of the file.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "resnum_subs.h"
+#include "regex_subs.h"
+#include "kix_subs.h"
+
+extern char * pgmname;
+
+#define KIX_MAXKEYS 64		/* most keys a window of the pattern may stand for */
+#define KIX_MAXUNITS 256	/* pattern positions looked at */
+#define KIX_MAXWINDOWS 4	/* most windows whose candidates are intersected */
+#define KIX_MINGAIN 16		/* use the index only if it rules out 15/16 of the database */
+#define KIX_MAXRATIO 8		/* ... and intersect windows up to 8 times as common as the best */
+
+ static void
+put_varint(unsigned char **p, uint64_t v)
+{
+	while(v >= 0x80) {
+		*(*p)++ = (v & 0x7F) | 0x80;
+		v >>= 7;
+		}
+	*(*p)++ = v;
+}
+
+ static uint64_t
+get_varint(unsigned char **p)
+{
+	uint64_t v = 0;
+	int shift = 0;
+
+	while(**p & 0x80) {
+		v |= (uint64_t) (*(*p)++ & 0x7F) << shift;
+		shift += 7;
+		}
+	v |= (uint64_t) *(*p)++ << shift;
+	return v;
+}
+
+ static int
+key_at(unsigned char *s)
+{
+	return (KIX_CODE(s[0]) * KIX_NCODES + KIX_CODE(s[1])) * KIX_NCODES +
+	  KIX_CODE(s[2]);
+}
+
+ int
+kix_write(FILE *out, char *seqfilename, struct seq *seq, int n_seqs)
+{
+	/* write the index of seq[0..n_seqs), read from seqfilename, onto out.
+	 * Returns 0, or -1 if out could not take it.
+	 */
+	struct kix_header hdr;
+	struct stat st;
+	int64_t *dir, *count, *next, n = 0;
+	int32_t (*occ)[2];	/* sequence and position, in order of key */
+	unsigned char *post, *p, *s;
+	int i, k, len, pos, lastseq, lastpos;
+	int64_t j;
+
+	count = (int64_t *) calloc(KIX_NKEYS, sizeof(int64_t));
+	for(i = 0; i < n_seqs; i++) {
+		s = (unsigned char *) seq[i].sequence;
+		len = strlen(seq[i].sequence);
+		for(pos = 0; pos + KIX_K <= len; pos++) count[key_at(s+pos)]++;
+		}
+
+	/* sort the occurrences by key; within a key they stay in order */
+	next = (int64_t *) malloc(KIX_NKEYS * sizeof(int64_t));
+	for(k = 0; k < KIX_NKEYS; k++) {
+		next[k] = n;
+		n += count[k];
+		}
+	occ = (int32_t (*)[2]) malloc((n ? n : 1) * sizeof(*occ));
+	for(i = 0; i < n_seqs; i++) {
+		s = (unsigned char *) seq[i].sequence;
+		len = strlen(seq[i].sequence);
+		for(pos = 0; pos + KIX_K <= len; pos++) {
+			j = next[key_at(s+pos)]++;
+			occ[j][0] = i;
+			occ[j][1] = pos;
+			}
+		}
+
+	/* no occurrence takes more than 10 bytes */
+	dir = (int64_t *) malloc((KIX_NKEYS+1) * sizeof(int64_t));
+	p = post = (unsigned char *) malloc(10 * n + 1);
+	for(j = k = 0; k < KIX_NKEYS; k++) {
+		dir[k] = p - post;
+		lastseq = lastpos = 0;
+		for(; j < next[k]; j++) {
+			put_varint(&p, occ[j][0] - lastseq);
+			put_varint(&p, occ[j][0] == lastseq ? occ[j][1] - lastpos : occ[j][1]);
+			lastseq = occ[j][0];
+			lastpos = occ[j][1];
+			}
+		}
+	dir[KIX_NKEYS] = p - post;
+	free(occ);
+	free(next);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, KIX_MAGIC, sizeof(hdr.magic));
+	hdr.version = KIX_VERSION;
+	hdr.byteorder = KIX_BYTEORDER;
+	hdr.k = KIX_K;
+	hdr.n_seqs = n_seqs;
+	if(stat(seqfilename, &st) == 0) {
+		hdr.seqfile_size = st.st_size;
+		hdr.seqfile_mtime = st.st_mtime;
+		}
+	hdr.n_residues = n;
+	hdr.dir_off = sizeof(hdr);
+	hdr.count_off = hdr.dir_off + (KIX_NKEYS+1) * sizeof(int64_t);
+	hdr.post_off = hdr.count_off + KIX_NKEYS * sizeof(int64_t);
+	hdr.post_size = dir[KIX_NKEYS];
+
+	fwrite(&hdr, sizeof(hdr), 1, out);
+	fwrite(dir, sizeof(int64_t), KIX_NKEYS+1, out);
+	fwrite(count, sizeof(int64_t), KIX_NKEYS, out);
+	fwrite(post, 1, hdr.post_size, out);
+	free(dir);
+	free(count);
+	free(post);
+	return ferror(out) ? -1 : 0;
+}
+
+ struct kix *
+kix_open(char *seqfilename, int n_seqs)
+{
+	/* map the index of seqfilename, which holds n_seqs sequences.
+	 * Returns NULL, silently if there is no index, or with a
+	 * message if it is out of date or otherwise of no use.
+	 */
+	struct kix *kx;
+	struct kix_header hdr;
+	struct stat st, seqst;
+	char *filename;
+	void *base;
+	int fd;
+
+	filename = (char *) malloc(strlen(seqfilename) + sizeof(".kix"));
+	sprintf(filename, "%s.kix", seqfilename);
+	if((fd = open(filename, O_RDONLY)) < 0) {
+		free(filename);
+		return NULL;
+		}
+	if(read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	  0 != memcmp(hdr.magic, KIX_MAGIC, sizeof(hdr.magic)) ||
+	  hdr.byteorder != KIX_BYTEORDER || hdr.version != KIX_VERSION ||
+	  hdr.k != KIX_K || fstat(fd, &st) < 0 ||
+	  hdr.post_off + hdr.post_size > st.st_size) {
+		fprintf(stderr, "%s: %s is not a k-mer index this program can use, rebuild it with sequery-mkdb -k\n",
+		  pgmname, filename);
+		goto fail;
+		}
+	if(stat(seqfilename, &seqst) < 0 || seqst.st_size != hdr.seqfile_size ||
+	  seqst.st_mtime != hdr.seqfile_mtime || n_seqs != hdr.n_seqs) {
+		fprintf(stderr, "%s: %s is out of date, not using it; rebuild it with sequery-mkdb -k\n",
+		  pgmname, filename);
+		goto fail;
+		}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if(base == MAP_FAILED) {
+		perror(filename);
+		goto fail;
+		}
+	close(fd);
+
+	kx = (struct kix *) calloc(1, sizeof(struct kix));
+	kx->filename = filename;
+	kx->hdr = (struct kix_header *) base;
+	kx->size = st.st_size;
+	kx->dir = (int64_t *) ((char *) base + hdr.dir_off);
+	kx->count = (int64_t *) ((char *) base + hdr.count_off);
+	kx->post = (unsigned char *) base + hdr.post_off;
+	return kx;
+
+fail:
+	close(fd);
+	free(filename);
+	return NULL;
+}
+
+ void
+kix_close(struct kix *kx)
+{
+	if(kx == NULL) return;
+	munmap((void *) kx->hdr, kx->size);
+	free(kx->filename);
+	free(kx);
+}
+
+/* Planning: the pattern is laid out as "units", one per residue it
+ * matches where each piece repeats a fixed number of times.  A piece
+ * that may repeat a varying number of times ends a "run" of units
+ * after its minimum; the units of a window of KIX_K must come from
+ * the same run.  Each unit stands for a set of codes.
+ */
+struct unit {
+	uint32_t codes;		/* bit KIX_CODE(c) set if c matches */
+	int run;
+	};
+
+struct window {
+	int at;			/* first unit */
+	int64_t cost;		/* occurrences of all its keys */
+	};
+
+ static int
+compare_windows(const void *p, const void *q)
+{
+	struct window *a = (struct window *) p, *b = (struct window *) q;
+
+	return a->cost < b->cost ? -1 : a->cost > b->cost;
+}
+
+ static int
+compare_cands(const void *p, const void *q)
+{
+	uint64_t a = *(uint64_t *) p, b = *(uint64_t *) q;
+
+	return a < b ? -1 : a > b;
+}
+
+ static int
+nkeys(struct unit *u, int *keys)
+{
+	/* the keys window u[0..KIX_K) stands for, into keys[] unless more
+	 * than KIX_MAXKEYS.  Returns how many.
+	 */
+	int prefix[KIX_MAXKEYS];
+	int n = 1, m, i, j, c;
+
+	for(i = 0; i < KIX_K; i++) {
+		for(m = 0, c = 0; c < KIX_NCODES; c++) m += (u[i].codes >> c) & 1;
+		n *= m;
+		if(n > KIX_MAXKEYS) return n;
+		}
+	keys[0] = 0;
+	for(n = 1, i = 0; i < KIX_K; i++) {
+		memcpy(prefix, keys, n * sizeof(int));
+		for(m = 0, c = 0; c < KIX_NCODES; c++) {
+			if(!((u[i].codes >> c) & 1)) continue;
+			for(j = 0; j < n; j++) keys[m++] = prefix[j] * KIX_NCODES + c;
+			}
+		n = m;
+		}
+	return n;
+}
+
+ static uint64_t *
+candidates(struct kix *kx, struct unit *u, int at, int fixed, int64_t *p_n)
+{
+	/* sorted, distinct candidates from window u[at..at+KIX_K):
+	 * (sequence << 32 | start of match) if fixed, else (sequence << 32)
+	 */
+	int keys[KIX_MAXKEYS];
+	int nk, i, seq, pos;
+	int64_t n = 0, m;
+	uint64_t *cand;
+	unsigned char *p, *end;
+
+	nk = nkeys(&u[at], keys);
+	for(i = 0; i < nk; i++) n += kx->count[keys[i]];
+	cand = (uint64_t *) malloc((n ? n : 1) * sizeof(uint64_t));
+	n = 0;
+	for(i = 0; i < nk; i++) {
+		p = kx->post + kx->dir[keys[i]];
+		end = kx->post + kx->dir[keys[i]+1];
+		seq = pos = 0;
+		while(p < end) {
+			m = get_varint(&p);
+			seq += m;
+			pos = m == 0 ? pos + get_varint(&p) : get_varint(&p);
+			if(!fixed) cand[n++] = (uint64_t) seq << 32;
+			else if(pos >= at) cand[n++] = (uint64_t) seq << 32 | (pos - at);
+			}
+		}
+	qsort(cand, n, sizeof(uint64_t), compare_cands);
+	for(m = i = 0; m < n; m++)
+		if(i == 0 || cand[m] != cand[i-1]) cand[i++] = cand[m];
+	*p_n = i;
+	return cand;
+}
+
+ int
+kix_plan(struct kix *kx, struct regex *re, int fixed,
+  struct kix_cand **p_cand, int *p_ncand)
+{
+	/* work out where pattern re can match, using index kx.
+	 * "fixed" is true if every match is re->minlen long and every
+	 * place it matches is reported (no ^ or $, no varying repeats).
+	 * Returns KIX_SCAN if the index is no help, otherwise
+	 * KIX_POSITIONS or KIX_SEQUENCES and a malloc'ed array
+	 * *p_cand of *p_ncand candidates in order.
+	 */
+	struct unit u[KIX_MAXUNITS];
+	struct window w[KIX_MAXUNITS];
+	struct re_piece *pc;
+	int keys[KIX_MAXKEYS];
+	int nu = 0, nw = 0, run = 0, i, j, k, c, nk;
+	uint64_t *cand, *more;
+	int64_t ncand, nmore, a, b, n;
+	uint32_t codes;
+
+	for(pc = re->piece; pc < &re->piece[re->npieces] && nu < KIX_MAXUNITS; pc++) {
+		codes = 0;
+		for(c = 1; c < 256; c++)
+			if(RE_ISMEMBER(pc, c)) codes |= (uint32_t) 1 << KIX_CODE(c);
+		for(i = 0; i < pc->min && nu < KIX_MAXUNITS; i++) {
+			u[nu].codes = codes;
+			u[nu++].run = run;
+			}
+		if(pc->max != pc->min) {
+			if(fixed) break; /* offsets past here unknown */
+			run++;
+			}
+		}
+
+	for(i = 0; i + KIX_K <= nu; i++) {
+		if(u[i].run != u[i+KIX_K-1].run) continue;
+		if((nk = nkeys(&u[i], keys)) > KIX_MAXKEYS) continue;
+		w[nw].at = i;
+		w[nw].cost = 0;
+		for(k = 0; k < nk; k++) w[nw].cost += kx->count[keys[k]];
+		nw++;
+		}
+	if(nw == 0) return KIX_SCAN;
+	qsort(w, nw, sizeof(struct window), compare_windows);
+	if(w[0].cost > kx->hdr->n_residues / KIX_MINGAIN) return KIX_SCAN;
+
+	cand = candidates(kx, u, w[0].at, fixed, &ncand);
+	for(i = 1; i < nw && i < KIX_MAXWINDOWS && ncand > 0 &&
+	  w[i].cost <= KIX_MAXRATIO * w[0].cost; i++) {
+		more = candidates(kx, u, w[i].at, fixed, &nmore);
+		for(n = a = b = 0; a < ncand && b < nmore; ) {
+			if(cand[a] < more[b]) a++;
+			else if(cand[a] > more[b]) b++;
+			else {
+				cand[n++] = cand[a++];
+				b++;
+				}
+			}
+		ncand = n;
+		free(more);
+		}
+
+	*p_cand = (struct kix_cand *) malloc((ncand ? ncand : 1) * sizeof(struct kix_cand));
+	for(j = 0; j < ncand; j++) {
+		(*p_cand)[j].seq = cand[j] >> 32;
+		(*p_cand)[j].start = fixed ? (int) (cand[j] & 0xFFFFFFFF) : -1;
+		}
+	*p_ncand = ncand;
+	free(cand);
+	return fixed ? KIX_POSITIONS : KIX_SEQUENCES;
+}
@@ -0,0 +1,75 @@
+/* kix_subs.h:
+ *  layout of the k-mer index ("SEQUENCE_FILE.kix") written by
+ *  sequery-mkdb -k and mapped read-only by sequery.
+ *
+ * For every run of KIX_K residues ("k-mer") the index lists where in
+ * the database it occurs.  Residues are coded 1..26 for 'A'..'Z' and 0
+ * for anything else, so each k-mer is one of KIX_NKEYS "keys".  A file
+ * contains, in order:
+ *	struct kix_header
+ *	int64_t dir[KIX_NKEYS+1]	postings of key k are post[dir[k]..dir[k+1])
+ *	int64_t count[KIX_NKEYS]	number of occurrences of key k
+ *	postings			occurrences of each key in order of
+ *					sequence, then position, as varints
+ * Each occurrence is stored as the difference from the previous
+ * sequence number and then, if that was 0, the difference from the
+ * previous position, otherwise the position itself.  Varints are
+ * 7 bits a byte, low bits first, the top bit set on all but the last.
+ * Like images, an index is specific to the byte order of the machine
+ * that made it; it records the size and time of the sequence file it
+ * was made from and is ignored if they no longer agree.
+ * Requires <stdio.h>, <stdint.h>, "resnum_subs.h" and "regex_subs.h".
+ */
+
+static char kix_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define KIX_MAGIC "SQKX"
+#define KIX_VERSION 1
+#define KIX_BYTEORDER 0x01020304
+
+#define KIX_K 3			/* residues in a k-mer */
+#define KIX_NCODES 27		/* 'A'-'Z' are 1..26, anything else 0 */
+#define KIX_NKEYS (KIX_NCODES*KIX_NCODES*KIX_NCODES)
+#define KIX_CODE(c) ((c) >= 'A' && (c) <= 'Z' ? (c) - 'A' + 1 : 0)
+
+struct kix_header {
+	char magic[4];		/* KIX_MAGIC, not '\0'-terminated */
+	int32_t version;	/* KIX_VERSION */
+	int32_t byteorder;	/* KIX_BYTEORDER as written */
+	int32_t k;		/* KIX_K */
+	int32_t n_seqs;		/* sequences indexed */
+	int32_t pad;
+	int64_t seqfile_size;	/* sequence file indexed, as stat(2) gave it */
+	int64_t seqfile_mtime;
+	int64_t n_residues;	/* k-mers indexed, all keys */
+	int64_t dir_off;	/* int64_t dir[KIX_NKEYS+1] */
+	int64_t count_off;	/* int64_t count[KIX_NKEYS] */
+	int64_t post_off;	/* postings */
+	int64_t post_size;
+	};
+
+struct kix {
+	char *filename;
+	struct kix_header *hdr;	/* the mapped file */
+	size_t size;
+	int64_t *dir;
+	int64_t *count;
+	unsigned char *post;
+	};
+
+/* Candidates from kix_plan(): where the pattern may match */
+struct kix_cand {
+	int seq;		/* sequence number */
+	int start;		/* KIX_POSITIONS: where a match would begin */
+	};
+
+#define KIX_SCAN 0		/* index no help, search every sequence */
+#define KIX_POSITIONS 1		/* candidates are the only possible matches */
+#define KIX_SEQUENCES 2		/* candidates are the only sequences to search */
+
+int kix_write(FILE *out, char *seqfilename, struct seq *seq, int n_seqs);
+struct kix * kix_open(char *seqfilename, int n_seqs);
+int kix_plan(struct kix *kx, struct regex *re, int fixed,
+  struct kix_cand **p_cand, int *p_ncand);
+void kix_close(struct kix *kx);
@@ -0,0 +1,155 @@
+/* matcher_subs.c:
+ *  compile a pattern once and send each search to the fastest engine
+ *  able to run it: the bit-parallel kernel of bitpar_subs.c for
+ *  fixed-length patterns, the DFA of regex_subs.c for everything else.
+ *  All engines report the same leftmost match.  A query scored with a
+ *  substitution matrix (score_subs.c) is matched through here too, so
+ *  it is searched for and reported like any pattern.  So is a pattern
+ *  allowed a few edits (sequery -k), which only the bit-parallel
+ *  matcher can look for.  Where a database is packed (pack_subs.c)
+ *  the word kernel reads the packed residues instead of the text.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "regex_subs.h"
+#include "bitpar_subs.h"
+#include "score_subs.h"
+#include "matcher_subs.h"
+
+ char *
+matcher_compile(char *pattern, struct matcher **mp)
+{
+	/* set *mp to a new matcher for "pattern".  Returns NULL if all is
+	 * well, otherwise an error message (and *mp is NULL).
+	 */
+	struct matcher *m;
+	char *msg;
+
+	*mp = NULL;
+	m = (struct matcher *) calloc(1, sizeof(struct matcher));
+	if((msg = regex_parse(pattern, &m->re)) != NULL) {
+		free(m);
+		return msg;
+		}
+	m->dfa = dfa_build(&m->re);
+	m->sa = shiftand_build(&m->re);
+	*mp = m;
+	return NULL;
+}
+
+ char *
+matcher_score(char *peptide, struct scoremat *mat, int threshold,
+  struct matcher **mp)
+{
+	/* set *mp to a new matcher of the windows scoring at least
+	 * "threshold" against "peptide" with "mat".  Returns as
+	 * matcher_compile() does.
+	 */
+	struct matcher *m;
+	char *msg;
+
+	*mp = NULL;
+	m = (struct matcher *) calloc(1, sizeof(struct matcher));
+	if((msg = score_build(peptide, mat, threshold, &m->sc)) != NULL) {
+		free(m);
+		return msg;
+		}
+	*mp = m;
+	return NULL;
+}
+
+ char *
+matcher_approx(struct matcher *m, int k)
+{
+	/* let matches of m have up to k residues changed, inserted or left
+	 * out.  Returns NULL if all is well, otherwise an error message.
+	 */
+	static char msg[80];
+
+	if(k <= 0) return NULL;
+	if(m->sa == NULL) return "-k needs a pattern of fixed length";
+	if(k > SA_MAXK) {
+		sprintf(msg, "-k allows at most %d edits", SA_MAXK);
+		return msg;
+		}
+	if(k >= m->sa->len) {
+		sprintf(msg, "-k must be less than the pattern's length, %d",
+		  m->sa->len);
+		return msg;
+		}
+	m->k = k;
+	return NULL;
+}
+
+ struct matcher *
+matcher_clone(struct matcher *m)
+{
+	/* a separate copy of m, for another thread: the DFA builds its
+	 * states as it goes, so two threads may not share one.
+	 */
+	struct matcher *c;
+
+	c = (struct matcher *) calloc(1, sizeof(struct matcher));
+	if(m->sc != NULL) {
+		c->sc = (struct scorer *) malloc(sizeof(struct scorer));
+		*c->sc = *m->sc;
+		return c;
+		}
+	c->re = m->re;
+	c->re.piece = (struct re_piece *)
+	  malloc((m->re.npieces+1) * sizeof(struct re_piece));
+	memcpy(c->re.piece, m->re.piece, m->re.npieces * sizeof(struct re_piece));
+	c->dfa = dfa_build(&c->re);
+	c->sa = shiftand_build(&c->re);
+	c->k = m->k;
+	return c;
+}
+
+ int
+matcher_match(struct matcher *m, char *string, int len, int *p_bgn, int *p_len)
+{
+	if(m->sc != NULL) return score_match(m->sc, string, len, p_bgn, p_len);
+	if(m->k > 0)
+		return approx_match(m->sa, m->k, string, len, p_bgn, p_len, &m->edits);
+	if(m->sa != NULL) return shiftand_match(m->sa, string, len, p_bgn, p_len);
+	return dfa_match(m->dfa, string, len, p_bgn, p_len);
+}
+
+ int
+matcher_packed(struct matcher *m)
+{
+	/* true if m is best matched against packed residues: the vector
+	 * kernels, the DFA and the others read the text
+	 */
+	return m->sc == NULL && m->k == 0 && m->sa != NULL &&
+	  m->sa->kernel == SA_SCALAR;
+}
+
+ int
+matcher_match_packed(struct matcher *m, uint64_t *words, int bits,
+  int from, int len, int *p_bgn, int *p_len)
+{
+	/* as matcher_match() on residues [from..len) of a packed sequence,
+	 * for an m of which matcher_packed() is true
+	 */
+	return shiftand_match_packed(m->sa, words, bits, from, len, p_bgn, p_len);
+}
+
+ void
+matcher_free(struct matcher *m)
+{
+	if(m == NULL) return;
+	dfa_free(m->dfa);
+	if(m->sa != NULL) free(m->sa);
+	if(m->sc != NULL) free(m->sc);
+	regex_free(&m->re);
+	free(m);
+}
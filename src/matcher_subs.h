@@ -0,0 +1,28 @@
+/* matcher_subs.h:
+ *  a compiled pattern, matched by whichever engine suits it best.
+ *  Requires <stdint.h>, "regex_subs.h", "bitpar_subs.h" and "score_subs.h".
+ */
+
+static char matcher_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+struct matcher {
+	struct regex re;	/* the parsed pattern */
+	struct dfa *dfa;	/* general engine, handles any pattern */
+	struct shiftand *sa;	/* fixed-length patterns, or NULL */
+	struct scorer *sc;	/* a query scored by a matrix (-M), or NULL,
+				 * when there is no pattern and no DFA */
+	int k;			/* edits a match may have (-k), with sa */
+	int edits;		/* ... and those of the last match */
+	};
+
+char * matcher_compile(char *pattern, struct matcher **mp);
+char * matcher_score(char *peptide, struct scoremat *mat, int threshold,
+  struct matcher **mp);
+char * matcher_approx(struct matcher *m, int k);
+struct matcher * matcher_clone(struct matcher *m);
+int matcher_match(struct matcher *m, char *string, int len, int *p_bgn, int *p_len);
+int matcher_packed(struct matcher *m);
+int matcher_match_packed(struct matcher *m, uint64_t *words, int bits,
+  int from, int len, int *p_bgn, int *p_len);
+void matcher_free(struct matcher *m);
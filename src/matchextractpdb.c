@@ -13,12 +13,286 @@ static char rcsid[] =
 #endif
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 
 #include "resnum_subs.h" /* defines seq structure & access functions. */
+#include "seqfile_subs.h" /* loads ASCII or binary sequence files */
+#include "pdbx_subs.h" /* index of PDB coordinate files */
+#include "pool_subs.h" /* threads for -j */
 
 #define MAXSEQLEN 2048
-#define MAXNSEQ 8000
+
+char * pgmname;
+static int context_pre=6;
+static int context_post=6;
+
+/* hash table of the sequences by entry and chain: the number of the
+ * first sequence of each, or -1 for an empty slot
+ */
+static int *seq_hash;
+static unsigned seq_hash_mask;
+
+ static unsigned
+hash_name(name, chain)
+char *name, *chain;
+{
+	unsigned h = 2166136261u; /* FNV-1a */
+
+	while(*name) h = (h ^ (unsigned char) *name++) * 16777619u;
+	h = (h ^ (unsigned char) chain[0]) * 16777619u;
+	return h;
+}
+
+ static void
+hash_seqs(seq, n_seqs)
+struct seq *seq;
+int n_seqs;
+{
+	int i;
+	unsigned h;
+
+	for(seq_hash_mask = 1; seq_hash_mask < 2*n_seqs; seq_hash_mask <<= 1);
+	seq_hash = (int *) malloc(seq_hash_mask * sizeof(int));
+	memset(seq_hash, -1, seq_hash_mask * sizeof(int));
+	seq_hash_mask--;
+	for(i = 0; i < n_seqs; i++) {
+		for(h = hash_name(seq[i].name, seq[i].chain) & seq_hash_mask;
+		  seq_hash[h] >= 0; h = (h+1) & seq_hash_mask)
+			if(strcmp(seq[seq_hash[h]].name, seq[i].name) == 0 &&
+			  strcmp(seq[seq_hash[h]].chain, seq[i].chain) == 0)
+				break; /* keep the first */
+		if(seq_hash[h] < 0) seq_hash[h] = i;
+		}
+}
+
+ static struct seq *
+find_seq(seq, name, chain)
+struct seq *seq;
+char *name, *chain;
+{
+	/* the first sequence of entry "name", chain "chain", or NULL */
+	unsigned h;
+
+	for(h = hash_name(name, chain) & seq_hash_mask; seq_hash[h] >= 0;
+	  h = (h+1) & seq_hash_mask)
+		if(strcmp(seq[seq_hash[h]].name, name) == 0 &&
+		  strcmp(seq[seq_hash[h]].chain, chain) == 0)
+			return &seq[seq_hash[h]];
+	return NULL;
+}
+
+ static void
+fragment_names(seqp, start_res, stop_res, start_name, stop_name)
+struct seq *seqp;
+char *start_res, *stop_res; /* first and last residue of a match */
+char *start_name, *stop_name; /* modified: the same, with context */
+{
+	/* names of the first and last residue to extract for a match */
+	int start_index,stop_index;
+
+	if((start_index=resnum_index(seqp,start_res))<0) start_index=seqp->len;
+	if((stop_index=resnum_index(seqp,stop_res))<0) stop_index=seqp->len;
+	start_index-=context_pre;
+	stop_index+=context_post;
+	if (start_index<0) start_index=0;
+	if (stop_index>seqp->len-1) stop_index=seqp->len-1;
+	start_name[0]=stop_name[0]='\0';
+	get_resnumber(start_index,seqp,start_name);
+	get_resnumber(stop_index,seqp,stop_name);
+}
+
+/* -j: the whole match file is read first and the matches ("fragments")
+ * grouped by entry; each entry's PDB file is then mapped once, looked
+ * through once for where its residues begin, and every fragment of the
+ * entry cut out of it, with the entries shared out among the threads.
+ * Messages are held back and written in the order of the match file, so
+ * the files and messages are those of matches done one at a time.
+ */
+struct frag {
+	char pdbcode[12], chain[2];
+	char start_res[8], stop_res[8];
+	char start_name[16], stop_name[16];
+	char *msg; /* for stderr, malloc'ed, or NULL */
+	int fatal; /* msg ends the run */
+	};
+
+struct batch {
+	struct frag *frag;
+	int *order; /* fragments by entry, then in input order */
+	int *first; /* entry e has order[first[e]..first[e+1]) */
+	char *pdb_dir, *baby_dir;
+	struct pdbx *px;
+	};
+
+static struct frag *sort_frag; /* for order_cmp() */
+
+ static int
+order_cmp(a, b)
+const void *a, *b;
+{
+	int c = strcmp(sort_frag[*(int *)a].pdbcode, sort_frag[*(int *)b].pdbcode);
+
+	return c!=0 ? c : *(int *)a - *(int *)b;
+}
+
+ static void
+add_msg(fr, msg)
+struct frag *fr;
+char *msg;
+{
+	int len = fr->msg==NULL ? 0 : strlen(fr->msg);
+
+	fr->msg = realloc(fr->msg, len+strlen(msg)+1);
+	strcpy(fr->msg+len, msg);
+}
+
+ static void
+batch_entry(arg, e, thread)
+void *arg;
+int e, thread;
+{
+	/* cut out the fragments of entry e */
+	struct batch *b = (struct batch *) arg;
+	struct frag *fr;
+	struct pdbx_res *res = NULL;
+	struct stat st;
+	int64_t n_res = -1, offset, pos;
+	char pdbfilename[1100], baby_pdbfilename[1200], msg[2500];
+	char line[PDBX_LINE], pdb_res_seq[8], chain_id, *text;
+	FILE *baby_pdbfile;
+	int k, len, start_flag, stop_flag, last_res_flag;
+
+	fr = &b->frag[b->order[b->first[e]]];
+	sprintf(pdbfilename,"%s/%s.pdb",b->pdb_dir,fr->pdbcode);
+	if ((text=pdbx_map_file(pdbfilename,&st))==NULL) {
+		sprintf(msg,"Error opening file: %s\n",pdbfilename);
+		add_msg(fr,msg);
+		fr->fatal=1;
+		return;
+		}
+	for (k=b->first[e]; k<b->first[e+1]; k++) {
+		fr = &b->frag[b->order[k]];
+		if (fr->chain[0]=='_') chain_id=' ';
+		  else chain_id=fr->chain[0];
+		sprintf(baby_pdbfilename,"%s/%s.%s.%s.%s.pdb",b->baby_dir,
+		  fr->pdbcode,fr->chain,fr->start_res,fr->stop_res);
+		if ((baby_pdbfile=fopen(baby_pdbfilename,"w"))==NULL) {
+			sprintf(msg,"Error opening file: %s\n",baby_pdbfilename);
+			add_msg(fr,msg);
+			fr->fatal=1;
+			break;
+			}
+
+		/* start where the start residue is; the index if it can tell, or
+		 * one pass over the file for all the fragments
+		 */
+		offset = b->px==NULL ? PDBX_STALE :
+		  pdbx_find(b->px,fr->pdbcode,&st,chain_id,fr->start_name);
+		if (offset==PDBX_STALE) {
+			if (n_res<0) res=pdbx_scan(text,st.st_size,&n_res);
+			offset=pdbx_lookup(res,n_res,chain_id,fr->start_name);
+			}
+		start_flag=stop_flag=last_res_flag=0;
+		for (pos=offset; pos>=0 && !stop_flag &&
+		  (len=pdbx_line(text,st.st_size,pos,line))>0; pos+=len) {
+			if ((strncmp(line,"ATOM",4)==0)||(strncmp(line,"HETATM",6)==0)) {
+				pdbx_resname(line,pdb_res_seq);
+				if((strcmp(pdb_res_seq,fr->start_name)==0)&&(chain_id==line[21])) start_flag=1;
+				if((start_flag)&&(strcmp(pdb_res_seq,fr->stop_name)==0)) last_res_flag=1;
+				if((last_res_flag==1)&&(strcmp(pdb_res_seq,fr->stop_name)!=0)) stop_flag=1;
+				if((start_flag)&&(!stop_flag)) fputs(line,baby_pdbfile);
+				}
+			}
+		if (!start_flag) {
+			sprintf(msg,"Error: Can't find start res seq %s in file %s\n",fr->start_name,pdbfilename);
+			add_msg(fr,msg);
+			}
+		if ((!stop_flag)&&(last_res_flag==0)) {
+			sprintf(msg,"Error: Can't find last res seq %s in file %s\n",fr->stop_name,pdbfilename);
+			add_msg(fr,msg);
+			}
+		fclose(baby_pdbfile);
+		}
+	free(res);
+	pdbx_unmap_file(text,st.st_size);
+}
+
+ static void
+batch_extract(seq, seqfilename, pdb_dir, baby_dir, px, nthreads)
+struct seq *seq;
+char *seqfilename, *pdb_dir, *baby_dir;
+struct pdbx *px;
+int nthreads;
+{
+	/* extract every match on stdin, nthreads entries at a time */
+	struct batch b;
+	struct frag *fr;
+	struct seq *seqp;
+	char buf[PDBX_LINE], msg[1200], *bad_pdb = NULL, *nl;
+	int n_frags = 0, max_frags = 0, n_entries, i, k, c;
+
+	memset(&b, 0, sizeof(b));
+	while(fgets(buf,sizeof(buf),stdin)!=NULL) {
+		if((nl=strchr(buf,'\n'))!=NULL) *nl = '\0';
+		/* the fields wanted come first: leave out the rest of a long line */
+		else while((c=getchar())!=EOF && c!='\n') ;
+		if(buf[0]=='#') {
+			printf("%s",buf);
+			continue;
+			}
+		if (n_frags==max_frags) {
+			max_frags = max_frags ? 2*max_frags : 1024;
+			b.frag = (struct frag *) realloc(b.frag, max_frags*sizeof(struct frag));
+			}
+		fr = &b.frag[n_frags++];
+		memset(fr, 0, sizeof(struct frag));
+		sscanf(buf,"%s %c %s %*s %s",fr->pdbcode,fr->chain,fr->start_res,fr->stop_res);
+		if ((seqp=find_seq(seq,fr->pdbcode,fr->chain))==NULL) {
+			sprintf(msg,"Error: No sequence for %s chain %s in %s\n",fr->pdbcode,fr->chain,seqfilename);
+			add_msg(fr,msg);
+			continue;
+			}
+		fragment_names(seqp,fr->start_res,fr->stop_res,fr->start_name,fr->stop_name);
+		/* stop, as one at a time would, at the first entry with no PDB file */
+		sprintf(msg,"%s/%s.pdb",pdb_dir,fr->pdbcode);
+		if (access(msg,R_OK)<0) {
+			bad_pdb = strdup(msg);
+			n_frags--;
+			break;
+			}
+		}
+
+	/* group the fragments by entry */
+	b.order = (int *) malloc((n_frags+1)*sizeof(int));
+	b.first = (int *) malloc((n_frags+1)*sizeof(int));
+	for (i=k=0; i<n_frags; i++)
+		if (b.frag[i].msg==NULL) b.order[k++]=i;
+	sort_frag = b.frag;
+	qsort(b.order, k, sizeof(int), order_cmp);
+	for (i=n_entries=0; i<k; i++)
+		if (i==0 || strcmp(b.frag[b.order[i]].pdbcode,b.frag[b.order[i-1]].pdbcode)!=0)
+			b.first[n_entries++]=i;
+	b.first[n_entries]=k;
+	b.pdb_dir=pdb_dir;
+	b.baby_dir=baby_dir;
+	b.px=px;
+	pool_run(nthreads, n_entries, batch_entry, &b);
+
+	for (i=0; i<n_frags; i++) {
+		if (b.frag[i].msg!=NULL) fputs(b.frag[i].msg,stderr);
+		if (b.frag[i].fatal) exit(-1);
+		}
+	if (bad_pdb!=NULL) {
+		fprintf(stderr,"Error opening file: %s\n",bad_pdb);
+		exit(-1);
+		}
+}
 
 main(argc, argv)
 int argc;
@@ -30,57 +304,96 @@ extern char *optarg;
 extern int optind, opterr;
 
 struct seq *seqp;
-static struct seq seq[MAXNSEQ]; /* in-core array of sequences */
+struct seq * seq; /* in-core array of sequences */
+int n_seqs;
+char seqfilename[1024];
 char * sequery_home();
 char * get_resnumber();
-char * c_ptr;
-char buf[128],chain[2],start_res[8],stop_res[8],pdbcode[12];
-char pdbfilename[132],baby_pdbfilename[132];
-char chain_id,pdb_res_seq[8],c_res[5];
+char buf[PDBX_LINE],chain[2],start_res[8],stop_res[8],pdbcode[12];
+char pdbfilename[1100],baby_pdbfilename[132];
+char pdb_dir[1024];
+char * pdbx_filename = NULL; /* -i: index of the PDB files */
+struct pdbx *px = NULL;
+int64_t offset;
+struct stat pdbst;
+int build_index=0;
+int nthreads=0; /* -j: batch extraction on this many threads */
+char chain_id,pdb_res_seq[8];
+char start_name[16],stop_name[16]; /* as long as any residue number/name */
 char baby_dir[80];
-FILE *seqfile,*matchfile,*pdbfile,*baby_pdbfile;
-int start_index,stop_index;
+FILE *matchfile,*pdbfile,*baby_pdbfile;
 int start_flag,stop_flag,last_res_flag,eof_flag;
-int i,j;
+int i;
 int c;
-static int context_pre=6;
-static int context_post=6;
 int errflg=0;
 
+  pgmname = argv[0];
   sprintf(baby_dir,".");
-  while (( c = getopt(argc, argv, "f:x:")) != -1 ) switch(c) {
+  strcpy(pdb_dir,"/mb/data/pdb/struct");
+  strcpy(seqfilename, sequery_home("lib/pdbseq.asc"));
+  while (( c = getopt(argc, argv, "bf:i:j:p:s:x:")) != -1 ) switch(c) {
 
+  case 'b':
+	 build_index = 1; break;
+  case 'i':
+	 pdbx_filename = optarg; break;
+  case 'j':
+	 nthreads = atoi(optarg);
+	 if(nthreads < 1) nthreads = 1;
+	 if(nthreads > POOL_MAXTHREADS) nthreads = POOL_MAXTHREADS;
+	 break;
+  case 'p':
+	 strcpy(pdb_dir,optarg); break;
   case 'f':
 	 strcpy(baby_dir,optarg); break;
+  case 's':
+	 strcpy(seqfilename,optarg); break;
   case 'x':
 	 context_pre = context_post = atoi(optarg); break;
   default:
    	 errflg = 1; break;
   }
   
+  if(build_index && pdbx_filename==NULL) errflg = 1;
   if(errflg) {
-	fprintf(stderr, "usage: matchextractpdb -x extra_residues < matchfile \n");
+	fprintf(stderr, "usage: matchextractpdb [-s sequence_file] [-p pdb_dir] [-i pdb_index] [-j threads] -x extra_residues < matchfile \n");
+	fprintf(stderr, "       matchextractpdb [-s sequence_file] [-p pdb_dir] -b -i pdb_index\n");
 	exit(-1);
   }
 
-  seqfile = fopen(sequery_home("lib/pdbseq.asc"),"r");
-  seqp = &seq[0];
-  fget_seq(seqp, MAXNSEQ, seqfile);  
+  if ((seq = seqfile_load_all(seqfilename, &n_seqs)) == NULL) exit(-1);
+  if (build_index) {
+	/* index the PDB file of every entry and stop */
+	if ((pdbfile=fopen(pdbx_filename,"w"))==NULL) {
+		perror(pdbx_filename);
+		exit(-1);
+		}
+	if ((i=pdbx_write(pdbfile,pdb_dir,seq,n_seqs))<0 || fclose(pdbfile)!=0) {
+		fprintf(stderr,"%s: error writing %s\n",pgmname,pdbx_filename);
+		exit(-1);
+		}
+	fprintf(stderr,"%s: indexed %d PDB files into %s\n",pgmname,i,pdbx_filename);
+	exit(0);
+	}
+  if (pdbx_filename!=NULL && (px=pdbx_open(pdbx_filename))==NULL) exit(-1);
+  hash_seqs(seq, n_seqs);
+  if (nthreads>0) {
+	batch_extract(seq,seqfilename,pdb_dir,baby_dir,px,nthreads);
+	exit(0);
+	}
   while(gets(buf)!=NULL) {
     if(buf[0]=='#') {
 	printf("%s",buf);
 	continue;
     	}
-    seqp = &seq[0];
     sscanf(buf,"%s %c %s %*s %s",pdbcode,chain,start_res,stop_res); 
-    while((strcmp(pdbcode,seqp->name)!=0)||(strcmp(chain,seqp->chain)!=0)) seqp++;
-    for(start_index=0;(strcmp(start_res,c_ptr=get_resnumber(start_index,seqp,c_res))!=0)&&(start_index<seqp->len);start_index++);
-    for(stop_index=0;(strcmp(stop_res,c_ptr=get_resnumber(stop_index,seqp,c_res))!=0)&&(stop_index<seqp->len);stop_index++);
-    start_index-=context_pre;
-    stop_index+=context_post;
-    if (start_index<0) start_index=0;
-    if (stop_index>seqp->len-1) stop_index=seqp->len-1;
-    sprintf(pdbfilename,"/mb/data/pdb/struct/%s.pdb",pdbcode);
+    chain[1]='\0';
+    if ((seqp=find_seq(seq,pdbcode,chain))==NULL) {
+	fprintf(stderr,"Error: No sequence for %s chain %s in %s\n",pdbcode,chain,seqfilename);
+	continue;
+    	}
+    fragment_names(seqp,start_res,stop_res,start_name,stop_name);
+    sprintf(pdbfilename,"%s/%s.pdb",pdb_dir,pdbcode);
     if ((pdbfile=fopen(pdbfilename,"r"))==NULL) {
 	fprintf(stderr,"Error opening file: %s\n",pdbfilename);;
 	exit(-1);
@@ -95,21 +408,26 @@ int errflg=0;
     	}
 
     start_flag=stop_flag=last_res_flag=0;
+    /* with an index, start reading where the start residue is, or not
+     * at all if it has none
+     */
+    offset = px==NULL || fstat(fileno(pdbfile),&pdbst)<0 ? PDBX_STALE :
+      pdbx_find(px,pdbcode,&pdbst,chain_id,start_name);
+    if (offset>=0) fseek(pdbfile,(long) offset,SEEK_SET);
+    else if (offset!=PDBX_STALE) fseek(pdbfile,0L,SEEK_END);
     while((eof_flag=fgets(buf,sizeof(buf),pdbfile)!=NULL)&&(!stop_flag)) {
 	if ((strncmp(&buf[0],"ATOM",4)==0)||(strncmp(&buf[0],"HETATM",6)==0)) {
                 
 /* Remove leading blanks in Residue seq. no. */
-		j=0;
-                for(i=23;i<28;i++) if (buf[i]!=' ') pdb_res_seq[j++]=buf[i];
-		pdb_res_seq[j]='\0';
-		if((strcmp(pdb_res_seq,get_resnumber(start_index,seqp,c_res))==0)&&(chain_id==buf[21])) start_flag=1;
-		if((start_flag)&&(strcmp(pdb_res_seq,get_resnumber(stop_index,seqp,c_res))==0)) last_res_flag=1;
-		if((last_res_flag==1)&&(strcmp(pdb_res_seq,get_resnumber(stop_index,seqp,c_res))!=0)) stop_flag=1;
+		pdbx_resname(buf,pdb_res_seq);
+		if((strcmp(pdb_res_seq,start_name)==0)&&(chain_id==buf[21])) start_flag=1;
+		if((start_flag)&&(strcmp(pdb_res_seq,stop_name)==0)) last_res_flag=1;
+		if((last_res_flag==1)&&(strcmp(pdb_res_seq,stop_name)!=0)) stop_flag=1;
 		if((start_flag)&&(!stop_flag)) fprintf(baby_pdbfile,"%s",buf);
         }
     }
-    if (!start_flag) fprintf(stderr,"Error: Can't find start res seq %s in file %s\n",get_resnumber(start_index,seqp,c_res),pdbfilename);
-    if ((!stop_flag)&&(last_res_flag==0)) fprintf(stderr,"Error: Can't find last res seq %s in file %s\n",get_resnumber(stop_index,seqp,c_res),pdbfilename);
+    if (!start_flag) fprintf(stderr,"Error: Can't find start res seq %s in file %s\n",start_name,pdbfilename);
+    if ((!stop_flag)&&(last_res_flag==0)) fprintf(stderr,"Error: Can't find last res seq %s in file %s\n",stop_name,pdbfilename);
     fclose(pdbfile);
     fclose(baby_pdbfile);
   }
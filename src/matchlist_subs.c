@@ -0,0 +1,360 @@
+/* matchlist_subs.c:
+ *  collect, sort and write out the matches of one pattern.
+ *
+ * sequery used to write each pattern's matches to a file in /tmp and
+ * have a shell run sort, sed and tee on it, then cat the result onto
+ * the log file: four processes and three copies of the matches for
+ * every pattern that matched anything.  Now the lines are kept in
+ * memory, sorted here with the same ordering sort(1) gives in the "C"
+ * locale, and written to each destination in one go.
+ *
+ * All the lists together hold no more than about the budget set by
+ * matchlist_budget(): past that, a list's lines are sorted and written
+ * to a temporary file as a "run", and when the list is written out its
+ * runs are merged.  If a run can't be written (a full TMPDIR) or read
+ * back, the list is marked, and writing it out fails rather than
+ * leaving matches out.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "matchlist_subs.h"
+#include "tally_subs.h"
+
+#define OUTBUFSIZE (1<<20)	/* output is written in pieces this big ... */
+#define RUNBUFSIZE (64<<10)	/* ... and runs read back in pieces this big */
+
+static long budget = 64L<<20;	/* bytes of lines to hold in memory */
+static long held = 0;		/* bytes of lines held, all lists */
+static int tally_mode = 0;	/* TALLY_..., or 0 to keep the lines */
+
+ void
+matchlist_budget(long bytes)
+{
+	budget = bytes;
+}
+
+ void
+matchlist_tally(int mode)
+{
+	/* count the lines of lists made from now on, by tally_add() in
+	 * the given TALLY_ mode, instead of keeping them
+	 */
+	tally_mode = mode;
+}
+
+ struct matchlist *
+matchlist_new(void)
+{
+	struct matchlist *ml;
+
+	ml = (struct matchlist *) calloc(1, sizeof(struct matchlist));
+	return ml;
+}
+
+static char *sort_text;	/* text of the list being sorted, for compare() */
+
+ static int
+compare_lines(char *a, int la, char *b, int lb)
+{
+	/* as sort(1) compares lines, in the "C" locale */
+	int r;
+
+	if((r = memcmp(a, b, la < lb ? la : lb)) != 0) return r;
+	return la - lb;
+}
+
+ static int
+compare(const void *p, const void *q)
+{
+	struct ml_rec *a = (struct ml_rec *) p, *b = (struct ml_rec *) q;
+
+	return compare_lines(sort_text + a->off, a->len, sort_text + b->off, b->len);
+}
+
+ static void
+sort_recs(struct matchlist *ml)
+{
+	sort_text = ml->text;
+	qsort(ml->rec, ml->nrecs, sizeof(struct ml_rec), compare);
+}
+
+ static void
+spill(struct matchlist *ml)
+{
+	/* write the lines held as a new sorted run */
+	struct ml_rec *r;
+
+	if(ml->spill == NULL && (ml->spill = tmpfile()) == NULL) return;
+	if(ml->nruns+2 > ml->runalloc) {
+		ml->runalloc = ml->runalloc ? 2 * ml->runalloc : 16;
+		ml->run = (long *) realloc(ml->run, ml->runalloc * sizeof(long));
+		}
+	if(ml->nruns == 0) ml->run[0] = 0;
+
+	sort_recs(ml);
+	for(r = ml->rec; r < &ml->rec[ml->nrecs]; r++)
+		if(fwrite(ml->text + r->off, 1, r->len, ml->spill) != r->len ||
+		  putc('\n', ml->spill) == EOF)
+			break;
+	if(r < &ml->rec[ml->nrecs] || fflush(ml->spill) == EOF ||
+	  ferror(ml->spill))
+		ml->error = 1;
+	ml->run[++ml->nruns] = ftell(ml->spill);
+
+	held -= ml->textlen;
+	ml->textlen = 0;
+	ml->nrecs = 0;
+}
+
+ void
+matchlist_add(struct matchlist *ml, char *line, int len)
+{
+	/* add one line (without its newline) to the list */
+	struct ml_rec *r;
+
+	if(tally_mode != 0) {
+		if(ml->tally == NULL) ml->tally = tally_new(tally_mode);
+		tally_add(ml->tally, line, len);
+		ml->nlines++;
+		return;
+		}
+
+	if(ml->textlen + len > ml->textalloc) {
+		ml->textalloc = 2 * ml->textalloc + len + 4096;
+		ml->text = (char *) realloc(ml->text, ml->textalloc);
+		}
+	if(ml->nrecs == ml->recalloc) {
+		ml->recalloc = ml->recalloc ? 2 * ml->recalloc : 256;
+		ml->rec = (struct ml_rec *) realloc(ml->rec,
+		  ml->recalloc * sizeof(struct ml_rec));
+		}
+	r = &ml->rec[ml->nrecs++];
+	r->off = ml->textlen;
+	r->len = len;
+	memcpy(ml->text + ml->textlen, line, len);
+	ml->textlen += len;
+	ml->nlines++;
+	held += len;
+
+	/* don't make runs so small that merging them would crawl */
+	if(ml->textlen >= budget || (held > budget && ml->textlen >= budget/64))
+		spill(ml);
+}
+
+ void
+matchlist_addtext(struct matchlist *ml, char *text, long size)
+{
+	/* add text[0..size), a number of newline-terminated lines */
+	char *end = text + size, *nl;
+
+	while(text < end) {
+		if((nl = memchr(text, '\n', end - text)) == NULL) nl = end;
+		matchlist_add(ml, text, nl - text);
+		text = nl + 1;
+		}
+}
+
+ static char *
+strip_keys(char *s, char *end)
+{
+	/* the line without its sort keys: skip two words and the
+	 * spaces after each, as sed's ^[^ ]* *[^ ]* * matched them
+	 */
+	int field;
+
+	for(field = 0; field < 2; field++) {
+		while(s < end && *s != ' ') s++;
+		while(s < end && *s == ' ') s++;
+		}
+	return s;
+}
+
+/* reading a run back, a line at a time */
+struct reader {
+	long pos, end;		/* the unread part of the run in the spill file */
+	char *buf;
+	int bufsize, buflen, next; /* buf[next..buflen) is unread */
+	char *line;		/* current line, or NULL at the end */
+	int len;
+	int error;		/* the run could not all be read */
+	};
+
+ static void
+next_line(struct reader *rd, int fd)
+{
+	char *nl;
+	int n;
+
+	for(;;) {
+		nl = rd->next < rd->buflen ?
+		  memchr(rd->buf + rd->next, '\n', rd->buflen - rd->next) : NULL;
+		if(nl != NULL) {
+			rd->line = rd->buf + rd->next;
+			rd->len = nl - rd->line;
+			rd->next += rd->len + 1;
+			return;
+			}
+		if(rd->pos >= rd->end) {
+			rd->line = NULL;
+			return;
+			}
+		/* keep the partial line, make room for more */
+		memmove(rd->buf, rd->buf + rd->next, rd->buflen - rd->next);
+		rd->buflen -= rd->next;
+		rd->next = 0;
+		if(rd->buflen == rd->bufsize) {
+			rd->bufsize *= 2;
+			rd->buf = (char *) realloc(rd->buf, rd->bufsize);
+			}
+		n = rd->bufsize - rd->buflen;
+		if(n > rd->end - rd->pos) n = rd->end - rd->pos;
+		if((n = pread(fd, rd->buf + rd->buflen, n, rd->pos)) <= 0) {
+			rd->error = 1; /* short of rd->end */
+			rd->line = NULL;
+			return;
+			}
+		rd->buflen += n;
+		rd->pos += n;
+		}
+}
+
+ static int
+before(struct reader *a, struct reader *b)
+{
+	return compare_lines(a->line, a->len, b->line, b->len) < 0;
+}
+
+ static int
+merge(struct matchlist *ml, FILE *fp)
+{
+	/* merge the runs onto fp, through a heap of their current lines.
+	 * Returns 0, or -1 if a run could not be read back.
+	 */
+	struct reader *rd, *t;
+	struct reader **heap;
+	char *out, *s, *e;
+	int i, j, k, n, fd, outlen = 0;
+
+	fd = fileno(ml->spill);
+	rd = (struct reader *) calloc(ml->nruns, sizeof(struct reader));
+	heap = (struct reader **) malloc(ml->nruns * sizeof(struct reader *));
+	out = (char *) malloc(OUTBUFSIZE);
+	for(n = k = 0; k < ml->nruns; k++) {
+		rd[k].pos = ml->run[k];
+		rd[k].end = ml->run[k+1];
+		rd[k].bufsize = RUNBUFSIZE;
+		rd[k].buf = (char *) malloc(rd[k].bufsize);
+		next_line(&rd[k], fd);
+		if(rd[k].line == NULL) continue;
+		/* sift up */
+		for(i = n++; i > 0 && before(&rd[k], heap[(i-1)/2]); i = (i-1)/2)
+			heap[i] = heap[(i-1)/2];
+		heap[i] = &rd[k];
+		}
+
+	while(n > 0) {
+		t = heap[0];
+		s = strip_keys(t->line, t->line + t->len);
+		e = t->line + t->len;
+		if(outlen + (e - s) + 1 > OUTBUFSIZE) {
+			fwrite(out, 1, outlen, fp);
+			outlen = 0;
+			}
+		if((e - s) + 1 > OUTBUFSIZE) fwrite(s, 1, e - s, fp);
+		else {
+			memcpy(out + outlen, s, e - s);
+			outlen += e - s;
+			}
+		out[outlen++] = '\n';
+
+		next_line(t, fd);
+		if(t->line == NULL) t = heap[--n];
+		/* sift t down from the top */
+		for(i = 0; (j = 2*i+1) < n; i = j) {
+			if(j+1 < n && before(heap[j+1], heap[j])) j++;
+			if(!before(heap[j], t)) break;
+			heap[i] = heap[j];
+			}
+		if(n > 0) heap[i] = t;
+		}
+	fwrite(out, 1, outlen, fp);
+
+	for(k = 0; k < ml->nruns; k++) {
+		if(rd[k].error) ml->error = 1;
+		free(rd[k].buf);
+		}
+	free(rd);
+	free(heap);
+	free(out);
+	return ml->error ? -1 : 0;
+}
+
+ int
+matchlist_write(struct matchlist *ml, FILE *fp)
+{
+	/* write the lines, sorted and without their keys, onto fp.
+	 * Returns 0, or -1 if fp could not take them, or if some of them
+	 * were lost in the spill file.
+	 */
+	struct ml_rec *r;
+	char *out, *s, *e;
+	long outlen = 0;
+
+	if(ml->nlines == 0) return 0;
+	if(ml->tally != NULL) return tally_write(ml->tally, fp);
+
+	if(ml->spill != NULL) {
+		if(ml->nrecs > 0) spill(ml);
+		if(merge(ml, fp) != 0) return -1;
+		}
+	else {
+		sort_recs(ml);
+		out = (char *) malloc(ml->textlen + ml->nrecs + 1);
+		for(r = ml->rec; r < &ml->rec[ml->nrecs]; r++) {
+			e = ml->text + r->off + r->len;
+			s = strip_keys(ml->text + r->off, e);
+			memcpy(out + outlen, s, e - s);
+			outlen += e - s;
+			out[outlen++] = '\n';
+			}
+		fwrite(out, 1, outlen, fp);
+		free(out);
+		}
+	if(fflush(fp) == EOF || ferror(fp)) return -1;
+	return 0;
+}
+
+ void
+matchlist_clear(struct matchlist *ml)
+{
+	/* forget all the lines, keeping the space for more */
+	held -= ml->textlen;
+	ml->textlen = 0;
+	ml->nrecs = 0;
+	ml->nlines = 0;
+	if(ml->spill != NULL) fclose(ml->spill);
+	ml->spill = NULL;
+	ml->nruns = 0;
+	ml->error = 0;
+	if(ml->tally != NULL) tally_clear(ml->tally);
+}
+
+ void
+matchlist_free(struct matchlist *ml)
+{
+	if(ml == NULL) return;
+	matchlist_clear(ml);
+	free(ml->text);
+	free(ml->rec);
+	free(ml->run);
+	tally_free(ml->tally);
+	free(ml);
+}
@@ -0,0 +1,43 @@
+/* matchlist_subs.h:
+ *  the matches of one pattern, kept in memory (or, when there are too
+ *  many, in sorted runs on disk) until they are sorted and written out.
+ *
+ * Each match is a line as sequery writes it: its sort keys (the matched
+ * residues, then the name with the letter last) followed by the line
+ * proper.  Lines are sorted as sort(1) does in the "C" locale, and
+ * written without the two keys (the first two words on the line and
+ * the spaces after them, as the old sed command removed them).
+ * After matchlist_tally(), the lines are given to a tally (tally_subs.h)
+ * instead, and what is written is the tally.
+ * Requires <stdio.h>.
+ */
+
+static char matchlist_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+struct ml_rec {
+	long off;		/* line is text[off..off+len), without newline */
+	int len;
+	};
+
+struct matchlist {
+	char *text;		/* lines not yet spilled */
+	long textlen, textalloc;
+	struct ml_rec *rec;
+	long nrecs, recalloc;
+	long nlines;		/* all lines, spilled or not */
+	FILE *spill;		/* sorted runs, or NULL */
+	long *run;		/* run k is spill[run[k]..run[k+1]) */
+	int nruns, runalloc;
+	int error;		/* a run could not be written or read back */
+	struct tally *tally;	/* after matchlist_tally(), or NULL */
+	};
+
+void matchlist_budget(long bytes);
+void matchlist_tally(int mode);
+struct matchlist * matchlist_new(void);
+void matchlist_add(struct matchlist *ml, char *line, int len);
+void matchlist_addtext(struct matchlist *ml, char *text, long size);
+int matchlist_write(struct matchlist *ml, FILE *fp);
+void matchlist_clear(struct matchlist *ml);
+void matchlist_free(struct matchlist *ml);
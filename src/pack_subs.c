@@ -0,0 +1,129 @@
+/* pack_subs.c:
+ *  pack the residues of an in-core database as small codes; see
+ *  pack_subs.h.
+ *
+ * The words of every sequence are kept in one block, in the order of
+ * the sequences, instead of a malloc'ed string for each chain.  The
+ * matchers that can use them (the word kernel of bitpar_subs.c) look
+ * up each code in a table of 32 or 4 entries instead of 256, and test
+ * a whole word of residues for a match at once.
+ *
+ * That does not make the scan itself any faster: each residue still
+ * waits on the last one's state word, and the text is read no slower
+ * than that.  What it saves is memory and cache, 5/8 of the text for
+ * proteins and 1/4 for nucleotides, which pays when the database is
+ * much larger than the caches or many processes search it at once; so
+ * a database is only packed if SEQUERY_PACK is set in the environment.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "resnum_subs.h"
+#include "pack_subs.h"
+
+char pack_nucleotides[4] = { 'A', 'C', 'G', 'T' };
+
+ static int
+code2(int c)
+{
+	/* the 2-bit code of nucleotide c, or -1 */
+	int k;
+
+	for(k = 0; k < 4; k++) if(c == pack_nucleotides[k]) return k;
+	return -1;
+}
+
+ static int
+fits(char *s, int bits)
+{
+	/* true if every residue of s has a code */
+	for(; *s != '\0'; s++)
+		if(bits == PACK_2BIT ? code2(*s) < 0 : (*s & 0xE0) != 0x40)
+			return 0;
+	return 1;
+}
+
+ struct pack *
+pack_build(struct seq *seq, int n_seqs)
+{
+	/* pack seq[0..n_seqs), grouped as seqfile_subs.c groups them.
+	 * Returns NULL if there is nothing worth packing.
+	 */
+	struct pack *pk;
+	struct seq *seqp, *o;
+	uint64_t *w;
+	long n = 0;
+	int i, j, bits = PACK_2BIT, code;
+	char *s;
+
+	if(getenv("SEQUERY_PACK") == NULL || n_seqs == 0) return NULL;
+
+	/* 2 bits if they are all nucleotides, 5 if any is not */
+	for(seqp = seq; seqp < &seq[n_seqs] && bits == PACK_2BIT; seqp++)
+		if(!seqp->copy && !fits(seqp->sequence, PACK_2BIT)) bits = PACK_5BIT;
+
+	pk = (struct pack *) calloc(1, sizeof(struct pack));
+	pk->bits = bits;
+	pk->per_word = 64 / bits;
+	pk->seq = seq;
+	pk->n_seqs = n_seqs;
+	pk->start = (long *) malloc(n_seqs * sizeof(long));
+	for(i = 0; i < n_seqs; i++) {
+		pk->start[i] = -1;
+		seqp = &seq[i];
+		if(seqp->copy || !fits(seqp->sequence, bits)) continue;
+		pk->start[i] = n;
+		j = strlen(seqp->sequence);
+		n += (j + pk->per_word-1) / pk->per_word;
+		pk->residues += j;
+		}
+	if(pk->residues == 0) {
+		pack_free(pk);
+		return NULL;
+		}
+	pk->nwords = n;
+	pk->words = (uint64_t *) calloc(n, sizeof(uint64_t));
+
+	for(i = 0; i < n_seqs; i++) {
+		seqp = &seq[i];
+		if(pk->start[i] < 0) continue;
+		w = &pk->words[pk->start[i]];
+		for(s = seqp->sequence, j = 0; *s != '\0'; s++, j++) {
+			code = bits == PACK_2BIT ? code2(*s) : PACK_CODE5(*s);
+			w[j / pk->per_word] |= (uint64_t) code << (bits * (j % pk->per_word));
+			}
+		/* copies share the first's words */
+		for(o = seqp->same; o != NULL; o = o->same)
+			pk->start[o - seq] = pk->start[i];
+		}
+	return pk;
+}
+
+ uint64_t *
+pack_words(struct pack *pk, struct seq *seqp)
+{
+	/* the words of sequence seqp, or NULL if it is not packed (or not
+	 * one of pk's at all)
+	 */
+	long i;
+
+	if(pk == NULL || seqp < pk->seq || seqp >= &pk->seq[pk->n_seqs]) return NULL;
+	i = pk->start[seqp - pk->seq];
+	return i < 0 ? NULL : &pk->words[i];
+}
+
+ void
+pack_free(struct pack *pk)
+{
+	if(pk == NULL) return;
+	free(pk->start);
+	free(pk->words);
+	free(pk);
+}
@@ -0,0 +1,39 @@
+/* pack_subs.h:
+ *  the residues of an in-core database packed as small codes, several
+ *  to a 64-bit word, so that a scan reads a fraction of the bytes the
+ *  text takes and the whole database stays in the processor's caches.
+ *
+ * A protein residue is given a 5-bit code, twelve to a word: residues
+ * '@' to '_' (0x40-0x5F), which hold 'A' to 'Z', are 0 to 31, so 'A'
+ * is 1 and 'Z' 26.  A database of nothing but the nucleotides A, C, G
+ * and T is given 2-bit codes instead, 32 to a word.  The codes of a
+ * sequence begin a word of their own, lowest bits first.  A sequence
+ * with a residue outside the code is not packed, and is scanned as
+ * text; so are copies (seqfile_subs.h), which share the first's words.
+ * Requires <stdint.h> and "resnum_subs.h".
+ */
+
+static char pack_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define PACK_5BIT 5	/* protein residues, 0x40-0x5F */
+#define PACK_2BIT 2	/* nucleotides A, C, G, T */
+
+#define PACK_CODE5(c) ((c) & 037)	/* of a residue 0x40-0x5F */
+
+struct pack {
+	int bits;		/* PACK_5BIT or PACK_2BIT */
+	int per_word;		/* codes in each word */
+	struct seq *seq;	/* the sequences packed */
+	int n_seqs;
+	long *start;		/* word where seq[i] begins, or -1 */
+	uint64_t *words;
+	long nwords;
+	long residues;		/* packed, counting each distinct sequence once */
+	};
+
+extern char pack_nucleotides[4];	/* residue of each 2-bit code */
+
+struct pack * pack_build(struct seq *seq, int n_seqs);
+uint64_t * pack_words(struct pack *pk, struct seq *seqp);
+void pack_free(struct pack *pk);
@@ -0,0 +1,314 @@
+/* pdbx_subs.c:
+ *  write and use indexes of PDB coordinate files.
+ *
+ * matchextractpdb -b reads the coordinate file of every entry of a
+ * sequence file once and writes, with pdbx_write(), where the records
+ * of each residue begin.  matchextractpdb -i maps the index with
+ * pdbx_open() and, for each match, asks pdbx_find() where to start
+ * reading, rather than reading the coordinate file from the top.
+ * pdbx_scan() does for one mapped coordinate file what the index does
+ * for all of them, for matchextractpdb -j to look up the matches of an
+ * entry in after a single pass over its file.
+ * See pdbx_subs.h for the layout of the file.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "resnum_subs.h"
+#include "pdbx_subs.h"
+
+extern char * pgmname;
+
+ char *
+pdbx_resname(char *line, char *name)
+{
+	/* the residue name of ATOM/HETATM record "line" (columns 23-27,
+	 * blanks removed) into name[8]
+	 */
+	int i, j;
+
+	for(i = 23, j = 0; i < 28 && line[i] != '\0'; i++)
+		if(line[i] != ' ') name[j++] = line[i];
+	name[j] = '\0';
+	return name;
+}
+
+ static void
+make_key(char *key, int chain, char *resname)
+{
+	memset(key, 0, sizeof(((struct pdbx_res *) 0)->key));
+	key[0] = chain;
+	strncpy(key+1, resname, sizeof(((struct pdbx_res *) 0)->key) - 1);
+}
+
+ static int
+res_cmp(const void *a, const void *b)
+{
+	/* by key, then by offset, so the first record of a residue comes first */
+	const struct pdbx_res *ra = a, *rb = b;
+	int c = memcmp(ra->key, rb->key, sizeof(ra->key));
+
+	if(c != 0) return c;
+	return ra->offset < rb->offset ? -1 : ra->offset > rb->offset;
+}
+
+ static int
+code_cmp(const void *a, const void *b)
+{
+	return strcmp(*(char **) a, *(char **) b);
+}
+
+ char *
+pdbx_map_file(char *filename, struct stat *st)
+{
+	/* map coordinate file "filename" read-only and stat(2) it into *st.
+	 * Returns NULL if it cannot be read; undo with pdbx_unmap_file().
+	 */
+	static char empty[1];
+	char *base;
+	int fd;
+
+	if((fd = open(filename, O_RDONLY)) < 0) return NULL;
+	if(fstat(fd, st) < 0) {
+		close(fd);
+		return NULL;
+		}
+	if(st->st_size == 0) base = empty; /* mmap() will not take it */
+	else if((base = mmap(NULL, st->st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+		base = NULL;
+	close(fd);
+	return base;
+}
+
+ void
+pdbx_unmap_file(char *base, int64_t size)
+{
+	if(size > 0) munmap(base, size);
+}
+
+ int
+pdbx_line(char *text, int64_t size, int64_t pos, char *line)
+{
+	/* copy the line at text[pos] into line[PDBX_LINE] as fgets() would,
+	 * long lines in pieces; returns the bytes taken, 0 at the end
+	 */
+	int n;
+
+	for(n = 0; pos + n < size && n < PDBX_LINE-1; )
+		if((line[n] = text[pos + n]) == '\n') {
+			n++;
+			break;
+			}
+		else n++;
+	line[n] = '\0';
+	return n;
+}
+
+ struct pdbx_res *
+pdbx_scan(char *text, int64_t size, int64_t *p_n)
+{
+	/* the first ATOM/HETATM record of each residue of coordinate file
+	 * text[0..size), in order of key, malloc'ed; *p_n of them
+	 */
+	struct pdbx_res *res = NULL, *rp;
+	int64_t n = 0, max = 0, offset, j;
+	char line[PDBX_LINE], key[8], lastkey[8], name[8];
+	int len;
+
+	for(offset = 0; (len = pdbx_line(text, size, offset, line)) > 0; offset += len) {
+		if(strncmp(line, "ATOM", 4) != 0 && strncmp(line, "HETATM", 6) != 0)
+			continue;
+		make_key(key, line[21], pdbx_resname(line, name));
+		/* most records continue the residue before them */
+		if(n > 0 && memcmp(key, lastkey, sizeof(key)) == 0) continue;
+		if(n == max) {
+			max = max ? 2 * max : 1024;
+			res = (struct pdbx_res *) realloc(res, max * sizeof(struct pdbx_res));
+			}
+		memcpy(res[n].key, key, sizeof(key));
+		res[n++].offset = offset;
+		memcpy(lastkey, key, sizeof(key));
+		}
+
+	/* keep the first record of each residue */
+	if(n > 0) qsort(res, n, sizeof(struct pdbx_res), res_cmp);
+	for(rp = res, j = 0; rp < &res[n]; rp++)
+		if(j == 0 || memcmp(rp->key, res[j-1].key, sizeof(rp->key)) != 0)
+			res[j++] = *rp;
+	*p_n = j;
+	return res;
+}
+
+ int64_t
+pdbx_lookup(struct pdbx_res *res, int64_t n, int chain, char *resname)
+{
+	/* offset of residue "resname" of "chain" in res[0..n) from
+	 * pdbx_scan(), or -1 if it is not there
+	 */
+	char key[8];
+	int64_t lo = 0, hi = n, mid;
+	int c;
+
+	make_key(key, chain, resname);
+	while(lo < hi) {
+		mid = (lo + hi) / 2;
+		if((c = memcmp(res[mid].key, key, sizeof(key))) == 0)
+			return res[mid].offset;
+		if(c < 0) lo = mid + 1;
+		else hi = mid;
+		}
+	return -1;
+}
+
+ int
+pdbx_write(FILE *out, char *pdbdir, struct seq *seq, int n_seqs)
+{
+	/* write the index of the coordinate files "pdbdir/CODE.pdb" of the
+	 * entries of seq[0..n_seqs) onto out.  Entries whose file cannot be
+	 * read are left out.  Returns the number of entries indexed, or -1
+	 * if out could not take it.
+	 */
+	struct pdbx_header hdr;
+	struct pdbx_entry *entry;
+	struct pdbx_res *res = NULL, *eres;
+	struct stat st;
+	char **code, filename[1024], *text;
+	int64_t n_res = 0, max_res = 0, n;
+	int i, n_codes, n_entries = 0;
+
+	code = (char **) malloc((n_seqs ? n_seqs : 1) * sizeof(char *));
+	for(i = 0; i < n_seqs; i++) code[i] = seq[i].name;
+	qsort(code, n_seqs, sizeof(char *), code_cmp);
+	for(i = n_codes = 0; i < n_seqs; i++)
+		if(n_codes == 0 || strcmp(code[n_codes-1], code[i]) != 0)
+			code[n_codes++] = code[i];
+
+	entry = (struct pdbx_entry *) calloc(n_codes ? n_codes : 1,
+	  sizeof(struct pdbx_entry));
+	for(i = 0; i < n_codes; i++) {
+		sprintf(filename, "%s/%s.pdb", pdbdir, code[i]);
+		if((text = pdbx_map_file(filename, &st)) == NULL) continue;
+		eres = pdbx_scan(text, st.st_size, &n);
+		pdbx_unmap_file(text, st.st_size);
+		if(n_res + n > max_res) {
+			while(n_res + n > max_res) max_res = max_res ? 2 * max_res : 65536;
+			res = (struct pdbx_res *) realloc(res, max_res * sizeof(struct pdbx_res));
+			}
+		if(n > 0) memcpy(&res[n_res], eres, n * sizeof(struct pdbx_res));
+		free(eres);
+
+		strncpy(entry[n_entries].code, code[i], sizeof(entry[n_entries].code) - 1);
+		entry[n_entries].file_size = st.st_size;
+		entry[n_entries].file_mtime = st.st_mtime;
+		entry[n_entries].first_res = n_res;
+		entry[n_entries++].n_res = n;
+		n_res += n;
+		}
+	free(code);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, PDBX_MAGIC, sizeof(hdr.magic));
+	hdr.version = PDBX_VERSION;
+	hdr.byteorder = PDBX_BYTEORDER;
+	hdr.n_entries = n_entries;
+	hdr.n_res = n_res;
+	hdr.entry_off = sizeof(hdr);
+	hdr.res_off = hdr.entry_off + (int64_t) n_entries * sizeof(struct pdbx_entry);
+
+	fwrite(&hdr, sizeof(hdr), 1, out);
+	fwrite(entry, sizeof(struct pdbx_entry), n_entries, out);
+	if(n_res > 0) fwrite(res, sizeof(struct pdbx_res), n_res, out);
+	free(entry);
+	free(res);
+	return ferror(out) ? -1 : n_entries;
+}
+
+ struct pdbx *
+pdbx_open(char *filename)
+{
+	/* map the coordinate index "filename".
+	 * Returns NULL, with a message, if it cannot be used.
+	 */
+	struct pdbx *px;
+	struct pdbx_header hdr;
+	struct stat st;
+	void *base;
+	int fd;
+
+	if((fd = open(filename, O_RDONLY)) < 0) {
+		perror(filename);
+		return NULL;
+		}
+	if(read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	  0 != memcmp(hdr.magic, PDBX_MAGIC, sizeof(hdr.magic)) ||
+	  hdr.byteorder != PDBX_BYTEORDER || hdr.version != PDBX_VERSION ||
+	  fstat(fd, &st) < 0 ||
+	  hdr.res_off + hdr.n_res * (int64_t) sizeof(struct pdbx_res) > st.st_size) {
+		fprintf(stderr, "%s: %s is not a coordinate index this program can use, rebuild it with matchextractpdb -b\n",
+		  pgmname, filename);
+		close(fd);
+		return NULL;
+		}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED) {
+		perror(filename);
+		return NULL;
+		}
+
+	px = (struct pdbx *) calloc(1, sizeof(struct pdbx));
+	px->filename = strdup(filename);
+	px->hdr = (struct pdbx_header *) base;
+	px->size = st.st_size;
+	px->entry = (struct pdbx_entry *) ((char *) base + hdr.entry_off);
+	px->res = (struct pdbx_res *) ((char *) base + hdr.res_off);
+	return px;
+}
+
+ int64_t
+pdbx_find(struct pdbx *px, char *code, struct stat *st, int chain, char *resname)
+{
+	/* offset in the coordinate file of entry "code", which stat(2) gave
+	 * as *st, of the first ATOM/HETATM record of residue "resname" of
+	 * "chain"; -1 if it has none, PDBX_STALE if the index cannot tell.
+	 */
+	struct pdbx_entry *ep;
+	int64_t lo, hi, mid;
+
+	lo = 0;
+	hi = px->hdr->n_entries;
+	while(lo < hi) {
+		mid = (lo + hi) / 2;
+		if(strncmp(px->entry[mid].code, code, sizeof(px->entry[mid].code)) < 0)
+			lo = mid + 1;
+		else hi = mid;
+		}
+	if(lo == px->hdr->n_entries ||
+	  strncmp(px->entry[lo].code, code, sizeof(px->entry[lo].code)) != 0)
+		return PDBX_STALE;
+	ep = &px->entry[lo];
+	if(st->st_size != ep->file_size || st->st_mtime != ep->file_mtime)
+		return PDBX_STALE;
+	return pdbx_lookup(&px->res[ep->first_res], ep->n_res, chain, resname);
+}
+
+ void
+pdbx_close(struct pdbx *px)
+{
+	if(px == NULL) return;
+	munmap((void *) px->hdr, px->size);
+	free(px->filename);
+	free(px);
+}
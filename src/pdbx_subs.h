@@ -0,0 +1,74 @@
+/* pdbx_subs.h:
+ *  layout of the PDB coordinate index written by matchextractpdb -b
+ *  and mapped read-only by matchextractpdb -i.
+ *
+ * For each PDB entry of a sequence file, the index records where in
+ * its coordinate file the ATOM/HETATM records of every residue begin,
+ * so that a residue range can be extracted with one seek instead of
+ * reading the file from the top.  A file contains, in order:
+ *	struct pdbx_header
+ *	struct pdbx_entry [n_entries]	one per coordinate file, in order of code
+ *	struct pdbx_res [n_res]		residues of each entry, in order of
+ *					chain and then name
+ * Only the first record of each (chain, residue name) in a file is
+ * recorded, which is where a scan from the top would have found it.
+ * An entry is ignored if its coordinate file has changed size or time
+ * since the index was made.  Like images, an index is specific to the
+ * byte order of the machine that made it.
+ * Requires <stdio.h>, <stdint.h>, <sys/stat.h> and "resnum_subs.h".
+ */
+
+static char pdbx_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define PDBX_MAGIC "SQPX"
+#define PDBX_VERSION 1
+#define PDBX_BYTEORDER 0x01020304
+
+#define PDBX_LINE 128		/* coordinate files are read in lines of this much */
+
+struct pdbx_header {
+	char magic[4];		/* PDBX_MAGIC, not '\0'-terminated */
+	int32_t version;	/* PDBX_VERSION */
+	int32_t byteorder;	/* PDBX_BYTEORDER as written */
+	int32_t n_entries;
+	int64_t n_res;
+	int64_t entry_off;	/* struct pdbx_entry [n_entries] */
+	int64_t res_off;	/* struct pdbx_res [n_res] */
+	};
+
+struct pdbx_entry {
+	char code[12];		/* as in the sequence file */
+	int32_t pad;
+	int64_t file_size;	/* coordinate file indexed, as stat(2) gave it */
+	int64_t file_mtime;
+	int64_t first_res;	/* its residues are res[first_res..first_res+n_res) */
+	int64_t n_res;
+	};
+
+struct pdbx_res {
+	char key[8];		/* chain, then residue name, '\0'-padded */
+	int64_t offset;		/* of its first ATOM/HETATM record */
+	};
+
+struct pdbx {
+	char *filename;
+	struct pdbx_header *hdr;	/* the mapped file */
+	size_t size;
+	struct pdbx_entry *entry;
+	struct pdbx_res *res;
+	};
+
+#define PDBX_STALE (-2)		/* pdbx_find(): entry not indexed, or changed */
+
+int pdbx_write(FILE *out, char *pdbdir, struct seq *seq, int n_seqs);
+struct pdbx * pdbx_open(char *filename);
+int64_t pdbx_find(struct pdbx *px, char *code, struct stat *st, int chain,
+  char *resname);
+void pdbx_close(struct pdbx *px);
+char * pdbx_resname(char *line, char *name);
+char * pdbx_map_file(char *filename, struct stat *st);
+void pdbx_unmap_file(char *base, int64_t size);
+int pdbx_line(char *text, int64_t size, int64_t pos, char *line);
+struct pdbx_res * pdbx_scan(char *text, int64_t size, int64_t *p_n);
+int64_t pdbx_lookup(struct pdbx_res *res, int64_t n, int chain, char *resname);
@@ -0,0 +1,275 @@
+/* perf_subs.c:
+ *  per-query counters and phase times; see perf_subs.h.
+ *
+ * When a batch job slows down the question is which part of it did:
+ * reading the definition files, compiling the patterns, the search
+ * itself, formatting the residue numbers of the matches, or sorting and
+ * writing them.  --perf FILE writes a line of JSON for each query (and
+ * one for the loading of the sequences, and one for a batch's pass over
+ * them), e.g.
+ *
+ *	{"type":"query","pid":1234,"query":3,"pattern":"YW1*wAQ","how":"scan",
+ *	 "defs_s":0.000002,"expand_s":0.000011,...,"matches":12,...}
+ *
+ * (on one line), which jq or a few lines of awk can sum up.  --trace
+ * FILE writes the same phases as "complete" events of the Trace Event
+ * Format, in the array form that may be left without its closing "]",
+ * so a server's trace can be read while it is still running.
+ *
+ * Each record is put together in memory and written with a single
+ * write(2) to a file opened for appending, so the processes of a
+ * server, all writing to the same files, do not cut into one another's
+ * lines.  With neither option perf_on is 0, and all that is left of any
+ * of this is a test of it now and then.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "resnum_subs.h"
+#include "seqfile_subs.h"
+#include "pack_subs.h"
+#include "perf_subs.h"
+
+int perf_on = 0;
+
+static int stats_fd = -1, trace_fd = -1;
+static pid_t opener;		/* the process that writes the closing "]" */
+static double base;		/* perf_now() at perf_open(): trace time 0 */
+static int queries;		/* numbered so far */
+
+static char *phase_name[PERF_NPHASES] = {
+	"defs", "expand", "compile", "scan", "report"
+	};
+
+ static int
+open_append(char *filename)
+{
+	int fd;
+
+	if(strcmp(filename, "-") == 0) return 2;
+	if((fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC|O_APPEND, 0666)) < 0)
+		perror(filename);
+	return fd;
+}
+
+ static void
+put_record(int fd, char *text, size_t size)
+{
+	/* one write, so that it is not interleaved with another process's */
+	if(fd >= 0 && size > 0) (void) write(fd, text, size);
+	free(text);
+}
+
+ static void
+put_string(FILE *fp, char *s)
+{
+	/* s as a JSON string */
+	putc('"', fp);
+	for(; *s != '\0'; s++) {
+		if(*s == '"' || *s == '\\') fprintf(fp, "\\%c", *s);
+		else if((unsigned char) *s < ' ') fprintf(fp, "\\u%04x", *s);
+		else putc(*s, fp);
+		}
+	putc('"', fp);
+}
+
+ int
+perf_open(char *statsname, char *tracename)
+{
+	/* start counting, writing the records to statsname and the trace
+	 * events to tracename (either may be NULL, "-" is the standard
+	 * error).  Returns 0, or -1 if a file could not be made.
+	 */
+	char *text;
+	size_t size;
+	FILE *fp;
+
+	if(statsname != NULL && (stats_fd = open_append(statsname)) < 0)
+		return -1;
+	if(tracename != NULL && (trace_fd = open_append(tracename)) < 0)
+		return -1;
+	perf_on = stats_fd >= 0 || trace_fd >= 0;
+	opener = getpid();
+	base = perf_now();
+
+	if(trace_fd >= 0) {
+		fp = open_memstream(&text, &size);
+		fprintf(fp, "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+		  "\"args\":{\"name\":\"sequery\"}}\n", (int) opener);
+		fclose(fp);
+		put_record(trace_fd, text, size);
+		}
+	return 0;
+}
+
+ double
+perf_now(void)
+{
+	/* seconds, from some time or other */
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+ void
+perf_begin(struct perf_query *q, char *pattern)
+{
+	memset(q, 0, sizeof(struct perf_query));
+	q->n = ++queries;
+	q->pattern = pattern;
+	q->how = "";
+	q->t0 = perf_now();
+}
+
+ void
+perf_span(char *name, int tid, int query, double t0, double t1)
+{
+	/* a trace event for something that went on from t0 to t1, in
+	 * thread tid (0 being the main one), for query number "query"
+	 * (or none, 0)
+	 */
+	char *text;
+	size_t size;
+	FILE *fp;
+
+	if(trace_fd < 0) return;
+	fp = open_memstream(&text, &size);
+	fprintf(fp, ",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+	  "\"ts\":%.3f,\"dur\":%.3f", name, (int) getpid(), tid,
+	  (t0 - base) * 1e6, (t1 - t0) * 1e6);
+	if(query > 0) fprintf(fp, ",\"args\":{\"query\":%d}", query);
+	fprintf(fp, "}\n");
+	fclose(fp);
+	put_record(trace_fd, text, size);
+}
+
+ double
+perf_phase(struct perf_query *q, int phase, double t0)
+{
+	/* the query has been in "phase" since t0: count it, and return
+	 * now, when the next phase begins
+	 */
+	double t1 = perf_now();
+
+	q->phase[phase] += t1 - t0;
+	perf_span(phase_name[phase], 0, q->n, t0, t1);
+	return t1;
+}
+
+ void
+perf_add(struct perf_count *to, struct perf_count *from)
+{
+	to->seqs += from->seqs;
+	to->residues += from->residues;
+	to->calls += from->calls;
+	to->matches += from->matches;
+	to->bytes += from->bytes;
+	to->format += from->format;
+}
+
+ void
+perf_load(struct seqfile *sf, struct pack *pk, double t0)
+{
+	/* a record of the sequences just loaded since t0, and the memory
+	 * they take: their residues (once for identical ones), their
+	 * struct seq's, the residue-numbering tables of resnum_subs.h, and
+	 * their packed codes
+	 */
+	struct seq *seqp;
+	struct rusage ru;
+	long residues = 0, residue_bytes = 0, resmap_bytes = 0;
+	int resmaps = 0;
+	double t1 = perf_now();
+	char *text;
+	size_t size;
+	FILE *fp;
+
+	perf_span("load", 0, 0, t0, t1);
+	if(stats_fd < 0) return;
+	if(sf->in_core)
+		for(seqp = sf->seq; seqp < &sf->seq[sf->n_seqs]; seqp++) {
+			residues += seqp->len;
+			if(!seqp->copy) residue_bytes += seqp->len + 1;
+			if(seqp->resmap != NULL) {
+				resmaps++;
+				resmap_bytes += seqp->resmap->size;
+				}
+			}
+	getrusage(RUSAGE_SELF, &ru);
+
+	fp = open_memstream(&text, &size);
+	fprintf(fp, "{\"type\":\"load\",\"pid\":%d,\"file\":", (int) getpid());
+	put_string(fp, sf->filename);
+	fprintf(fp, ",\"in_core\":%d,\"load_s\":%.6f", sf->in_core, t1 - t0);
+	if(sf->in_core)
+		fprintf(fp, ",\"sequences\":%d,\"distinct\":%d,\"residues\":%ld,"
+		  "\"residue_bytes\":%ld,\"seq_bytes\":%ld,\"resmaps\":%d,"
+		  "\"resmap_bytes\":%ld,\"pack_bytes\":%ld",
+		  sf->n_seqs, sf->n_distinct, residues, residue_bytes,
+		  (long) (sf->n_seqs * sizeof(struct seq)), resmaps, resmap_bytes,
+		  pk != NULL ? pk->nwords * 8 : 0L);
+	else fprintf(fp, ",\"chunk_bytes\":%ld", sf->bufsize);
+	fprintf(fp, ",\"maxrss_kb\":%ld}\n", ru.ru_maxrss);
+	fclose(fp);
+	put_record(stats_fd, text, size);
+}
+
+ void
+perf_end(struct perf_query *q)
+{
+	/* write the record of a query, or of a batch's pass */
+	struct perf_count *c = &q->count;
+	char *text;
+	size_t size;
+	FILE *fp;
+	int k;
+
+	if(stats_fd < 0) return;
+	fp = open_memstream(&text, &size);
+	if(q->pattern != NULL) {
+		fprintf(fp, "{\"type\":\"query\",\"pid\":%d,\"query\":%d,\"pattern\":",
+		  (int) getpid(), q->n);
+		put_string(fp, q->pattern);
+		}
+	else fprintf(fp, "{\"type\":\"batch\",\"pid\":%d,\"query\":%d",
+	  (int) getpid(), q->n);
+	fprintf(fp, ",\"how\":\"%s\"", q->how);
+	for(k = 0; k < PERF_NPHASES; k++)
+		fprintf(fp, ",\"%s_s\":%.6f", phase_name[k], q->phase[k]);
+	fprintf(fp, ",\"format_s\":%.6f,\"total_s\":%.6f", c->format,
+	  perf_now() - q->t0);
+	fprintf(fp, ",\"sequences\":%ld,\"residues\":%ld,\"matcher_calls\":%ld,"
+	  "\"matches\":%ld,\"bytes\":%ld}\n",
+	  c->seqs, c->residues, c->calls, c->matches, c->bytes);
+	fclose(fp);
+	put_record(stats_fd, text, size);
+}
+
+ void
+perf_close(void)
+{
+	char *text;
+
+	if(trace_fd >= 0 && getpid() == opener) {
+		text = strdup("]\n");
+		put_record(trace_fd, text, 2);
+		}
+	if(stats_fd > 2) close(stats_fd);
+	if(trace_fd > 2) close(trace_fd);
+	stats_fd = trace_fd = -1;
+	perf_on = 0;
+}
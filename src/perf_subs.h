@@ -0,0 +1,53 @@
+/* perf_subs.h:
+ *  where the time of each query goes, and what it looked at (sequery
+ *  --perf and --trace).
+ *
+ * A query's time is divided into phases, each timed from the end of
+ * the last; its counters are added up by whoever does the work, each
+ * thread of -j in a perf_count of its own.  When the query is done a
+ * line of JSON is written with all of it; the phases (and the pieces
+ * of sequences each thread searched) may also be written as events
+ * for a trace viewer (chrome://tracing, Perfetto).
+ * Nothing is timed or counted unless perf_on is set, by perf_open().
+ * Requires <stdio.h>, "resnum_subs.h", "seqfile_subs.h" and "pack_subs.h".
+ */
+
+static char perf_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define PERF_DEFS 0	/* reading the definition files (again) */
+#define PERF_EXPAND 1	/* expanding the pattern by them */
+#define PERF_COMPILE 2	/* compiling it */
+#define PERF_SCAN 3	/* searching the sequences, formatting included */
+#define PERF_REPORT 4	/* sorting the matches and writing them out */
+#define PERF_NPHASES 5
+
+struct perf_count {
+	long seqs;		/* sequences examined */
+	long residues;		/* residues examined */
+	long calls;		/* calls of a matcher */
+	long matches;
+	long bytes;		/* of the match lines formatted */
+	double format;		/* seconds spent formatting them */
+	};
+
+struct perf_query {
+	int n;			/* 1 for the first query, ... */
+	char *pattern;		/* as given, or NULL for a batch's pass */
+	char *how;		/* "scan", "index", "cache", "batch", "error" or "" */
+	double t0;		/* when it began */
+	double phase[PERF_NPHASES];	/* seconds in each */
+	struct perf_count count;
+	};
+
+extern int perf_on;
+
+int perf_open(char *statsname, char *tracename);
+double perf_now(void);
+void perf_begin(struct perf_query *q, char *pattern);
+double perf_phase(struct perf_query *q, int phase, double t0);
+void perf_span(char *name, int tid, int query, double t0, double t1);
+void perf_add(struct perf_count *to, struct perf_count *from);
+void perf_load(struct seqfile *sf, struct pack *pk, double t0);
+void perf_end(struct perf_query *q);
+void perf_close(void);
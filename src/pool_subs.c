@@ -0,0 +1,105 @@
+/* pool_subs.c:
+ *  run numbered tasks on a pool of threads, with work stealing.
+ *
+ * Tasks 0..ntasks-1 are dealt out in equal runs, one run to each thread.
+ * A thread takes tasks from the front of its own run; when that is
+ * empty it steals from the back of another thread's run, so a thread
+ * that drew slow tasks is helped out by the others.  Each task is run
+ * exactly once, and the caller's thread is one of the workers.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "pool_subs.h"
+
+struct worker {
+	pthread_mutex_t lock;	/* guards next and end */
+	int next, end;		/* tasks [next, end) still to do */
+	int id;
+	struct pool *pool;
+	pthread_t thread;
+	int started;		/* thread was created */
+	};
+
+struct pool {
+	int nthreads;
+	struct worker *w;
+	void (*task)(void *arg, int t, int thread);
+	void *arg;
+	};
+
+ static int
+take(struct pool *p, int me)
+{
+	/* next task for worker "me", or -1 if all are taken */
+	struct worker *w = &p->w[me];
+	int i, t = -1;
+
+	pthread_mutex_lock(&w->lock);
+	if(w->next < w->end) t = w->next++;
+	pthread_mutex_unlock(&w->lock);
+
+	for(i = 1; t < 0 && i < p->nthreads; i++) {
+		w = &p->w[(me+i) % p->nthreads];
+		pthread_mutex_lock(&w->lock);
+		if(w->next < w->end) t = --w->end;
+		pthread_mutex_unlock(&w->lock);
+		}
+	return t;
+}
+
+ static void *
+work(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	struct pool *p = w->pool;
+	int t;
+
+	while((t = take(p, w->id)) >= 0) (*p->task)(p->arg, t, w->id);
+	return NULL;
+}
+
+ int
+pool_run(int nthreads, int ntasks, void (*task)(void *arg, int t, int thread),
+  void *arg)
+{
+	/* call task(arg, t, thread) for t in 0..ntasks-1, on nthreads
+	 * threads numbered 0..nthreads-1, and return when all are done.
+	 * Returns the number of threads used.
+	 */
+	struct pool p;
+	int i;
+
+	if(nthreads > ntasks) nthreads = ntasks;
+	if(nthreads > POOL_MAXTHREADS) nthreads = POOL_MAXTHREADS;
+	if(nthreads < 1) nthreads = 1;
+
+	p.nthreads = nthreads;
+	p.task = task;
+	p.arg = arg;
+	p.w = (struct worker *) calloc(nthreads, sizeof(struct worker));
+	for(i = 0; i < nthreads; i++) {
+		pthread_mutex_init(&p.w[i].lock, NULL);
+		p.w[i].next = (int) ((long) ntasks * i / nthreads);
+		p.w[i].end = (int) ((long) ntasks * (i+1) / nthreads);
+		p.w[i].id = i;
+		p.w[i].pool = &p;
+		}
+
+	/* if no more threads can be had, the others steal the missing ones' runs */
+	for(i = 1; i < nthreads; i++)
+		p.w[i].started = pthread_create(&p.w[i].thread, NULL, work, &p.w[i]) == 0;
+	work(&p.w[0]);
+	for(i = 1; i < nthreads; i++)
+		if(p.w[i].started) pthread_join(p.w[i].thread, NULL);
+
+	for(i = 0; i < nthreads; i++) pthread_mutex_destroy(&p.w[i].lock);
+	free(p.w);
+	return nthreads;
+}
@@ -0,0 +1,11 @@
+/* pool_subs.h:
+ *  run numbered tasks on a pool of threads.
+ */
+
+static char pool_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define POOL_MAXTHREADS 256
+
+int pool_run(int nthreads, int ntasks, void (*task)(void *arg, int t, int thread),
+  void *arg);
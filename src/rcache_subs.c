@@ -0,0 +1,394 @@
+/* rcache_subs.c:
+ *  keep the matches of patterns searched for in a cache directory;
+ *  see rcache_subs.h.
+ *
+ * Each entry is a file named after a hash of its key, holding the key
+ * itself (so a hash that happens to collide is not taken for a hit),
+ * the three counts sequery reports, and the matches exactly as
+ * matchlist_write() wrote them.  Entries are written under a temporary
+ * name and renamed, so any number of sequery processes may share a
+ * directory.  Finding an entry sets its time, and the entries with the
+ * oldest times are removed when the directory holds too much.
+ *
+ * A batch may find thousands of its patterns here, so an entry found is
+ * not held open: only where its matches begin is noted, and the file is
+ * opened again to copy them.  The directory is looked through when it
+ * is opened, and again only when what this process has added since
+ * takes it past its size; it is then brought down to three quarters of
+ * the size, so that this happens seldom.  A batch finds all its entries
+ * before it copies any, so the entries this process has found are not
+ * removed by it, even if that leaves the directory over its size until
+ * the next time.
+ *
+ * Hashing the database is a pass over all of it, so the hash is itself
+ * kept in the directory, in a file named after the device, inode, time
+ * and size of the database and its delta file: it is made again only
+ * when one of them is replaced.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "resnum_subs.h"
+#include "delta_subs.h"
+#include "matchlist_subs.h"
+#include "rcache_subs.h"
+
+#define RCACHE_VERSION 1	/* of the entries' layout */
+#define COPYBUFSIZE (64<<10)
+
+extern char * pgmname;
+
+static void evict(void);
+
+static char *cachedir;		/* NULL if there is no cache */
+static long maxbytes;
+static long total;		/* bytes in the directory, as far as we know */
+static uint64_t *found;		/* hashes of the entries found, to be kept */
+static int nfound, foundalloc;
+static uint64_t db_hash;
+static int have_db;		/* db_hash is that of the database */
+
+ static uint64_t
+hash_bytes(uint64_t h, char *s, size_t n)
+{
+	while(n-- > 0) h = (h ^ (unsigned char) *s++) * 1099511628211ULL;
+	return h;
+}
+
+ int
+rcache_open(char *dirname, long megabytes)
+{
+	/* keep matches in directory "dirname", made if need be, of at most
+	 * "megabytes".  Returns 0, or -1 after printing a message if the
+	 * directory can't be used.
+	 */
+	struct stat st;
+
+	if(stat(dirname, &st) < 0 && mkdir(dirname, 0777) < 0) {
+		perror(dirname);
+		return -1;
+		}
+	if(access(dirname, R_OK|W_OK|X_OK) < 0) {
+		perror(dirname);
+		return -1;
+		}
+	cachedir = dirname;
+	maxbytes = megabytes << 20;
+	evict(); /* in case it was bigger last time */
+	return 0;
+}
+
+ static int
+hash_file(char *filename, uint64_t *h)
+{
+	/* add the contents of "filename", if there is one, to *h */
+	char *buf;
+	ssize_t n;
+	int fd;
+
+	if((fd = open(filename, O_RDONLY)) < 0) return 0;
+	(void) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	buf = malloc(COPYBUFSIZE);
+	while((n = read(fd, buf, COPYBUFSIZE)) > 0)
+		*h = hash_bytes(*h, buf, n);
+	free(buf);
+	close(fd);
+	if(n < 0) {
+		perror(filename);
+		return -1;
+		}
+	return 0;
+}
+
+ int
+rcache_db(char *seqfilename)
+{
+	/* the database is now "seqfilename" (and its delta segments).
+	 * Returns 0, or -1 if it could not be read, when nothing will be
+	 * found in or put in the cache until it can.
+	 */
+	static char *suffix[2] = { "", DELTA_SUFFIX };
+	char name[1024+16], memo[1024+32], tmp[1024+48];
+	long stamp[10];
+	struct stat st;
+	uint64_t h;
+	FILE *f;
+	int i;
+
+	have_db = 0;
+	if(cachedir == NULL) return 0;
+
+	memset(stamp, 0, sizeof(stamp));
+	for(i = 0; i < 2; i++) {
+		sprintf(name, "%s%s", seqfilename, suffix[i]);
+		if(stat(name, &st) != 0) continue;
+		stamp[5*i] = st.st_dev;
+		stamp[5*i+1] = st.st_ino;
+		stamp[5*i+2] = st.st_mtim.tv_sec;
+		stamp[5*i+3] = st.st_mtim.tv_nsec;
+		stamp[5*i+4] = st.st_size;
+		}
+	h = hash_bytes(14695981039346656037ULL, (char *) stamp, sizeof(stamp));
+	sprintf(memo, "%s/%016llx.db", cachedir, (unsigned long long) h);
+
+	if((f = fopen(memo, "r")) != NULL) {
+		i = fscanf(f, "%llx", (unsigned long long *) &db_hash);
+		fclose(f);
+		if(i == 1) {
+			have_db = 1;
+			return 0;
+			}
+		}
+
+	h = 14695981039346656037ULL;
+	for(i = 0; i < 2; i++) {
+		sprintf(name, "%s%s", seqfilename, suffix[i]);
+		if(hash_file(name, &h) < 0) return -1;
+		h = hash_bytes(h, "", 1); /* where one file ends */
+		}
+	db_hash = h;
+	have_db = 1;
+
+	sprintf(tmp, "%s.%d.new", memo, (int) getpid());
+	if((f = fopen(tmp, "w")) != NULL) {
+		fprintf(f, "%016llx\n", (unsigned long long) db_hash);
+		if(fclose(f) != 0 || rename(tmp, memo) != 0) unlink(tmp);
+		}
+	return 0;
+}
+
+ char *
+rcache_key(char *pat_in, char *pat, int context_pre, int context_post,
+  int one_per_seq)
+{
+	/* the key of the matches of pattern "pat_in", "pat" when expanded,
+	 * with the given context, of every sequence or (one_per_seq) only
+	 * of distinct ones.  Returns NULL if there is no cache.
+	 * The key is to be freed.
+	 */
+	char *key;
+
+	if(cachedir == NULL || !have_db) return NULL;
+	key = malloc(strlen(pat_in) + strlen(pat) + 128);
+	sprintf(key, "sequery matches %d\ndb %016llx\nx %d %d\nu %d\ngiven %s\nexpanded %s\n",
+	  RCACHE_VERSION, (unsigned long long) db_hash, context_pre, context_post,
+	  one_per_seq, pat_in, pat);
+	return key;
+}
+
+ static uint64_t
+entry_path(char *key, char *path)
+{
+	/* the file of the entry of "key", and the hash it is named after */
+	uint64_t h;
+
+	h = hash_bytes(14695981039346656037ULL, key, strlen(key));
+	sprintf(path, "%s/%016llx.sqc", cachedir, (unsigned long long) h);
+	return h;
+}
+
+ static int
+find(char *key, struct rcache_hit *hit)
+{
+	/* fill in *hit with the entry of "key", if there is one.
+	 * Returns 1 if there is, or 0.
+	 */
+	char line[128], *buf;
+	size_t len;
+	int ok = 0;
+	FILE *f;
+
+	hit->hash = entry_path(key, hit->path);
+	if((f = fopen(hit->path, "r")) == NULL) return 0;
+	len = strlen(key);
+	buf = malloc(len);
+	if(fread(buf, 1, len, f) == len && memcmp(buf, key, len) == 0 &&
+	  fgets(line, sizeof(line), f) != NULL &&
+	  sscanf(line, "%d %d %d", &hit->matches_found,
+	  &hit->sequences_matched, &hit->sequences_examined) == 3) {
+		hit->data = ftell(f);
+		ok = 1;
+		}
+	free(buf);
+	fclose(f);
+	return ok;
+}
+
+ int
+rcache_get(char *key, struct rcache_hit *hit)
+{
+	/* look for the entry of "key" (from rcache_key(), possibly NULL).
+	 * Returns 1 if found, having filled in *hit, or 0.
+	 */
+	if(key == NULL || !find(key, hit)) return 0;
+	(void) utimes(hit->path, NULL); /* used just now */
+	if(nfound == foundalloc) {
+		foundalloc = foundalloc ? 2 * foundalloc : 256;
+		found = (uint64_t *) realloc(found, foundalloc * sizeof(uint64_t));
+		}
+	found[nfound++] = hit->hash;
+	return 1;
+}
+
+ int
+rcache_copy(struct rcache_hit *hit, FILE *out)
+{
+	/* write the matches of entry "hit" onto out, as matchlist_write()
+	 * would have.  Returns 0, or -1 if they could not be (as when
+	 * another process has removed the entry since it was found).
+	 */
+	char *buf;
+	size_t n;
+	int ok;
+	FILE *f;
+
+	if((f = fopen(hit->path, "r")) == NULL) {
+		perror(hit->path);
+		return -1;
+		}
+	if(fseek(f, hit->data, SEEK_SET) != 0) {
+		fclose(f);
+		return -1;
+		}
+	buf = malloc(COPYBUFSIZE);
+	while((n = fread(buf, 1, COPYBUFSIZE, f)) > 0) fwrite(buf, 1, n, out);
+	ok = !ferror(f);
+	free(buf);
+	fclose(f);
+	if(!ok || fflush(out) == EOF || ferror(out)) return -1;
+	return 0;
+}
+
+struct entry {
+	char name[64];
+	off_t size;
+	struct timespec time;
+	};
+
+ static int
+older(const void *a, const void *b)
+{
+	const struct entry *x = a, *y = b;
+
+	if(x->time.tv_sec != y->time.tv_sec)
+		return x->time.tv_sec < y->time.tv_sec ? -1 : 1;
+	if(x->time.tv_nsec != y->time.tv_nsec)
+		return x->time.tv_nsec < y->time.tv_nsec ? -1 : 1;
+	return strcmp(x->name, y->name);
+}
+
+ static int
+by_hash(const void *a, const void *b)
+{
+	const uint64_t *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+ static void
+evict(void)
+{
+	/* note how much the directory holds, and if it is more than
+	 * maxbytes remove the least recently used entries until it holds
+	 * no more than three quarters of that, sparing those found by this
+	 * process (which may yet be copied)
+	 */
+	char path[1024+80];
+	struct entry *e = NULL;
+	struct dirent *de;
+	struct stat st;
+	uint64_t h;
+	int n = 0, nalloc = 0, i, len;
+	DIR *d;
+
+	total = 0;
+	if((d = opendir(cachedir)) == NULL) return;
+	while((de = readdir(d)) != NULL) {
+		len = strlen(de->d_name);
+		if(len >= sizeof(e->name) || !((len > 4 &&
+		  strcmp(de->d_name + len - 4, ".sqc") == 0) ||
+		  (len > 3 && strcmp(de->d_name + len - 3, ".db") == 0)))
+			continue;
+		sprintf(path, "%s/%s", cachedir, de->d_name);
+		if(stat(path, &st) != 0) continue;
+		if(n == nalloc) {
+			nalloc = nalloc ? 2 * nalloc : 256;
+			e = (struct entry *) realloc(e, nalloc * sizeof(struct entry));
+			}
+		strcpy(e[n].name, de->d_name);
+		e[n].size = st.st_size;
+		e[n].time = st.st_mtim;
+		total += st.st_size;
+		n++;
+		}
+	closedir(d);
+
+	if(total > maxbytes) {
+		qsort(e, n, sizeof(struct entry), older);
+		qsort(found, nfound, sizeof(uint64_t), by_hash);
+		for(i = 0; i < n && total > maxbytes / 4 * 3; i++) {
+			h = strtoull(e[i].name, NULL, 16);
+			if(nfound > 0 && bsearch(&h, found, nfound, sizeof(uint64_t),
+			  by_hash) != NULL)
+				continue;
+			sprintf(path, "%s/%s", cachedir, e[i].name);
+			if(unlink(path) == 0) total -= e[i].size;
+			}
+		}
+	free(e);
+}
+
+ void
+rcache_put(char *key, struct matchlist *ml, int matches_found,
+  int sequences_matched, int sequences_examined)
+{
+	/* keep the matches "ml" (possibly NULL, if there were none) of
+	 * "key", from rcache_key(), possibly NULL
+	 */
+	struct rcache_hit hit;
+	char tmp[1024+48];
+	long size;
+	FILE *f;
+
+	/* one already there is as good as new */
+	if(key == NULL || find(key, &hit)) return;
+	sprintf(tmp, "%s.%d.new", hit.path, (int) getpid());
+	if((f = fopen(tmp, "w")) == NULL) {
+		perror(tmp);
+		return;
+		}
+	fputs(key, f);
+	fprintf(f, "%d %d %d\n", matches_found, sequences_matched,
+	  sequences_examined);
+	if((ml != NULL && matchlist_write(ml, f) != 0) | ((size = ftell(f)) < 0) |
+	  (fclose(f) != 0)) {
+		fprintf(stderr, "%s: can't add to cache %s\n", pgmname, cachedir);
+		unlink(tmp);
+		return;
+		}
+	/* one that would fill the cache by itself is not worth keeping */
+	if(size > maxbytes) {
+		unlink(tmp);
+		return;
+		}
+	if(rename(tmp, hit.path) != 0) {
+		perror(hit.path);
+		unlink(tmp);
+		return;
+		}
+	total += size;
+	if(total > maxbytes) evict();
+}
@@ -0,0 +1,38 @@
+/* rcache_subs.h:
+ *  a directory of the sorted matches of patterns already searched for
+ *  (sequery --cache), so a pattern searched for again in the same
+ *  database is answered from there without looking at a sequence.
+ *
+ * An entry is known by a hash of the contents of the database (and of
+ * its delta segments), the pattern as given, the pattern as expanded
+ * by the definition files, the context widths of -x, and whether
+ * only one of identical sequences is reported (-u): everything
+ * the matches written depend on.  A change to the database or to a
+ * definition file therefore changes the key, and the entries made
+ * before it are never found again; they go when the directory grows
+ * past its size, the least recently used first.
+ * Requires <stdio.h>, <stdint.h> and "matchlist_subs.h".
+ */
+
+static char rcache_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define RCACHE_SIZE 256		/* megabytes the directory may hold, by default */
+
+struct rcache_hit {		/* an entry found */
+	char path[1024+32];	/* its file, opened only to copy the matches */
+	long data;		/* where they begin */
+	uint64_t hash;		/* of its key, which names the file */
+	int matches_found;
+	int sequences_matched;
+	int sequences_examined;
+	};
+
+int rcache_open(char *dirname, long megabytes);
+int rcache_db(char *seqfilename);
+char * rcache_key(char *pat_in, char *pat, int context_pre, int context_post,
+  int one_per_seq);
+int rcache_get(char *key, struct rcache_hit *hit);
+int rcache_copy(struct rcache_hit *hit, FILE *out);
+void rcache_put(char *key, struct matchlist *ml, int matches_found,
+  int sequences_matched, int sequences_examined);
@@ -0,0 +1,592 @@
+/* regex_subs.c:
+ *  parse sequery's "ed"-style patterns and match them with a lazy DFA.
+ *
+ * This replaces the old <regexp.h> compile()/step() macros, which newer
+ * C libraries no longer supply, and which backtracked over every
+ * possible length of a .\{m,n\} gap at every starting residue.
+ *
+ * regex_parse() accepts exactly what compile() accepted and reports the
+ * same errors.  Apart from \( \) (accepted, and ignored) the result is a
+ * plain list of pieces, see regex_subs.h.
+ *
+ * dfa_build() turns the pieces into a position automaton (one position
+ * per residue a piece may consume) and dfa_match() runs it as a DFA.
+ * DFA states are sets of positions, made only when first reached and
+ * remembered in a cache of at most DFASTATES states, which is simply
+ * emptied if it fills up.  Residues are first mapped to "byte classes"
+ * (characters no piece can tell apart share a class; a protein pattern
+ * seldom needs more than 25) so each step is one or two table lookups.
+ *
+ * step() reported the leftmost match, and for it the longest match
+ * that the pattern allows; dfa_match() does the same in three passes
+ * that together read each residue a small, fixed number of times:
+ *	1. a forward scan finds where the first match to be complete ends;
+ *	2. a scan of the reversed pattern, backward over at most the
+ *	   longest possible match on either side of that point, finds
+ *	   the leftmost position at which any match starts;
+ *	3. a forward scan anchored there finds the longest match.
+ * As with step(), ^ anchors a match to the beginning of the string
+ * given, and $ to its end.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "regex_subs.h"
+
+#define NBRA 9		/* most \( allowed, as in ed */
+#define MAXREP 255	/* repetition counts must be below this, as in ed */
+#define DFASTATES 1000	/* most DFA states cached per automaton */
+
+#define SETBIT(set,i) ((set)[(i)/WORDBITS] |= 1UL<<((i)%WORDBITS))
+#define TESTBIT(set,i) ((set)[(i)/WORDBITS] & 1UL<<((i)%WORDBITS))
+#define WORDBITS (8*sizeof(unsigned long))
+
+#define S_ACCEPT 1	/* dstate flags */
+#define S_DEAD 2
+
+/* position automaton for one direction of the pattern */
+struct nfa {
+	int nslots;		/* positions; "position" nslots means accept */
+	int *piece;		/* piece whose class a position consumes */
+	int *next;		/* position after consuming */
+	int *skip;		/* position reached without consuming, or -1 */
+	};
+
+/* lazily built DFA over a struct nfa */
+struct ldfa {
+	struct nfa *nfa;
+	unsigned char *memb;	/* memb[piece*nclasses+class]: class matches piece */
+	int nclasses;
+	int anchored;		/* if not, a match may begin at any residue */
+	int nwords;		/* words per position set */
+	int nstates;
+	unsigned long *sets;	/* [DFASTATES][nwords] */
+	int *trans;		/* [DFASTATES][nclasses], -1 if not yet known */
+	char *flags;		/* [DFASTATES] S_ACCEPT, S_DEAD */
+	int *hnext;		/* [DFASTATES] hash chains */
+	int *bucket;		/* [DFASTATES] hash heads */
+	int start;		/* start state, -1 if not in cache */
+	int flushes;		/* times the cache has been emptied */
+	unsigned long *tmp;
+	};
+
+struct dfa {
+	int bol, eol;
+	int maxlen;
+	int npieces;
+	unsigned char byteclass[256];
+	int nclasses;
+	unsigned char *memb_fwd, *memb_rev;
+	struct nfa fwd, rev;
+	struct ldfa *fu, *fa, *ru, *ra; /* forward/reverse, unanchored/anchored */
+	};
+
+ static struct re_piece *
+new_piece(struct regex *re, int *alloc)
+{
+	struct re_piece *p;
+
+	if(re->npieces == *alloc) {
+		*alloc = *alloc ? 2 * *alloc : 16;
+		re->piece = (struct re_piece *) realloc(re->piece,
+		  *alloc * sizeof(struct re_piece));
+		}
+	p = &re->piece[re->npieces++];
+	memset(p, 0, sizeof(*p));
+	p->min = p->max = 1;
+	return p;
+}
+
+ char *
+regex_parse(char *pattern, struct regex *re)
+{
+	/* parse "pattern" into "re".  Returns NULL if all is well,
+	 * otherwise (having freed anything allocated) an error message.
+	 */
+	char *sp = pattern;
+	int c, i, lc, neg, cflg;
+	int alloc = 0;
+	int nbra = 0, ebra = 0, closed = 0;
+	int last = -2;		/* piece * or \{ applies to; -2 none yet, -1 a \( \) */
+	int last_ranged = 0;	/* it already has a \{ \} */
+	unsigned char ccl[16];
+	struct re_piece *p;
+	char *msg;
+
+	memset(re, 0, sizeof(*re));
+	if(*sp == '\0') return "No remembered search string.";
+	if(*sp == '^') {
+		re->bol = 1;
+		sp++;
+		}
+
+	for(;;) {
+		c = *sp++;
+		switch(c) {
+
+		case '\0':
+			goto done;
+
+		case '.':
+			p = new_piece(re, &alloc);
+			for(i = 1; i < 256; i++) p->cls[i>>3] |= 1<<(i&07);
+			last = re->npieces-1;
+			last_ranged = 0;
+			continue;
+
+		case '*':
+			if(last < 0) goto defchar;
+			if(!last_ranged) {
+				re->piece[last].min = 0;
+				re->piece[last].max = RE_INF;
+				}
+			continue;
+
+		case '$':
+			if(*sp != '\0') goto defchar;
+			re->eol = 1;
+			continue;
+
+		case '[':
+			memset(ccl, 0, sizeof(ccl));
+			neg = 0;
+			if((c = *sp++) == '^') {
+				neg = 1;
+				c = *sp++;
+				}
+			lc = 0;
+			do {
+				if(c == '\0') { msg = "[] imbalance."; goto error; }
+				if(c == '-' && lc != 0) {
+					if((c = *sp++) == ']') {
+						ccl['-'>>3] |= 1<<('-'&07);
+						break;
+						}
+					if(c == '\0') { msg = "[] imbalance."; goto error; }
+					for(; lc < (c&0177); lc++) ccl[lc>>3] |= 1<<(lc&07);
+					}
+				lc = c & 0177;
+				ccl[lc>>3] |= 1<<(lc&07);
+				} while((c = *sp++) != ']');
+			if(neg) {
+				for(i = 0; i < 16; i++) ccl[i] ^= 0377;
+				ccl[0] &= 0376;
+				}
+			/* like step(), ignore the eighth bit of the residue */
+			p = new_piece(re, &alloc);
+			for(i = 1; i < 256; i++)
+				if(ccl[(i&0177)>>3] & 1<<(i&07)) p->cls[i>>3] |= 1<<(i&07);
+			last = re->npieces-1;
+			last_ranged = 0;
+			continue;
+
+		case '\\':
+			switch(c = *sp++) {
+
+			case '(':
+				if(nbra >= NBRA) { msg = "Too many \\(."; goto error; }
+				nbra++;
+				last = -1;
+				continue;
+
+			case ')':
+				if(++ebra > nbra) { msg = "\\( \\) imbalance."; goto error; }
+				closed++;
+				last = -1;
+				continue;
+
+			case '{':
+				if(last == -2) goto defchar;
+				if(last == -1) { msg = "\\{ \\} must follow a residue, . or [...]."; goto error; }
+				cflg = 0;
+				p = &re->piece[last];
+			nlim:
+				c = *sp++;
+				i = 0;
+				do {
+					if('0' <= c && c <= '9') i = 10 * i + c - '0';
+					else { msg = "Bad number."; goto error; }
+					} while((c = *sp++) != '\\' && c != ',');
+				if(i >= MAXREP) { msg = "Range endpoint too large."; goto error; }
+				if(!cflg) p->min = p->max = i;
+				else p->max = i;
+				if(c == ',') {
+					if(cflg++) { msg = "More than 2 numbers  given  in \\{ \\}."; goto error; }
+					if((c = *sp++) == '\\') p->max = RE_INF;
+					else {
+						sp--;
+						goto nlim;
+						}
+					}
+				if(*sp++ != '}') { msg = "} expected after \\."; goto error; }
+				if(p->max != RE_INF && p->max < p->min) {
+					msg = "First number exceeds second in \\{ \\}.";
+					goto error;
+					}
+				last_ranged = 1;
+				continue;
+
+			case '\0':
+				msg = "Illegal or missing delimiter.";
+				goto error;
+
+			case 'n':
+				c = '\n';
+				goto defchar;
+
+			default:
+				if(c >= '1' && c <= '9') {
+					if(c - '1' >= closed) msg = "``\\ digit'' out of range.";
+					else msg = "\\( \\) back-references are not supported.";
+					goto error;
+					}
+				}
+			/* fall through: \ turns off special meaning */
+
+		defchar:
+		default:
+			p = new_piece(re, &alloc);
+			p->cls[(c&0377)>>3] |= 1<<(c&07);
+			last = re->npieces-1;
+			last_ranged = 0;
+			continue;
+			}
+		}
+
+done:
+	if(nbra != ebra) { msg = "\\( \\) imbalance."; goto error; }
+	re->minlen = re->maxlen = 0;
+	for(i = 0; i < re->npieces; i++) {
+		p = &re->piece[i];
+		for(c = 0; c < 32; c++)
+			if(RE_ISMEMBER(p, 0x40+c)) p->codes |= 1U << c;
+		re->minlen += re->piece[i].min;
+		if(re->piece[i].max == RE_INF || re->maxlen == RE_INF) re->maxlen = RE_INF;
+		else re->maxlen += re->piece[i].max;
+		}
+	return NULL;
+
+error:
+	regex_free(re);
+	return msg;
+}
+
+ void
+regex_free(struct regex *re)
+{
+	if(re->piece != NULL) free(re->piece);
+	re->piece = NULL;
+	re->npieces = 0;
+}
+
+ static void
+nfa_build(struct nfa *n, struct regex *re, int reverse)
+{
+	/* one position for each residue a piece can consume; an unlimited
+	 * piece gets one extra position that loops on itself.
+	 */
+	int i, j, k, idx, end;
+	struct re_piece *p;
+
+	n->nslots = 0;
+	for(i = 0; i < re->npieces; i++) {
+		p = &re->piece[i];
+		n->nslots += p->max == RE_INF ? p->min + 1 : p->max;
+		}
+	n->piece = (int *) malloc((n->nslots+1) * sizeof(int));
+	n->next = (int *) malloc((n->nslots+1) * sizeof(int));
+	n->skip = (int *) malloc((n->nslots+1) * sizeof(int));
+
+	k = 0;
+	for(i = 0; i < re->npieces; i++) {
+		idx = reverse ? re->npieces-1-i : i;
+		p = &re->piece[idx];
+		end = k + (p->max == RE_INF ? p->min + 1 : p->max);
+		for(j = 0; j < p->min; j++, k++) {
+			n->piece[k] = idx;
+			n->next[k] = k+1;
+			n->skip[k] = -1;
+			}
+		if(p->max == RE_INF) {
+			n->piece[k] = idx;
+			n->next[k] = k;
+			n->skip[k] = end;
+			k++;
+			}
+		else for(; j < p->max; j++, k++) {
+			n->piece[k] = idx;
+			n->next[k] = k+1;
+			n->skip[k] = end;
+			}
+		}
+}
+
+ static void
+nfa_free(struct nfa *n)
+{
+	free(n->piece);
+	free(n->next);
+	free(n->skip);
+}
+
+ static void
+closure(struct nfa *n, unsigned long *set, int k)
+{
+	/* add position k, and all those reachable from it without consuming */
+	for(;;) {
+		SETBIT(set, k);
+		if(k == n->nslots || n->skip[k] < 0) return;
+		k = n->skip[k];
+		}
+}
+
+ static struct ldfa *
+ldfa_new(struct nfa *n, unsigned char *memb, int nclasses, int anchored)
+{
+	struct ldfa *ld;
+
+	ld = (struct ldfa *) calloc(1, sizeof(struct ldfa));
+	ld->nfa = n;
+	ld->memb = memb;
+	ld->nclasses = nclasses;
+	ld->anchored = anchored;
+	ld->nwords = (n->nslots + 1 + WORDBITS-1) / WORDBITS;
+	ld->sets = (unsigned long *) malloc(DFASTATES * ld->nwords * sizeof(unsigned long));
+	ld->trans = (int *) malloc(DFASTATES * nclasses * sizeof(int));
+	ld->flags = (char *) malloc(DFASTATES);
+	ld->hnext = (int *) malloc(DFASTATES * sizeof(int));
+	ld->bucket = (int *) malloc(DFASTATES * sizeof(int));
+	ld->tmp = (unsigned long *) malloc(ld->nwords * sizeof(unsigned long));
+	memset(ld->bucket, -1, DFASTATES * sizeof(int));
+	ld->start = -1;
+	return ld;
+}
+
+ static void
+ldfa_free(struct ldfa *ld)
+{
+	if(ld == NULL) return;
+	free(ld->sets);
+	free(ld->trans);
+	free(ld->flags);
+	free(ld->hnext);
+	free(ld->bucket);
+	free(ld->tmp);
+	free(ld);
+}
+
+ static int
+ldfa_state(struct ldfa *ld, unsigned long *set)
+{
+	/* return the state for position set "set", making it if need be */
+	unsigned long h = 0;
+	unsigned long *sp;
+	int i, s, empty;
+
+	for(i = 0; i < ld->nwords; i++) h = (h ^ set[i]) * 1099511628211UL;
+	h %= DFASTATES;
+	for(s = ld->bucket[h]; s >= 0; s = ld->hnext[s])
+		if(0 == memcmp(&ld->sets[s*ld->nwords], set, ld->nwords*sizeof(unsigned long)))
+			return s;
+
+	if(ld->nstates == DFASTATES) {
+		/* cache full: forget everything and start over */
+		ld->nstates = 0;
+		ld->start = -1;
+		ld->flushes++;
+		memset(ld->bucket, -1, DFASTATES * sizeof(int));
+		}
+	s = ld->nstates++;
+	sp = &ld->sets[s*ld->nwords];
+	memcpy(sp, set, ld->nwords*sizeof(unsigned long));
+	for(i = 0; i < ld->nclasses; i++) ld->trans[s*ld->nclasses+i] = -1;
+	empty = 1;
+	for(i = 0; i < ld->nwords; i++) if(sp[i]) empty = 0;
+	ld->flags[s] = (TESTBIT(sp, ld->nfa->nslots) ? S_ACCEPT : 0) | (empty ? S_DEAD : 0);
+	ld->hnext[s] = ld->bucket[h];
+	ld->bucket[h] = s;
+	return s;
+}
+
+ static int
+ldfa_start(struct ldfa *ld)
+{
+	if(ld->start < 0) {
+		memset(ld->tmp, 0, ld->nwords*sizeof(unsigned long));
+		closure(ld->nfa, ld->tmp, 0);
+		ld->start = ldfa_state(ld, ld->tmp);
+		}
+	return ld->start;
+}
+
+ static int
+ldfa_next(struct ldfa *ld, int s, int c)
+{
+	/* the state reached from state s on a residue of class c */
+	struct nfa *n = ld->nfa;
+	unsigned long *set = &ld->sets[s*ld->nwords];
+	int k, t, flushes;
+
+	memset(ld->tmp, 0, ld->nwords*sizeof(unsigned long));
+	for(k = 0; k < n->nslots; k++)
+		if(TESTBIT(set, k) && ld->memb[n->piece[k]*ld->nclasses + c])
+			closure(n, ld->tmp, n->next[k]);
+	if(!ld->anchored) closure(n, ld->tmp, 0);
+	flushes = ld->flushes;
+	t = ldfa_state(ld, ld->tmp);
+	if(flushes == ld->flushes) ld->trans[s*ld->nclasses + c] = t;
+	return t;
+}
+
+#define NEXT(ld,s,c) \
+	((t = (ld)->trans[(s)*(ld)->nclasses + (c)]) >= 0 ? t : ldfa_next((ld),(s),(c)))
+
+ struct dfa *
+dfa_build(struct regex *re)
+{
+	/* prepare to match "re"; the automata themselves are made as needed */
+	struct dfa *dfa;
+	int b, c, i, nc;
+	int rep[256];		/* a byte of each class */
+
+	dfa = (struct dfa *) calloc(1, sizeof(struct dfa));
+	dfa->bol = re->bol;
+	dfa->eol = re->eol;
+	dfa->maxlen = re->maxlen;
+	dfa->npieces = re->npieces;
+
+	/* bytes are in the same class if every piece treats them alike */
+	nc = 0;
+	for(b = 0; b < 256; b++) {
+		for(c = 0; c < nc; c++) {
+			for(i = 0; i < re->npieces; i++)
+				if(!RE_ISMEMBER(&re->piece[i], b) != !RE_ISMEMBER(&re->piece[i], rep[c]))
+					break;
+			if(i == re->npieces) break;
+			}
+		if(c == nc) rep[nc++] = b;
+		dfa->byteclass[b] = c;
+		}
+	dfa->nclasses = nc;
+
+	dfa->memb_fwd = (unsigned char *) malloc(re->npieces * nc + 1);
+	for(i = 0; i < re->npieces; i++)
+		for(c = 0; c < nc; c++)
+			dfa->memb_fwd[i*nc+c] = RE_ISMEMBER(&re->piece[i], rep[c]) != 0;
+	dfa->memb_rev = dfa->memb_fwd; /* positions keep their piece's number */
+
+	nfa_build(&dfa->fwd, re, 0);
+	nfa_build(&dfa->rev, re, 1);
+	return dfa;
+}
+
+ void
+dfa_free(struct dfa *dfa)
+{
+	if(dfa == NULL) return;
+	ldfa_free(dfa->fu);
+	ldfa_free(dfa->fa);
+	ldfa_free(dfa->ru);
+	ldfa_free(dfa->ra);
+	nfa_free(&dfa->fwd);
+	nfa_free(&dfa->rev);
+	free(dfa->memb_fwd);
+	free(dfa);
+}
+
+ static int
+longest(struct dfa *dfa, char *string, int from, int len)
+{
+	/* end of the longest match beginning at "from", or -1 if none */
+	struct ldfa *ld;
+	int s, t, p, last = -1;
+
+	if(dfa->fa == NULL)
+		dfa->fa = ldfa_new(&dfa->fwd, dfa->memb_fwd, dfa->nclasses, 1);
+	ld = dfa->fa;
+	s = ldfa_start(ld);
+	for(p = from; ; p++) {
+		if((ld->flags[s] & S_ACCEPT) && (!dfa->eol || p == len)) last = p;
+		if(p == len || (ld->flags[s] & S_DEAD)) break;
+		s = NEXT(ld, s, dfa->byteclass[(unsigned char) string[p]]);
+		}
+	return last;
+}
+
+ int
+dfa_match(struct dfa *dfa, char *string, int len, int *p_bgn, int *p_len)
+{
+	/* look for the pattern in string[0..len).  If found, return 1 and set
+	 * *p_bgn and *p_len to the leftmost match and its length.
+	 */
+	struct ldfa *ld;
+	unsigned char *bc = dfa->byteclass;
+	int s, t, p, lo, hi, e1, best, end;
+
+	if(dfa->bol) {
+		if((end = longest(dfa, string, 0, len)) < 0) return 0;
+		*p_bgn = 0;
+		*p_len = end;
+		return 1;
+		}
+
+	if(dfa->eol) {
+		/* every match ends at len: scan back from there for the first start */
+		if(dfa->ra == NULL)
+			dfa->ra = ldfa_new(&dfa->rev, dfa->memb_rev, dfa->nclasses, 1);
+		ld = dfa->ra;
+		s = ldfa_start(ld);
+		best = -1;
+		for(p = len; ; p--) {
+			if(ld->flags[s] & S_ACCEPT) best = p;
+			if(p == 0 || (ld->flags[s] & S_DEAD)) break;
+			s = NEXT(ld, s, bc[(unsigned char) string[p-1]]);
+			}
+		if(best < 0) return 0;
+		*p_bgn = best;
+		*p_len = len - best;
+		return 1;
+		}
+
+	/* 1. where does the first match to be complete end? */
+	if(dfa->fu == NULL)
+		dfa->fu = ldfa_new(&dfa->fwd, dfa->memb_fwd, dfa->nclasses, 0);
+	ld = dfa->fu;
+	s = ldfa_start(ld);
+	for(p = 0; !(ld->flags[s] & S_ACCEPT); p++) {
+		if(p == len) return 0;
+		s = NEXT(ld, s, bc[(unsigned char) string[p]]);
+		}
+	e1 = p;
+
+	/* 2. every match ends at or after e1, so the leftmost one starts
+	 * no earlier than e1-maxlen, no later than e1, and ends by e1+maxlen.
+	 */
+	lo = 0;
+	hi = len;
+	if(dfa->maxlen != RE_INF) {
+		if(e1 - dfa->maxlen > lo) lo = e1 - dfa->maxlen;
+		if(e1 + dfa->maxlen < hi) hi = e1 + dfa->maxlen;
+		}
+	if(dfa->ru == NULL)
+		dfa->ru = ldfa_new(&dfa->rev, dfa->memb_rev, dfa->nclasses, 0);
+	ld = dfa->ru;
+	s = ldfa_start(ld);
+	best = e1;
+	for(p = hi; ; p--) {
+		if(ld->flags[s] & S_ACCEPT) best = p;
+		if(p == lo) break;
+		s = NEXT(ld, s, bc[(unsigned char) string[p-1]]);
+		}
+
+	/* 3. the longest match from there */
+	*p_bgn = best;
+	*p_len = longest(dfa, string, best, len) - best;
+	return 1;
+}
@@ -0,0 +1,41 @@
+/* regex_subs.h:
+ *  "ed"-style regular expressions of sequery patterns, matched with a
+ *  lazily built deterministic automaton (DFA).
+ *
+ * A pattern is parsed into a list of "pieces": each piece is a class of
+ * characters (a single character, ".", or a [...] class) repeated
+ * between "min" and "max" times, as written with *, \{m\}, \{m,\} or
+ * \{m,n\}.  This is everything ed patterns can say apart from \( \)
+ * back-references, which sequery can not express anyway (it takes
+ * \digit for itself).  The pieces are then compiled into a DFA.
+ * Requires <stdio.h>.
+ */
+
+static char regex_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define RE_INF (-1) /* "max" of a piece repeated without limit */
+
+struct re_piece {
+	unsigned char cls[32];	/* bit c set if character c matches */
+	unsigned int codes;	/* the same for residues 0x40-0x5F: bit k set
+				 * if the residue of code k matches, as one
+				 * 32-bit mask (see pack_subs.h) */
+	int min, max;		/* number of repetitions */
+	};
+
+struct regex {
+	int bol, eol;		/* pattern began with ^, ended with $ */
+	int npieces;
+	struct re_piece *piece;
+	int minlen, maxlen;	/* shortest, longest match (maxlen may be RE_INF) */
+	};
+
+#define RE_ISMEMBER(p,c) ((p)->cls[(unsigned char)(c)>>3] & (1<<((c)&07)))
+
+char * regex_parse(char *pattern, struct regex *re);
+void regex_free(struct regex *re);
+
+struct dfa * dfa_build(struct regex *re);
+int dfa_match(struct dfa *dfa, char *string, int len, int *p_bgn, int *p_len);
+void dfa_free(struct dfa *dfa);
@@ -1,160 +1,357 @@
-/*
-* $Log:	resnum_subs.c,v $
- * Revision 1.3  92/08/21  21:03:58  mp
- * Moved "include ctype.h" for System V compatibility.
- * 
- * Revision 1.2  92/03/23  18:30:34  mp
- * Added additional "origin" info to allow most PDB sequences (those that
- * do not contain any suffixed residue names) to fit within the numeric
- * origin-count scheme, reducing "sequery" run-time space requirements
- * from 7 meg to 2 meg.
- * 
- * Revision 1.1  92/03/17  19:11:32  mp
- * Initial revision
- * 
-*/
-#ifndef lint
-static char rcs_id[] =
- "@(#) $Header: /export/asd/prog/sequery/devel/src/resnum_subs.c,v 1.3 92/08/21 21:03:58 mp Exp Locker: mp $";
-#endif
-
-#include <stdio.h>
-#include "resnum_subs.h"
-
-/*Vishal's changes*/
-#include <ctype.h>
- 
-#define MAXSEQLEN 2048
-#define MAXNSEQ 8000
-
-  char * 
-get_resnumber(num,seqp,c_num)
-int num;
-struct seq *seqp;
-char *c_num; /* modified */
-{
-	/* writes residue number/name into "c_num" which should be allocated by
-	 * caller as a character array big enough to hold largest residue number/name.
-	 */
-	if (seqp->resnumber==NULL || seqp->resnumber[num]==NULL && seqp->origin_is_numeric ) {
-		sprintf(c_num, "%d", num+seqp->origin_n); /* name is merely index in array */
-		}
-	//these lines modified because doing a strcpy with a NULL source results in a segmentation fault in Linux using gcc
-	else if (seqp->resnumber[num] == NULL) {
-		c_num = NULL;
-	} else {
-		strcpy(c_num, seqp->resnumber[num]); /* copy name from char array */
-	}
-	
-	return(c_num);
-}
-
-
-
- int
-fget_seq( seqp, count, seqfile)
-struct seq * seqp;
-int count;
-FILE * seqfile;
-{
-	/* read up to "count" sequences from file. Return number read.
-	 * Note: this malloc's the sequence strings.
-	 */
-int k=0; /* count of ones read */
-register int /* char */ c;
-register int i;
-char * malloc();
-extern char * pgmname;
-int non_standard; /* flag for sequence that contains "weird" residue numbers. */
-#include <ctype.h>
-
-
-while(count--) {
-	if(4!=fscanf(seqfile, 
-	  "%8s %1s %s %d", 
-	  seqp->name, seqp->chain, seqp->origin, &seqp->len) 
-	  ) return k;
-	(void) struptolow(seqp->name); /* force to lower case */
-
-	/* set "origin_n" if origin is purely numeric */
-	seqp->origin_is_numeric = is_numeric(seqp->origin);
-	if(seqp->origin_is_numeric) sscanf(seqp->origin, "%d", &seqp->origin_n);
-		
-	seqp->sequence = (char *) malloc(1+seqp->len); /* needs better checking... */
-	seqp->resnumber=(char **)NULL;
-	non_standard=0;
-	i=0;
-	while( i<seqp->len) {
-		char *resnum_ptr,*c_ptr;
-		int resnum,j;
-		int itoa();
-		c = getc(seqfile);
-		if(c==EOF) {
-			free(seqp->sequence); /* incomplete */
-			seqp->len = 0;
-			return k;
-			}
-		if( isspace(c) ) continue;
-		if ( c == '#' ) {
-			/* bypass comments */
-			while ( '\n' != (c= getc(seqfile)))  if(c==EOF) return k;
-			}
-		if(c=='(') {
-			if(!non_standard) {
-				seqp->resnumber=(char **)calloc(seqp->len+1, sizeof(char *));
-				non_standard=1;
-				}
-			c_ptr=resnum_ptr=(char *)malloc(9);
-			for(j=0;(c=getc(seqfile))!=')';j++) *c_ptr++=c;
-			*c_ptr='\0';
-			seqp->resnumber[i]=resnum_ptr;
-			sscanf(resnum_ptr,"%d",&resnum);
-			/* check to see if we're really beginning a standard sequence from
-			 * the specified origin (MP experiment):
-			 */
-			if(i==0 && seqp->origin_is_numeric && resnum == seqp->origin_n) {
-				/* if so, make us "standard" to save space & speed */
-				free(seqp->resnumber[i]);
-				free(seqp->resnumber);
-				seqp->resnumber = NULL;
-				non_standard=0;
-				}
-			while(isspace(seqp->sequence[i]=getc(seqfile))); /* MP: why this asgnmt? */
-			++i;
-		  	}
-		else if(non_standard) {
-			/* ordinary number but not equal to index in array ... */
-			seqp->resnumber[i]=(char *)malloc(9);
-			sprintf(seqp->resnumber[i],"%d",++resnum);
-			seqp->sequence[i++] = c;
-			}
-		else seqp->sequence[i++] = c;
-		}
-	seqp->sequence[i] = '\0';
-	k++;
-	seqp++;
-	}
-return k;
-}
-
-
- char *
-struptolow(str)
-char * str;
-{
-#include <ctype.h>
-register char * s = str;
-	/* make upper case alphabetics into lower case */
-	for(;*s;s++) if(isascii(*s) && isupper(*s) ) *s = tolower(*s);
-	return str;
-	}
-
- int
-is_numeric(s)
-char * s;
-{
-#include <ctype.h>
-
-	for(;*s;s++) if(!( isascii(*s) && isdigit(*s) ) ) return 0;
-	return 1;
-	}
+/*
+* $Log:	resnum_subs.c,v $
+ * Revision 1.3  92/08/21  21:03:58  mp
+ * Moved "include ctype.h" for System V compatibility.
+ * 
+ * Revision 1.2  92/03/23  18:30:34  mp
+ * Added additional "origin" info to allow most PDB sequences (those that
+ * do not contain any suffixed residue names) to fit within the numeric
+ * origin-count scheme, reducing "sequery" run-time space requirements
+ * from 7 meg to 2 meg.
+ * 
+ * Revision 1.1  92/03/17  19:11:32  mp
+ * Initial revision
+ * 
+*/
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header: /export/asd/prog/sequery/devel/src/resnum_subs.c,v 1.3 92/08/21 21:03:58 mp Exp Locker: mp $";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "resnum_subs.h"
+#include "seqdb_subs.h"
+
+/*Vishal's changes*/
+#include <ctype.h>
+ 
+#define MAXSEQLEN 2048
+#define MAXNSEQ 8000
+
+/* the table fget_seq() is building for the current sequence */
+static struct resseg *bld_seg;
+static int bld_n_segs, bld_max_segs;
+static char *bld_names;
+static int bld_names_size, bld_max_names;
+
+ static struct resseg *
+find_seg(rm, num)
+struct resmap *rm;
+int num;
+{
+	/* the segment holding residue "num", or NULL if it comes before them all */
+	struct resseg *seg = RESMAP_SEG(rm);
+	int k = RESMAP_BLOCKS(rm)[num/RESMAP_BLOCK];
+
+	if(k < 0) k = 0;
+	while(k+1 < rm->n_segs && seg[k+1].index <= num) k++;
+	return seg[k].index <= num ? &seg[k] : NULL;
+}
+
+ static void
+decimal(c_num, n)
+char *c_num;
+int n;
+{
+	/* sprintf(c_num, "%d", n), which is slow enough to matter when
+	 * every match of a broad pattern is numbered
+	 */
+	char digits[12], *d = &digits[sizeof(digits)];
+	unsigned int u = n<0 ? -(unsigned int)n : n;
+
+	*--d = '\0';
+	do *--d = '0' + u%10; while((u /= 10) != 0);
+	if(n<0) *--d = '-';
+	strcpy(c_num, d);
+}
+
+  char * 
+get_resnumber(num,seqp,c_num)
+int num;
+struct seq *seqp;
+char *c_num; /* modified */
+{
+	/* writes residue number/name into "c_num" which should be allocated by
+	 * caller as a character array big enough to hold largest residue number/name.
+	 * Returns NULL, leaving c_num alone, for a residue without a name
+	 * (before the first segment of a table, with a non-numeric origin).
+	 */
+	struct resseg *sp;
+
+	if (seqp->resmap!=NULL && num>=0 && num<seqp->len &&
+	  (sp = find_seg(seqp->resmap, num))!=NULL) {
+		if(sp->name>=0) strcpy(c_num, RESMAP_NAMES(seqp->resmap)+sp->name);
+		else decimal(c_num, sp->number+num-sp->index);
+		}
+	else if (seqp->resmap==NULL || seqp->origin_is_numeric) {
+		decimal(c_num, num+seqp->origin_n); /* name is merely index in array */
+		}
+	else c_num = NULL;
+	return(c_num);
+}
+
+ static int
+canonical_number(name, p_n)
+char *name;
+int *p_n;
+{
+	/* true if "name" is a number just as sprintf("%d") would write it */
+	char buf[16];
+
+	if(1!=sscanf(name, "%d", p_n)) return 0;
+	sprintf(buf, "%d", *p_n);
+	return 0==strcmp(buf, name);
+}
+
+ int
+resnum_index(seqp, name)
+struct seq *seqp;
+char *name;
+{
+	/* index of the first residue of seqp whose number/name is "name"
+	 * (as get_resnumber() would write it), or -1 if there is none.
+	 */
+	struct resmap *rm = seqp->resmap;
+	struct resseg *seg, *sp;
+	int n, is_number, first, lo, hi, mid, end;
+
+	is_number = canonical_number(name, &n);
+	first = rm==NULL ? seqp->len : RESMAP_SEG(rm)[0].index;
+	if(is_number && (rm==NULL || seqp->origin_is_numeric) &&
+	  n-seqp->origin_n>=0 && n-seqp->origin_n<first)
+		return n-seqp->origin_n;
+	if(rm==NULL) return -1;
+
+	seg = RESMAP_SEG(rm);
+	lo = 0;
+	if(rm->ordered) {
+		/* a name not beginning with a number is in no ordered table */
+		if(!is_number && 1!=sscanf(name, "%d", &n)) return -1;
+		/* first segment whose last number is n or more */
+		hi = rm->n_segs;
+		while(lo<hi) {
+			mid = (lo+hi)/2;
+			end = mid+1<rm->n_segs ? seg[mid+1].index : seqp->len;
+			if(seg[mid].name<0 ? seg[mid].number+(end-1-seg[mid].index) < n :
+			  seg[mid].number < n)
+				lo = mid+1;
+			else hi = mid;
+			}
+		}
+	for(sp = &seg[lo]; sp<&seg[rm->n_segs]; sp++) {
+		if(rm->ordered && sp->number>n) break;
+		if(sp->name>=0) {
+			if(0==strcmp(RESMAP_NAMES(rm)+sp->name, name)) return sp->index;
+			}
+		else if(is_number) {
+			end = sp+1<&seg[rm->n_segs] ? sp[1].index : seqp->len;
+			if(n>=sp->number && n-sp->number<end-sp->index)
+				return sp->index+n-sp->number;
+			}
+		}
+	return -1;
+}
+
+ static void
+add_resnumber(i, name, number)
+int i; /* index of residue */
+char *name; /* its name, or NULL if it is just "number" */
+int number;
+{
+	/* add residue i to the table being built, starting a new segment
+	 * unless it simply continues the run in the last one.
+	 */
+	struct resseg *sp = bld_n_segs>0 ? &bld_seg[bld_n_segs-1] : NULL;
+	int len;
+
+	if(name==NULL && sp!=NULL && sp->name<0 && sp->number+(i-sp->index)==number)
+		return;
+	if(bld_n_segs==bld_max_segs) {
+		bld_max_segs = bld_max_segs ? 2*bld_max_segs : 64;
+		bld_seg = (struct resseg *) realloc(bld_seg,
+		  bld_max_segs*sizeof(struct resseg));
+		}
+	sp = &bld_seg[bld_n_segs++];
+	sp->index = i;
+	sp->number = number;
+	sp->name = -1;
+	if(name!=NULL) {
+		len = strlen(name);
+		if(len>RESNAMEMAX) len = RESNAMEMAX;
+		if(bld_names_size+len+1>bld_max_names) {
+			bld_max_names = 2*bld_max_names+len+1+256;
+			bld_names = realloc(bld_names, bld_max_names);
+			}
+		sp->name = bld_names_size;
+		memcpy(bld_names+bld_names_size, name, len);
+		bld_names[bld_names_size+len] = '\0';
+		bld_names_size += len+1;
+		}
+}
+
+ static struct resmap *
+make_resmap(len)
+int len; /* of the sequence */
+{
+	/* pack the table built for a sequence of "len" residues into one
+	 * malloc'ed block and empty the builder.
+	 */
+	struct resmap *rm;
+	struct resseg *seg;
+	int *block;
+	int size, n_blocks, b, k, ordered, end, last;
+
+	n_blocks = (len+RESMAP_BLOCK-1)/RESMAP_BLOCK;
+	size = sizeof(struct resmap) + bld_n_segs*sizeof(struct resseg) +
+	  n_blocks*sizeof(int) + bld_names_size;
+	size = (size+7) & ~7;
+	rm = (struct resmap *) calloc(1, size);
+	rm->size = size;
+	rm->n_segs = bld_n_segs;
+	rm->n_blocks = n_blocks;
+	seg = RESMAP_SEG(rm);
+	memcpy(seg, bld_seg, bld_n_segs*sizeof(struct resseg));
+	block = RESMAP_BLOCKS(rm);
+	for(b = 0, k = -1; b<n_blocks; b++) {
+		while(k+1<bld_n_segs && seg[k+1].index<=b*RESMAP_BLOCK) k++;
+		block[b] = k;
+		}
+	memcpy(RESMAP_NAMES(rm), bld_names, bld_names_size);
+
+	/* ordered if every segment begins at or after the end of the last */
+	ordered = 1;
+	for(k = 0; k<bld_n_segs && ordered; k++) {
+		if(seg[k].name>=0 &&
+		  1!=sscanf(RESMAP_NAMES(rm)+seg[k].name, "%d", &seg[k].number))
+			ordered = 0;
+		if(k>0 && seg[k].number<last) ordered = 0;
+		end = k+1<bld_n_segs ? seg[k+1].index : len;
+		last = seg[k].name>=0 ? seg[k].number :
+		  seg[k].number+(end-1-seg[k].index);
+		}
+	rm->ordered = ordered;
+
+	bld_n_segs = bld_names_size = 0;
+	return rm;
+}
+
+ int
+fget_seq( seqp, count, seqfile)
+struct seq * seqp;
+int count;
+FILE * seqfile;
+{
+	/* read up to "count" sequences from file. Return number read.
+	 * Note: this malloc's the sequence strings.
+	 */
+int k=0; /* count of ones read */
+register int /* char */ c;
+register int i;
+extern char * pgmname;
+int non_standard; /* flag for sequence that contains "weird" residue numbers. */
+int resnum; /* number of the last residue read */
+char name[RESNAMEMAX+1];
+int j;
+#include <ctype.h>
+
+
+while(count--) {
+	if(4!=fscanf(seqfile, 
+	  "%8s %1s %s %d", 
+	  seqp->name, seqp->chain, seqp->origin, &seqp->len) 
+	  ) return k;
+	(void) struptolow(seqp->name); /* force to lower case */
+
+	/* set "origin_n" if origin is purely numeric */
+	seqp->origin_is_numeric = is_numeric(seqp->origin);
+	if(seqp->origin_is_numeric) sscanf(seqp->origin, "%d", &seqp->origin_n);
+	else seqp->origin_n = 0; /* as in a fresh static table; get_resnumber uses it */
+		
+	seqp->sequence = (char *) malloc(1+seqp->len); /* needs better checking... */
+	seqp->resmap=NULL;
+	seqp->same=NULL;
+	seqp->copy=0;
+	non_standard=0;
+	bld_n_segs=bld_names_size=0;
+	resnum=seqp->origin_n;
+	i=0;
+	while( i<seqp->len) {
+		c = getc(seqfile);
+		if(c==EOF) {
+			free(seqp->sequence); /* incomplete */
+			seqp->len = 0;
+			return k;
+			}
+		if( isspace(c) ) continue;
+		if ( c == '#' ) {
+			/* bypass comments */
+			while ( '\n' != (c= getc(seqfile)))  if(c==EOF) return k;
+			}
+		if(c=='(') {
+			for(j=0;(c=getc(seqfile))!=')' && c!=EOF;j++)
+				if(j<RESNAMEMAX) name[j]=c;
+			name[j<RESNAMEMAX ? j : RESNAMEMAX]='\0';
+			sscanf(name,"%d",&resnum);
+			/* check to see if we're really beginning a standard sequence from
+			 * the specified origin (MP experiment):
+			 */
+			if(i==0 && seqp->origin_is_numeric && resnum == seqp->origin_n)
+				; /* if so, stay "standard" to save space & speed */
+			else {
+				non_standard=1;
+				if(canonical_number(name, &j)) add_resnumber(i, (char *)NULL, j);
+				else add_resnumber(i, name, resnum);
+				}
+			while(isspace(seqp->sequence[i]=getc(seqfile))); /* MP: why this asgnmt? */
+			++i;
+		  	}
+		else if(non_standard) {
+			/* ordinary number but not equal to index in array ... */
+			add_resnumber(i, (char *)NULL, ++resnum);
+			seqp->sequence[i++] = c;
+			}
+		else seqp->sequence[i++] = c;
+		}
+	seqp->sequence[i] = '\0';
+	if(non_standard) seqp->resmap = make_resmap(seqp->len);
+	k++;
+	seqp++;
+	}
+return k;
+}
+
+ void
+free_seq(seqp)
+struct seq * seqp;
+{
+	/* release what fget_seq malloc'ed for one sequence (a copy's
+	 * residues are those of the sequence it copies)
+	 */
+	free(seqp->resmap);
+	seqp->resmap=NULL;
+	if(!seqp->copy) free(seqp->sequence);
+	seqp->sequence=NULL;
+}
+
+ char *
+struptolow(str)
+char * str;
+{
+#include <ctype.h>
+register char * s = str;
+	/* make upper case alphabetics into lower case */
+	for(;*s;s++) if(isascii(*s) && isupper(*s) ) *s = tolower(*s);
+	return str;
+	}
+
+ int
+is_numeric(s)
+char * s;
+{
+#include <ctype.h>
+
+	for(;*s;s++) if(!( isascii(*s) && isdigit(*s) ) ) return 0;
+	return 1;
+	}
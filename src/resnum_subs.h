@@ -1,5 +1,7 @@
 char * get_resnumber();
+int resnum_index();
 int fget_seq();
+void free_seq();
 char * struptolow();
 
 static char resnum_subs_h_rcsid[] = 
@@ -14,9 +16,54 @@ struct seq {
 		and if so, what that origin is, normally 1 . */
         int  len; /* number of residues */
         char *sequence; /* array of 1-character residue types */
-        char **resnumber; /* Residue number/name - char for non-integer name, e.g. 106B,
-			   * or any residue whose number/name is not merely its 1-origin
-			   * index in the array, which is indicated by NULL pointer.
+	struct resmap *resmap; /* Residue numbers/names, for chains in which any
+			   * residue's number/name is not merely origin plus its
+			   * index in the array; NULL otherwise.  See below.
 			   */
+	struct seq *same; /* next sequence of the database with the very same
+			   * residues, or NULL (see seqfile_subs.c) */
+	int copy;	/* true if an earlier one has them: it is searched
+			   * instead, and its matches stand for this one's */
         };
 
+
+/* A residue-numbering table is one block of memory (malloc'ed by
+ * fget_seq(), or straight out of a mapped image) holding "segments" in
+ * order of index.  A segment is either a run of consecutively numbered
+ * residues, starting with "number" at "index" and lasting until the next
+ * segment, or a single residue with a name that is not just a number
+ * (an insertion code like 106B, leading zeroes, ...), kept as a string.
+ * Residues before the first segment are numbered from the origin as in
+ * a chain without a table.  So the 1000 numbers of a chain with one gap
+ * take two segments instead of 1000 malloc'ed strings.
+ *
+ * block[b] is the last segment beginning at or before index
+ * b*RESMAP_BLOCK (-1 if none), so finding a residue's segment never looks
+ * at more than RESMAP_BLOCK+1 of them.  If "ordered" is set, the numbers
+ * never go down along the chain and resnum_index() finds a name by
+ * binary search; otherwise it looks through every segment.
+ */
+#define RESMAP_BLOCK 16
+#define RESNAMEMAX 8	/* longest residue name kept, not counting '\0' */
+
+struct resseg {
+	int index;	/* of first residue in segment */
+	int number;	/* its number; for a name, the number it begins with */
+	int name;	/* offset of the name in names[], or -1 for a run */
+	};
+
+struct resmap {
+	int size;	/* bytes in the whole table, a multiple of 8 */
+	int n_segs;
+	int n_blocks;
+	int ordered;
+	/* followed by:
+	 *	struct resseg seg[n_segs];
+	 *	int block[n_blocks];
+	 *	char names[];	'\0'-terminated
+	 */
+	};
+
+#define RESMAP_SEG(rm) ((struct resseg *) ((rm) + 1))
+#define RESMAP_BLOCKS(rm) ((int *) (RESMAP_SEG(rm) + (rm)->n_segs))
+#define RESMAP_NAMES(rm) ((char *) (RESMAP_BLOCKS(rm) + (rm)->n_blocks))
@@ -0,0 +1,325 @@
+/* score_subs.c:
+ *  find the windows of a sequence that score at least a threshold
+ *  against a query peptide; see score_subs.h.
+ *
+ * For a query of n residues, the score of the window starting at i is
+ * the sum over j of score(query[j], s[i+j]).  The matrix is turned into
+ * a profile, prof[j][c], so each term is one lookup.
+ *
+ * On x86 processors with SSE4.1 or AVX2, 16 or 32 windows are scored at
+ * once, as bitpar_subs.c tests starting residues: for each position j
+ * of the query, the residues s[i+j..] are looked up in two 16-entry
+ * tables of 8-bit scores (residues 0x40-0x4F and 0x50-0x5F, lower case
+ * folded onto upper), and the scores are widened to 16 bits and added
+ * to the sums of their windows.  A block holding any residue outside
+ * 0x40-0x7F is scored by the word kernel instead.  Setting
+ * SEQUERY_NOSIMD in the environment, or compiling with -DNO_SIMD, also
+ * forces the word kernel.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#include "score_subs.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && !defined(NO_SIMD)
+#define X86_SIMD
+#include <immintrin.h>
+#endif
+
+#define LINELEN 4096
+#define MAXSCORE 127	/* scores must fit the vector kernels' 8 bits */
+
+extern char * pgmname;
+
+ static int
+fold(int c)
+{
+	/* the residue c scores as: lower case as upper case */
+	return c >= 0x60 && c <= 0x7F ? c & 0x5F : c;
+}
+
+ struct scoremat *
+score_load(char *filename)
+{
+	/* read the substitution matrix in "filename".  Returns NULL after
+	 * printing a message if it can't be read.  A residue missing from
+	 * the matrix scores as "*" if that is there, and otherwise as the
+	 * lowest score in the matrix, against anything.
+	 */
+	struct scoremat *mat;
+	char line[LINELEN], *s, *e;
+	unsigned char col[256];
+	char *set;
+	int ncol = 0, row, a, b, k, linenumber = 0, lowest = MAXSCORE;
+	long v;
+	FILE *f;
+
+	if((f = fopen(filename, "r")) == NULL) {
+		perror(filename);
+		return NULL;
+		}
+	mat = (struct scoremat *) calloc(1, sizeof(struct scoremat));
+	mat->filename = strdup(filename);
+	set = calloc(256, 256);
+
+	while(fgets(line, sizeof(line), f) != NULL) {
+		linenumber++;
+		for(s = line; isspace((unsigned char) *s); s++) ;
+		if(*s == '\0' || *s == '#') continue; /* skip empties, comments */
+		if(ncol == 0) {
+			/* the residues of the columns */
+			for(; *s != '\0'; s++)
+				if(!isspace((unsigned char) *s) && ncol < 256)
+					col[ncol++] = fold((unsigned char) *s);
+			continue;
+			}
+		row = fold((unsigned char) *s++);
+		for(k = 0; k < ncol; k++) {
+			v = strtol(s, &e, 10);
+			if(e == s || v < -MAXSCORE || v > MAXSCORE) break;
+			s = e;
+			mat->score[row][col[k]] = v;
+			set[row*256 + col[k]] = 1;
+			if(v < lowest) lowest = v;
+			}
+		for(; isspace((unsigned char) *s); s++) ;
+		if(k < ncol || *s != '\0') {
+			fprintf(stderr, "%s: format problem in file %s, line %d :%s",
+			  pgmname, filename, linenumber, line);
+			if(v < -MAXSCORE || v > MAXSCORE)
+				fprintf(stderr, " scores must be between %d and %d.\n",
+				  -MAXSCORE, MAXSCORE);
+			fclose(f);
+			free(set);
+			free(mat);
+			return NULL;
+			}
+		mat->known[row] = 1;
+		}
+	fclose(f);
+	if(ncol == 0) {
+		fprintf(stderr, "%s: no substitution matrix in %s\n", pgmname, filename);
+		free(set);
+		free(mat);
+		return NULL;
+		}
+
+	/* now every pair of characters, in either case */
+	for(a = 0; a < 256; a++) for(b = 0; b < 256; b++) {
+		row = mat->known[fold(a)] ? fold(a) : '*';
+		k = mat->known[fold(b)] ? fold(b) : '*';
+		if(!mat->known[row] || !set[row*256 + k]) k = -1;
+		mat->score[a][b] = k < 0 ? lowest : mat->score[row][k];
+		}
+	for(a = 0; a < 256; a++) if(a != fold(a)) mat->known[a] = mat->known[fold(a)];
+	free(set);
+
+	mat->hash = 14695981039346656037ULL;
+	for(a = 0; a < 256; a++) for(b = 0; b < 256; b++)
+		mat->hash = (mat->hash ^ (unsigned) mat->score[a][b]) * 1099511628211ULL;
+	return mat;
+}
+
+ int
+score_self(char *peptide, struct scoremat *mat)
+{
+	/* the score of "peptide" against itself, the best of most matrices */
+	unsigned char *s;
+	int sum = 0;
+
+	for(s = (unsigned char *) peptide; *s != '\0'; s++)
+		if(!isspace(*s)) sum += mat->score[*s][*s];
+	return sum;
+}
+
+ char *
+score_build(char *peptide, struct scoremat *mat, int threshold, struct scorer **scp)
+{
+	/* set *scp to a new scorer reporting the windows that score at least
+	 * "threshold" against "peptide".  Returns NULL if all is well,
+	 * otherwise an error message (and *scp is NULL).
+	 */
+	static char msg[80];
+	struct scorer *sc;
+	unsigned char *s;
+	int j, c;
+
+	*scp = NULL;
+	sc = (struct scorer *) calloc(1, sizeof(struct scorer));
+	for(s = (unsigned char *) peptide; *s != '\0'; s++) {
+		if(isspace(*s)) continue;
+		if(!mat->known[*s]) {
+			sprintf(msg, "%c is not in substitution matrix %.40s", *s,
+			  mat->filename);
+			free(sc);
+			return msg;
+			}
+		if(sc->len == SC_MAXLEN) {
+			sprintf(msg, "query longer than %d residues", SC_MAXLEN);
+			free(sc);
+			return msg;
+			}
+		j = sc->len++;
+		for(c = 0; c < 256; c++) sc->prof[j][c] = mat->score[*s][c];
+		for(c = 0; c < 16; c++) {
+			sc->lo[j][c] = sc->prof[j][0x40+c];
+			sc->hi[j][c] = sc->prof[j][0x50+c];
+			}
+		}
+	if(sc->len == 0) {
+		free(sc);
+		return "empty query";
+		}
+
+	/* no window can score beyond these, and 16 bits hold them */
+	if(threshold > SC_MAXLEN * MAXSCORE + 1) threshold = SC_MAXLEN * MAXSCORE + 1;
+	if(threshold < -SC_MAXLEN * MAXSCORE) threshold = -SC_MAXLEN * MAXSCORE;
+	sc->threshold = threshold;
+
+	sc->kernel = SC_SCALAR;
+#ifdef X86_SIMD
+	if(getenv("SEQUERY_NOSIMD") == NULL) {
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2")) sc->kernel = SC_AVX2;
+		else if(__builtin_cpu_supports("sse4.1")) sc->kernel = SC_SSE41;
+		}
+#endif
+	*scp = sc;
+	return NULL;
+}
+
+ static int
+window(struct scorer *sc, unsigned char *s)
+{
+	/* the score of the window at s */
+	int j, sum = 0;
+
+	for(j = 0; j < sc->len; j++) sum += sc->prof[j][s[j]];
+	return sum;
+}
+
+#ifdef X86_SIMD
+/* Vector kernels: return the leftmost window scoring enough among whole
+ * blocks of windows, or -1-i where i is the first window left for the
+ * word kernel.  They only load residues in s[0..len).
+ */
+
+__attribute__((target("avx2")))
+ static int
+scan_avx2(struct scorer *sc, unsigned char *s, int len)
+{
+	const __m256i k40 = _mm256_set1_epi8(0x40);
+	const __m256i kC0 = _mm256_set1_epi8((char) 0xC0);
+	const __m256i thr = _mm256_set1_epi16(sc->threshold - 1);
+	__m256i acc0, acc1, ok, t, lo, hi, m;
+	unsigned bits;
+	int i, j, p, n = sc->len;
+
+	for(i = 0; i + 32 + n - 1 <= len; i += 32) {
+		acc0 = acc1 = _mm256_setzero_si256();
+		ok = _mm256_set1_epi8(-1);
+		for(j = 0; j < n; j++) {
+			t = _mm256_loadu_si256((const __m256i *) (s + i + j));
+			ok = _mm256_and_si256(ok,
+			  _mm256_cmpeq_epi8(_mm256_and_si256(t, kC0), k40));
+			lo = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+			  _mm_loadu_si128((const __m128i *) sc->lo[j])), t);
+			hi = _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(
+			  _mm_loadu_si128((const __m128i *) sc->hi[j])), t);
+			/* bit 4 of the residue picks the table */
+			m = _mm256_blendv_epi8(lo, hi, _mm256_slli_epi16(t, 3));
+			acc0 = _mm256_add_epi16(acc0,
+			  _mm256_cvtepi8_epi16(_mm256_castsi256_si128(m)));
+			acc1 = _mm256_add_epi16(acc1,
+			  _mm256_cvtepi8_epi16(_mm256_extracti128_si256(m, 1)));
+			}
+		if((unsigned) _mm256_movemask_epi8(ok) != 0xFFFFFFFFu) {
+			for(p = i; p < i + 32; p++)
+				if(window(sc, s + p) >= sc->threshold) return p;
+			continue;
+			}
+		/* two bits for each 16-bit sum */
+		if((bits = (unsigned) _mm256_movemask_epi8(
+		  _mm256_cmpgt_epi16(acc0, thr))) != 0)
+			return i + __builtin_ctz(bits) / 2;
+		if((bits = (unsigned) _mm256_movemask_epi8(
+		  _mm256_cmpgt_epi16(acc1, thr))) != 0)
+			return i + 16 + __builtin_ctz(bits) / 2;
+		}
+	return -1 - i;
+}
+
+__attribute__((target("sse4.1")))
+ static int
+scan_sse41(struct scorer *sc, unsigned char *s, int len)
+{
+	const __m128i k40 = _mm_set1_epi8(0x40);
+	const __m128i kC0 = _mm_set1_epi8((char) 0xC0);
+	const __m128i thr = _mm_set1_epi16(sc->threshold - 1);
+	__m128i acc0, acc1, ok, t, lo, hi, m;
+	unsigned bits;
+	int i, j, p, n = sc->len;
+
+	for(i = 0; i + 16 + n - 1 <= len; i += 16) {
+		acc0 = acc1 = _mm_setzero_si128();
+		ok = _mm_set1_epi8(-1);
+		for(j = 0; j < n; j++) {
+			t = _mm_loadu_si128((const __m128i *) (s + i + j));
+			ok = _mm_and_si128(ok, _mm_cmpeq_epi8(_mm_and_si128(t, kC0), k40));
+			lo = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) sc->lo[j]), t);
+			hi = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) sc->hi[j]), t);
+			m = _mm_blendv_epi8(lo, hi, _mm_slli_epi16(t, 3));
+			acc0 = _mm_add_epi16(acc0, _mm_cvtepi8_epi16(m));
+			acc1 = _mm_add_epi16(acc1, _mm_cvtepi8_epi16(_mm_srli_si128(m, 8)));
+			}
+		if((unsigned) _mm_movemask_epi8(ok) != 0xFFFFu) {
+			for(p = i; p < i + 16; p++)
+				if(window(sc, s + p) >= sc->threshold) return p;
+			continue;
+			}
+		if((bits = (unsigned) _mm_movemask_epi8(_mm_cmpgt_epi16(acc0, thr))) != 0)
+			return i + __builtin_ctz(bits) / 2;
+		if((bits = (unsigned) _mm_movemask_epi8(_mm_cmpgt_epi16(acc1, thr))) != 0)
+			return i + 8 + __builtin_ctz(bits) / 2;
+		}
+	return -1 - i;
+}
+#endif
+
+ int
+score_match(struct scorer *sc, char *string, int len, int *p_bgn, int *p_len)
+{
+	/* look for a window of string[0..len) scoring at least the threshold;
+	 * if found return 1 and set *p_bgn and *p_len to the leftmost, as
+	 * dfa_match() does a match.
+	 */
+	unsigned char *s = (unsigned char *) string;
+	int p = 0;
+
+#ifdef X86_SIMD
+	if(sc->kernel != SC_SCALAR) {
+		p = sc->kernel == SC_AVX2 ? scan_avx2(sc, s, len) : scan_sse41(sc, s, len);
+		if(p >= 0) {
+			*p_bgn = p;
+			*p_len = sc->len;
+			return 1;
+			}
+		p = -1 - p;
+		}
+#endif
+	for(; p + sc->len <= len; p++)
+		if(window(sc, s + p) >= sc->threshold) {
+			*p_bgn = p;
+			*p_len = sc->len;
+			return 1;
+			}
+	return 0;
+}
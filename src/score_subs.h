@@ -0,0 +1,44 @@
+/* score_subs.h:
+ *  scoring every window of a sequence against a query peptide with a
+ *  substitution matrix (sequery -M), the numerical threshold the yes/no
+ *  classes of a definition file only approximate.
+ *
+ * The matrix is read in the form BLOSUM and PAM matrices are usually
+ * given in: a line naming the residues of the columns, then a line for
+ * each residue with its name and its scores against each column.
+ * Requires <stdint.h>.
+ */
+
+static char score_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define SC_MAXLEN 128	/* longest query: its scores must fit 16 bits */
+
+struct scoremat {
+	char *filename;
+	int known[256];		/* residue c has a row and column */
+	int score[256][256];	/* of residues a, b in either case */
+	uint64_t hash;		/* of the scores */
+	};
+
+struct scorer {
+	int len;		/* residues in the query, and in a window */
+	int threshold;		/* lowest score of a window reported */
+	int kernel;		/* SC_SCALAR, SC_SSE41 or SC_AVX2 */
+	short prof[SC_MAXLEN][256];	/* score of residue c at position j */
+	/* for the vector kernels, residues 0x40-0x7F only, which score as
+	 * c & 0x5F does:
+	 */
+	signed char lo[SC_MAXLEN][16];	/* score of 0x40+k at position j */
+	signed char hi[SC_MAXLEN][16];	/* score of 0x50+k at position j */
+	};
+
+#define SC_SCALAR 0
+#define SC_SSE41 1
+#define SC_AVX2 2
+
+struct scoremat * score_load(char *filename);
+char * score_build(char *peptide, struct scoremat *mat, int threshold,
+  struct scorer **scp);
+int score_self(char *peptide, struct scoremat *mat);
+int score_match(struct scorer *sc, char *string, int len, int *p_bgn, int *p_len);
@@ -0,0 +1,282 @@
+/* seqdb_subs.c:
+ *  write and map precompiled binary sequence databases ("images").
+ *
+ * sequery-mkdb reads an ASCII sequence file once with fget_seq() and
+ * writes it out with seqdb_write().  sequery and matchextractpdb then
+ * call seqdb_map(), which maps the image read-only and points an array
+ * of "struct seq" straight into it: the residues and residue names are
+ * never parsed, copied, or malloc'ed one by one.  Identical chains
+ * (the subunits of a homo-oligomer, the many structures of one protein)
+ * share one copy of their residues in the image.
+ * See seqdb_subs.h for the layout of the file.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "resnum_subs.h"
+#include "seqdb_subs.h"
+
+extern char * pgmname;
+
+/* the images mapped by seqdb_map(), so that seqdb_unmap() can undo it */
+struct mapping {
+	struct seq *seq;
+	char *base;
+	size_t size;
+	};
+static struct mapping *mapping;
+static int n_mappings;
+
+ int
+seqdb_is_image(char *filename)
+{
+	/* true if "filename" begins with the image magic number */
+	char magic[sizeof(SEQDB_MAGIC)-1];
+	FILE *f;
+	int is_image;
+
+	if((f = fopen(filename, "r")) == NULL) return 0;
+	is_image = fread(magic, sizeof(magic), 1, f) == 1 &&
+	  0 == memcmp(magic, SEQDB_MAGIC, sizeof(magic));
+	fclose(f);
+	return is_image;
+}
+
+ struct seq *
+seqdb_map(char *filename, int *n_seqs)
+{
+	/* map image "filename" and return a malloc'ed array of n_seqs sequences
+	 * pointing into it.  Returns NULL with *n_seqs 0 if the file is not an
+	 * image at all (caller should read it as ASCII), or NULL with *n_seqs -1
+	 * (after printing a message) if it is an image we cannot use.
+	 * The mapping stays in place until seqdb_unmap() or the program exits.
+	 */
+	int fd;
+	struct stat st;
+	struct seqdb_header hdr;
+	struct seqdb_entry *ep;
+	struct seq *seq, *seqp;
+	struct resmap *rm;
+	char *base;
+	int i;
+
+	*n_seqs = 0;
+	if((fd = open(filename, O_RDONLY)) < 0) return NULL;
+	if(read(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+	  0 != memcmp(hdr.magic, SEQDB_MAGIC, sizeof(hdr.magic))) {
+		close(fd);
+		return NULL;
+		}
+	*n_seqs = -1;
+	if(hdr.byteorder != SEQDB_BYTEORDER) {
+		fprintf(stderr, "%s: %s was written on a machine of different byte order, rebuild it with sequery-mkdb\n",
+		  pgmname, filename);
+		close(fd);
+		return NULL;
+		}
+	if(hdr.version != SEQDB_VERSION) {
+		fprintf(stderr, "%s: %s is image version %d, this program reads version %d; rebuild it with sequery-mkdb\n",
+		  pgmname, filename, (int) hdr.version, SEQDB_VERSION);
+		close(fd);
+		return NULL;
+		}
+	if(fstat(fd, &st) < 0 || hdr.n_seqs < 0 || hdr.entry_off < 0 ||
+	  hdr.residue_off < 0 || hdr.residue_size < 0 ||
+	  hdr.resmap_off < 0 || hdr.resmap_size < 0 ||
+	  hdr.entry_off + (int64_t) hdr.n_seqs * sizeof(struct seqdb_entry) > st.st_size ||
+	  hdr.residue_off + hdr.residue_size > st.st_size ||
+	  hdr.resmap_off + hdr.resmap_size > st.st_size) {
+		fprintf(stderr, "%s: %s: truncated or damaged sequence image\n",
+		  pgmname, filename);
+		close(fd);
+		return NULL;
+		}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED) {
+		perror(filename);
+		return NULL;
+		}
+
+	seq = (struct seq *) calloc(hdr.n_seqs ? hdr.n_seqs : 1, sizeof(struct seq));
+	if(seq == NULL) {
+		fprintf(stderr, "%s: out of memory mapping %s\n", pgmname, filename);
+		return NULL;
+		}
+	ep = (struct seqdb_entry *) (base + hdr.entry_off);
+	for(i = 0, seqp = seq; i < hdr.n_seqs; i++, ep++, seqp++) {
+		/* nothing of an entry may lie outside its section */
+		if(ep->len < 0 || ep->seq_off < 0 ||
+		  ep->seq_off >= hdr.residue_size ||
+		  ep->len >= hdr.residue_size - ep->seq_off ||
+		  base[hdr.residue_off + ep->seq_off + ep->len] != '\0')
+			break;
+		if(ep->resmap_off >= 0) {
+			if(ep->resmap_off % 8 != 0 || ep->resmap_off >
+			  hdr.resmap_size - (int64_t) sizeof(struct resmap))
+				break;
+			rm = (struct resmap *) (base + hdr.resmap_off + ep->resmap_off);
+			if(rm->size < (int) sizeof(struct resmap) || rm->n_segs < 0 ||
+			  rm->n_blocks < 0 || rm->size > hdr.resmap_size - ep->resmap_off ||
+			  sizeof(struct resmap) + rm->n_segs * sizeof(struct resseg) +
+			  rm->n_blocks * sizeof(int) > rm->size)
+				break;
+			}
+		memcpy(seqp->name, ep->name, sizeof(seqp->name));
+		memcpy(seqp->chain, ep->chain, sizeof(seqp->chain));
+		memcpy(seqp->origin, ep->origin, sizeof(seqp->origin));
+		seqp->origin_is_numeric = ep->origin_is_numeric;
+		seqp->origin_n = ep->origin_n;
+		seqp->len = ep->len;
+		seqp->sequence = base + hdr.residue_off + ep->seq_off;
+		seqp->resmap = ep->resmap_off < 0 ? NULL :
+		  (struct resmap *) (base + hdr.resmap_off + ep->resmap_off);
+		}
+	if(i < hdr.n_seqs) {
+		fprintf(stderr, "%s: %s: truncated or damaged sequence image\n",
+		  pgmname, filename);
+		munmap(base, st.st_size);
+		free(seq);
+		return NULL;
+		}
+	*n_seqs = hdr.n_seqs;
+
+	mapping = (struct mapping *) realloc(mapping,
+	  (n_mappings+1) * sizeof(struct mapping));
+	mapping[n_mappings].seq = seq;
+	mapping[n_mappings].base = base;
+	mapping[n_mappings++].size = st.st_size;
+	return seq;
+}
+
+ int
+seqdb_unmap(struct seq *seq)
+{
+	/* if seq was returned by seqdb_map(), unmap its image and free it
+	 * and return 1, otherwise return 0.
+	 */
+	int i;
+
+	for(i = 0; i < n_mappings; i++)
+		if(mapping[i].seq == seq) {
+			munmap(mapping[i].base, mapping[i].size);
+			free(seq);
+			mapping[i] = mapping[--n_mappings];
+			return 1;
+			}
+	return 0;
+}
+
+ int *
+seqdb_group(struct seq *seq, int n_seqs)
+{
+	/* return a malloc'ed array giving, for each sequence, the index of
+	 * the first with the very same residues (its own if none before it)
+	 */
+	int *first, *table, size, i, j;
+	uint64_t h;
+	char *s;
+
+	first = (int *) malloc((n_seqs ? n_seqs : 1) * sizeof(int));
+	for(size = 64; size < 2*n_seqs; size *= 2) ;
+	table = (int *) malloc(size * sizeof(int));
+	for(j = 0; j < size; j++) table[j] = -1;
+
+	for(i = 0; i < n_seqs; i++) {
+		h = 14695981039346656037ULL;
+		for(s = seq[i].sequence; *s != '\0'; s++)
+			h = (h ^ (unsigned char) *s) * 1099511628211ULL;
+		for(j = h & (size-1); table[j] >= 0; j = (j+1) & (size-1))
+			if(seq[table[j]].len == seq[i].len &&
+			  (seq[table[j]].sequence == seq[i].sequence ||
+			  strcmp(seq[table[j]].sequence, seq[i].sequence) == 0))
+				break;
+		if(table[j] < 0) table[j] = i;
+		first[i] = table[j];
+		}
+	free(table);
+	return first;
+}
+
+ int
+seqdb_write(FILE *out, struct seq *seq, int n_seqs)
+{
+	/* write n_seqs sequences to "out" as an image, the residues of
+	 * identical ones only once.
+	 * Returns 0 if all went well, -1 on a write error.
+	 */
+	struct seqdb_header hdr;
+	struct seqdb_entry ent;
+	struct seq *seqp;
+	int64_t residue_size = 0, resmap_size = 0;
+	int64_t *seq_off;
+	int *first, i;
+	static char pad[8];
+
+	first = seqdb_group(seq, n_seqs);
+	seq_off = (int64_t *) malloc((n_seqs ? n_seqs : 1) * sizeof(int64_t));
+	for(i = 0, seqp = seq; seqp < &seq[n_seqs]; i++, seqp++) {
+		if(first[i] == i) {
+			seq_off[i] = residue_size;
+			residue_size += strlen(seqp->sequence) + 1;
+			}
+		else seq_off[i] = seq_off[first[i]];
+		if(seqp->resmap != NULL)
+			resmap_size += seqp->resmap->size;
+		}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SEQDB_MAGIC, sizeof(hdr.magic));
+	hdr.version = SEQDB_VERSION;
+	hdr.byteorder = SEQDB_BYTEORDER;
+	hdr.n_seqs = n_seqs;
+	hdr.entry_off = sizeof(hdr);
+	hdr.residue_off = hdr.entry_off + (int64_t) n_seqs * sizeof(struct seqdb_entry);
+	hdr.residue_size = residue_size;
+	hdr.resmap_off = (hdr.residue_off + residue_size + 7) & ~(int64_t) 7;
+	hdr.resmap_size = resmap_size;
+	fwrite(&hdr, sizeof(hdr), 1, out);
+
+	resmap_size = 0;
+	for(seqp = seq; seqp < &seq[n_seqs]; seqp++) {
+		memset(&ent, 0, sizeof(ent));
+		memcpy(ent.name, seqp->name, sizeof(ent.name));
+		memcpy(ent.chain, seqp->chain, sizeof(ent.chain));
+		memcpy(ent.origin, seqp->origin, sizeof(ent.origin));
+		ent.origin_is_numeric = seqp->origin_is_numeric;
+		ent.origin_n = seqp->origin_n;
+		ent.len = seqp->len;
+		ent.seq_off = seq_off[seqp - seq];
+		if(seqp->resmap != NULL) {
+			ent.resmap_off = resmap_size;
+			resmap_size += seqp->resmap->size;
+			}
+		else ent.resmap_off = -1;
+		fwrite(&ent, sizeof(ent), 1, out);
+		}
+
+	for(i = 0, seqp = seq; seqp < &seq[n_seqs]; i++, seqp++)
+		if(first[i] == i)
+			fwrite(seqp->sequence, strlen(seqp->sequence) + 1, 1, out);
+	free(first);
+	free(seq_off);
+
+	fwrite(pad, hdr.resmap_off - (hdr.residue_off + hdr.residue_size), 1, out);
+	for(seqp = seq; seqp < &seq[n_seqs]; seqp++)
+		if(seqp->resmap != NULL)
+			fwrite(seqp->resmap, seqp->resmap->size, 1, out);
+
+	return (fflush(out) == 0 && !ferror(out)) ? 0 : -1;
+}
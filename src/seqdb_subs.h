@@ -0,0 +1,54 @@
+/* seqdb_subs.h:
+ *  layout of the precompiled binary sequence database ("image") written
+ *  by sequery-mkdb and mapped read-only by sequery and matchextractpdb.
+ *
+ * An image is one file containing, in order:
+ *	struct seqdb_header
+ *	struct seqdb_entry [n_seqs]	name/chain/origin table
+ *	residue buffer			every distinct sequence, '\0'-terminated,
+ *					back to back; identical ones share one
+ *	residue-numbering tables	struct resmap (see resnum_subs.h) of each
+ *					chain whose residue numbers are not simply
+ *					origin+index, 8-byte aligned
+ * All offsets are in bytes from the start of the file, so the file can
+ * be mapped anywhere and used without any parsing or copying.
+ * Integers are stored in the byte order of the machine that wrote the
+ * image; "byteorder" lets a reader on another machine refuse it.
+ */
+
+static char seqdb_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#include <stdint.h>
+
+#define SEQDB_MAGIC "SQDB"
+#define SEQDB_VERSION 2
+#define SEQDB_BYTEORDER 0x01020304
+
+struct seqdb_header {
+	char magic[4];		/* SEQDB_MAGIC, not '\0'-terminated */
+	int32_t version;	/* SEQDB_VERSION */
+	int32_t byteorder;	/* SEQDB_BYTEORDER as written */
+	int32_t n_seqs;		/* number of entries */
+	int64_t entry_off;	/* struct seqdb_entry table */
+	int64_t residue_off;	/* residue buffer */
+	int64_t residue_size;
+	int64_t resmap_off;	/* residue-numbering tables */
+	int64_t resmap_size;
+	};
+
+struct seqdb_entry {
+	char name[12];
+	char chain[2];
+	char origin[6];
+	int32_t origin_is_numeric, origin_n;
+	int32_t len;
+	int64_t seq_off;	/* of sequence, relative to residue_off */
+	int64_t resmap_off;	/* of its table, relative to resmap_off, or -1 */
+	};
+
+struct seq * seqdb_map(char *filename, int *n_seqs);
+int seqdb_unmap(struct seq *seq);
+int seqdb_write(FILE *out, struct seq *seq, int n_seqs);
+int * seqdb_group(struct seq *seq, int n_seqs);
+int seqdb_is_image(char *filename);
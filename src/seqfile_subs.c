@@ -0,0 +1,375 @@
+/* seqfile_subs.c:
+ *  open a sequence database in core or as a stream; see seqfile_subs.h.
+ *
+ * A database is kept in core when it is a sequery-mkdb image (which is
+ * only mapped, never read) or when its text is small enough for the
+ * memory budget.  Otherwise it is streamed: the text is read with large
+ * sequential read(2)s into a buffer of a quarter of the budget, cut at
+ * the last complete record, and parsed with the ordinary fget_seq().
+ * While one chunk is being searched the kernel is asked to read ahead
+ * the next, so a search runs at about disk speed and the size of the
+ * database is limited only by the disk.
+ *
+ * The PDB holds many identical chains, so the sequences delivered are
+ * grouped by their residues: the first of each group is searched, and
+ * the others, linked to it, are marked as copies.  A text database
+ * keeps only one string for the group (an image already shares it, see
+ * seqdb_subs.c).  A streamed one is grouped a chunk at a time, which
+ * still catches the chains of an entry, next to one another.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "resnum_subs.h"
+#include "seqdb_subs.h"
+#include "seqfile_subs.h"
+#include "delta_subs.h"
+
+#define SEQ_BLOCK 1024 /* sequences read per fget_seq call */
+#define MINCHUNK (1L<<20) /* smallest streaming buffer, bytes */
+
+extern char * pgmname;
+
+ static int
+group(struct seq *seq, int n_seqs, int share)
+{
+	/* link the identical sequences of seq[0..n_seqs), and if "share"
+	 * free the copies' residues and point them at the first's (all of
+	 * them must then have been malloc'ed by fget_seq()).
+	 * Returns how many are not copies.
+	 */
+	int *first, *last, i, n_distinct = 0;
+
+	first = seqdb_group(seq, n_seqs);
+	last = (int *) malloc((n_seqs ? n_seqs : 1) * sizeof(int));
+	for(i = 0; i < n_seqs; i++) {
+		seq[i].same = NULL;
+		seq[i].copy = first[i] != i;
+		if(!seq[i].copy) {
+			last[i] = i;
+			n_distinct++;
+			continue;
+			}
+		seq[last[first[i]]].same = &seq[i];
+		last[first[i]] = i;
+		if(share && seq[i].sequence != seq[first[i]].sequence) {
+			free(seq[i].sequence);
+			seq[i].sequence = seq[first[i]].sequence;
+			}
+		}
+	free(first);
+	free(last);
+	return n_distinct;
+}
+
+ static int
+read_seqs(FILE *f, struct seq **seqp, int *n_alloc)
+{
+	/* read every sequence in "f" into (*seqp)[], growing it as needed.
+	 * Returns number read, or -1 if out of memory.
+	 */
+	int n_seqs = 0, n;
+	struct seq *new;
+
+	do {
+		if(n_seqs + SEQ_BLOCK > *n_alloc) {
+			new = (struct seq *) realloc(*seqp,
+			  (*n_alloc + 8*SEQ_BLOCK) * sizeof(struct seq));
+			if(new == NULL) return -1;
+			*seqp = new;
+			*n_alloc += 8*SEQ_BLOCK;
+			}
+		n = fget_seq(&(*seqp)[n_seqs], SEQ_BLOCK, f);
+		n_seqs += n;
+		} while(n == SEQ_BLOCK);
+	return n_seqs;
+}
+
+ struct seq *
+seqfile_load(char *filename, int *n_seqs)
+{
+	/* read (or map) the whole of database "filename" into core.
+	 * Unlike the old fixed-size table, there is no limit on the number
+	 * of sequences.  Returns NULL after printing a message on failure.
+	 */
+	struct seq *seq;
+	FILE *f;
+	int n_alloc = 0;
+
+	if((seq = seqdb_map(filename, n_seqs)) != NULL) return seq;
+	if(*n_seqs < 0) return NULL;
+
+	if((f = fopen(filename, "r")) == NULL) {
+		perror(filename);
+		return NULL;
+		}
+	seq = NULL;
+	*n_seqs = read_seqs(f, &seq, &n_alloc);
+	fclose(f);
+	if(*n_seqs < 0) {
+		fprintf(stderr, "%s: out of memory reading %s\n", pgmname, filename);
+		return NULL;
+		}
+	return seq;
+}
+
+ struct seq *
+seqfile_read(FILE *f, int *n_seqs)
+{
+	/* read every sequence of ASCII stream "f" into core, as
+	 * seqfile_load() does a file.  Returns NULL if out of memory.
+	 */
+	struct seq *seq = NULL;
+	int n_alloc = 0;
+
+	if((*n_seqs = read_seqs(f, &seq, &n_alloc)) < 0) return NULL;
+	if(seq == NULL) seq = (struct seq *) malloc(sizeof(struct seq));
+	return seq;
+}
+
+ struct seq *
+seqfile_load_all(char *filename, int *n_seqs)
+{
+	/* as seqfile_load(), with the delta segments of the file applied.
+	 * The sequences of the file and of the segments are kept for as
+	 * long as the program runs.
+	 */
+	struct seq *seq;
+	struct delta *d;
+	int n_segs;
+
+	if((seq = seqfile_load(filename, n_seqs)) == NULL) return NULL;
+	if((d = delta_open(filename, &n_segs)) == NULL)
+		return n_segs < 0 ? NULL : seq;
+	return delta_apply(d, seq, *n_seqs, n_seqs);
+}
+
+ struct seqfile *
+seqfile_open(char *filename, long budget)
+{
+	/* prepare to search database "filename" using about "budget" bytes
+	 * for sequences.  Returns NULL after printing a message on failure.
+	 */
+	struct seqfile *sf;
+	struct stat st;
+	int n_segs;
+
+	sf = (struct seqfile *) calloc(1, sizeof(struct seqfile));
+	if(sf == NULL) return NULL;
+	sf->filename = filename;
+	sf->fd = -1;
+
+	if(stat(filename, &st) < 0) {
+		perror(filename);
+		return NULL;
+		}
+	sf->delta = delta_open(filename, &n_segs);
+	if(n_segs < 0) return NULL;
+
+	/* text and parsed sequences together take about twice the file size */
+	if(seqdb_is_image(filename) || 2*(long)st.st_size <= budget) {
+		sf->in_core = 1;
+		sf->seq = seqfile_load(filename, &sf->n_seqs);
+		if(sf->seq == NULL) return NULL;
+		if(sf->delta != NULL) {
+			sf->file_seq = sf->seq;
+			sf->n_file_seqs = sf->n_seqs;
+			sf->seq = delta_apply(sf->delta, sf->file_seq, sf->n_file_seqs,
+			  &sf->n_seqs);
+			}
+		sf->n_alloc = sf->n_seqs;
+		/* the merged copies of a delta's sequences own no residues */
+		sf->n_distinct = group(sf->seq, sf->n_seqs,
+		  sf->delta == NULL && !seqdb_is_image(filename));
+		return sf;
+		}
+
+	sf->in_core = 0;
+	if((sf->fd = open(filename, O_RDONLY)) < 0) {
+		perror(filename);
+		return NULL;
+		}
+	sf->bufsize = budget/4;
+	if(sf->bufsize < MINCHUNK) sf->bufsize = MINCHUNK;
+	if((sf->buf = malloc(sf->bufsize)) == NULL) {
+		fprintf(stderr, "%s: can't allocate %ld byte buffer for %s\n",
+		  pgmname, sf->bufsize, filename);
+		return NULL;
+		}
+	(void) posix_fadvise(sf->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	if(sf->delta != NULL) {
+		sf->delta_seq = delta_apply(sf->delta, NULL, 0, &sf->n_delta_seqs);
+		(void) group(sf->delta_seq, sf->n_delta_seqs, 0);
+		}
+	seqfile_rewind(sf);
+	return sf;
+}
+
+ static void
+release_chunk(struct seqfile *sf)
+{
+	int i;
+	for(i = 0; i < sf->n_seqs; i++) free_seq(&sf->seq[i]);
+	sf->n_seqs = 0;
+}
+
+ void
+seqfile_rewind(struct seqfile *sf)
+{
+	/* start again from the first sequence */
+	sf->delivered = 0;
+	if(sf->in_core) return;
+	release_chunk(sf);
+	(void) lseek(sf->fd, 0, SEEK_SET);
+	sf->buflen = 0;
+	sf->offset = 0;
+	sf->eof = 0;
+	(void) posix_fadvise(sf->fd, 0, sf->bufsize, POSIX_FADV_WILLNEED);
+}
+
+ static long
+record_boundary(char *buf, long len)
+{
+	/* return offset of the last record start in buf[0..len), 0 if none.
+	 * Records begin at the start of a line with a non-blank character;
+	 * continuation lines of a sequence begin with blanks.
+	 */
+	long i;
+	for(i = len-1; i > 0; i--)
+		if(buf[i-1] == '\n' && !isspace((unsigned char) buf[i])) return i;
+	return 0;
+}
+
+ static int
+read_chunk(struct seqfile *sf)
+{
+	/* parse the next chunk of a streamed file into sf->seq[] and return
+	 * how many sequences it has, or 0 after the last one
+	 */
+	long end, n;
+	char *newbuf;
+	FILE *f;
+
+	for(;;) {
+		while(!sf->eof && sf->buflen < sf->bufsize) {
+			n = read(sf->fd, sf->buf + sf->buflen, sf->bufsize - sf->buflen);
+			if(n < 0) perror(sf->filename);
+			if(n <= 0) {
+				sf->eof = 1;
+				break;
+				}
+			sf->buflen += n;
+			sf->offset += n;
+			}
+		/* have the kernel fetch the next chunk while we search this one */
+		if(!sf->eof)
+			(void) posix_fadvise(sf->fd, sf->offset, sf->bufsize, POSIX_FADV_WILLNEED);
+		if(sf->buflen == 0) return 0;
+
+		end = sf->eof ? sf->buflen : record_boundary(sf->buf, sf->buflen);
+		if(end > 0) break;
+
+		/* one sequence is bigger than the whole buffer: make room for it */
+		if((newbuf = realloc(sf->buf, 2*sf->bufsize)) == NULL) {
+			fprintf(stderr, "%s: out of memory streaming %s\n",
+			  pgmname, sf->filename);
+			return 0;
+			}
+		sf->buf = newbuf;
+		sf->bufsize *= 2;
+		}
+
+	if((f = fmemopen(sf->buf, end, "r")) == NULL) {
+		perror(sf->filename);
+		return 0;
+		}
+	n = read_seqs(f, &sf->seq, &sf->n_alloc);
+	fclose(f);
+	if(n < 0) {
+		fprintf(stderr, "%s: out of memory streaming %s\n",
+		  pgmname, sf->filename);
+		return 0;
+		}
+	sf->n_seqs = n;
+
+	/* keep the partial record at the end for next time */
+	memmove(sf->buf, sf->buf + end, sf->buflen - end);
+	sf->buflen -= end;
+	return sf->n_seqs;
+}
+
+ int
+seqfile_next(struct seqfile *sf, struct seq **chunk)
+{
+	/* set *chunk to the next group of sequences and return how many there
+	 * are, or 0 after the last one.
+	 */
+	int i, n;
+
+	if(sf->in_core) {
+		if(sf->delivered) return 0;
+		sf->delivered = 1;
+		*chunk = sf->seq;
+		return sf->n_seqs;
+		}
+
+	release_chunk(sf);
+	while(read_chunk(sf) > 0) {
+		/* leave out what the delta segments replace */
+		for(i = n = 0; i < sf->n_seqs; i++)
+			if(delta_hides(sf->delta, &sf->seq[i], 0)) free_seq(&sf->seq[i]);
+			else sf->seq[n++] = sf->seq[i];
+		if((sf->n_seqs = n) > 0) {
+			sf->n_distinct = group(sf->seq, sf->n_seqs, 1);
+			*chunk = sf->seq;
+			return sf->n_seqs;
+			}
+		}
+
+	/* then the delta segments' own */
+	if(sf->delta_seq != NULL && !sf->delivered && sf->n_delta_seqs > 0) {
+		sf->delivered = 1;
+		*chunk = sf->delta_seq;
+		return sf->n_delta_seqs;
+		}
+	return 0;
+}
+
+ void
+seqfile_close(struct seqfile *sf)
+{
+	/* release everything seqfile_open() took */
+	int i;
+
+	if(sf->in_core) {
+		if(sf->delta != NULL) {
+			free(sf->seq); /* copies of file_seq[] and the segments' */
+			sf->seq = sf->file_seq;
+			sf->n_seqs = sf->n_file_seqs;
+			}
+		if(!seqdb_unmap(sf->seq)) {
+			for(i = 0; i < sf->n_seqs; i++) free_seq(&sf->seq[i]);
+			free(sf->seq);
+			}
+		}
+	else {
+		release_chunk(sf);
+		free(sf->seq);
+		free(sf->buf);
+		free(sf->delta_seq);
+		close(sf->fd);
+		}
+	delta_close(sf->delta);
+	free(sf);
+}
@@ -0,0 +1,58 @@
+/* seqfile_subs.h:
+ *  access to a sequence database, held entirely in core or, when it is
+ *  too big for the memory budget, streamed from disk in chunks.
+ *
+ * Either way the caller sees the same loop:
+ *
+ *	seqfile_rewind(sf);
+ *	while((n = seqfile_next(sf, &chunk)) > 0)
+ *		for(seqp = chunk; seqp < &chunk[n]; seqp++) ...
+ *
+ * An in-core database is returned as one chunk.  A streamed one is
+ * parsed a chunk at a time; each chunk's sequences are freed by the
+ * following seqfile_next() or seqfile_rewind() call.
+ * Either way, any delta segments of the file (see delta_subs.h) are
+ * applied: chains they replace or remove are left out, and their own
+ * chains come after those of the file.
+ * Identical sequences of a chunk are linked together by their "same"
+ * fields, and all but the first marked as copies ("copy"), so each
+ * residue string need only be searched once.
+ * Requires <stdio.h> and "resnum_subs.h".
+ */
+
+static char seqfile_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#include <sys/types.h>
+
+#define MEMBUDGET 256 /* default memory budget, megabytes */
+
+struct seqfile {
+	char *filename;
+	int in_core;		/* true if whole database is in seq[] */
+	struct seq *seq;	/* whole database, or current chunk */
+	int n_seqs;		/* ... and how many sequences in it */
+	int n_distinct;		/* ... not copies of another in it */
+	int n_alloc;		/* size of seq[] when we malloc'ed it */
+	int delivered;		/* seq[], or delta_seq[], already returned since rewind */
+	struct delta *delta;	/* delta segments, or NULL if there are none */
+	struct seq *file_seq;	/* in core, with delta segments: the file's own */
+	int n_file_seqs;	/*  sequences, seq[] being those merged with the segments' */
+	struct seq *delta_seq;	/* streaming, with delta segments: the chains of */
+	int n_delta_seqs;	/*  the segments, delivered after the file's */
+
+	/* streaming only: */
+	int fd;
+	char *buf;		/* raw text of the current chunk */
+	long bufsize, buflen;	/* allocated and used bytes of buf */
+	off_t offset;		/* file offset just past buf's contents */
+	int eof;
+	};
+
+struct seq * seqfile_load(char *filename, int *n_seqs);
+struct seq * seqfile_read(FILE *f, int *n_seqs);
+struct seq * seqfile_load_all(char *filename, int *n_seqs);
+struct seqfile * seqfile_open(char *filename, long budget);
+int seqfile_next(struct seqfile *sf, struct seq **chunk);
+void seqfile_rewind(struct seqfile *sf);
+void seqfile_close(struct seqfile *sf);
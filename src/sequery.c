@@ -63,6 +63,9 @@
  *			 that each digit must be preceded by a \ for sequery.
  *			Example: 3 to 7 residues of any kind: .\{\3,\7\}
  *
+ *	\( and \) may group parts of a pattern, but back-references
+ *	to them are not available (sequery takes \digit for itself).
+ *
  *	Note that any database of alphabetic sequences could be searched, 
  *	provided that its file is in the format expected by this program.
  *
@@ -79,10 +82,80 @@
  *
  *  -s SEQUENCE_FILE : use custom file of protein/DNA/etc sequences.
  *			Default: $SEQUERY_HOME/lib/pdbseq.asc
+ *			This may also be a binary image made from such a
+ *			file by sequery-mkdb, which is mapped into memory
+ *			instead of being read and parsed.  If sequery-mkdb -k
+ *			left a k-mer index beside it (SEQUENCE_FILE.kix),
+ *			patterns with rare runs of residues are looked for
+ *			only where the index says those runs are; with
+ *			an FM-index (sequery-mkdb -f, SEQUENCE_FILE.fmi)
+ *			short patterns are found in time depending on how
+ *			often they occur rather than on the database size.
+ *			Delta segments appended by sequery-mkdb -a
+ *			(SEQUENCE_FILE.delta) are applied as it is read;
+ *			the indexes are not used until sequery-mkdb -c has
+ *			merged them in.
+ *
+ *  -M MATRIX_FILE : instead of patterns, read peptides, and report every
+ *			window of a sequence as long as the peptide whose
+ *			score against it, by the substitution matrix in
+ *			MATRIX_FILE, is at least the threshold given by -t.
+ *			The matrix is given as BLOSUM and PAM matrices
+ *			usually are: a line of residue letters, then a line
+ *			for each, its letter then its scores.  The matches
+ *			are written just as a pattern's (see score_subs.c).
+ *
+ *  -t THRESHOLD : the lowest score reported with -M.
+ *			Default: the peptide's score against itself.
+ *
+ *  -k EDITS : also report the matches with up to EDITS residues
+ *			changed, inserted or left out, each with its number
+ *			of edits ("with 2 edits").  Only for patterns of
+ *			fixed length, without * or \{m,n\}; matches found
+ *			this way do not overlap (see bitpar_subs.c).
+ *
+ *  -u : report each distinct sequence once.  Identical chains (the
+ *			subunits of a homo-oligomer, the many structures of
+ *			one protein) are always searched only once, their
+ *			matches repeated for each; with -u only the first
+ *			of them (in the sequence file) is reported, and the
+ *			counts are of distinct sequences.
+ *
+ *  -c : (count) : instead of its matches, write for each pattern only
+ *			"N matches in M out of E sequences matching PATTERN"
+ *			(even when there are none).  The matches are counted
+ *			as they are found, not written out and sorted, so
+ *			this costs little more than the search itself.
+ *
+ *  -l : (list) : that line, then "NAME CHAIN" for each chain matched, in
+ *			the order of the sequence file (delta segments' chains
+ *			last), however much of it is held in memory.
+ *
+ *  --stats : that line, then "position J: R N R N ..." for each position
+ *			J of the matches, giving how many times each residue
+ *			R was matched there, then "NAME CHAIN N matches" for
+ *			each chain matched, as ordered by -l (see
+ *			tally_subs.c).  Only one of
+ *			-c, -l and --stats can be given, and none of them
+ *			uses the --cache.
  *
  *  -x NUMBER_OF_CONTEXT_RESIDUES : show this many residues on each side
  *			of the match.  Default: 4
  *
+ *  -m MEGABYTES : memory budget for sequences.  A sequence file whose
+ *			text fits comfortably in the budget is read into
+ *			memory once; a bigger one is re-read from disk for
+ *			each pattern (or once for a batch, see below) in
+ *			chunks of a quarter of the budget, so there is no
+ *			limit on the size of the file.  Matches waiting to
+ *			be sorted may use another quarter before they are
+ *			sorted in runs on disk.
+ *			Default: 256
+ *
+ *  -j THREADS : search the sequences with this many threads at once.
+ *			The output is the same whatever the number.
+ *			Default: 1
+ *
  *  -v : (verbose) : give more output, mostly for debugging.
  *  -q : (quiet) :  give no output except error messages.
  * 
@@ -94,16 +167,64 @@
  *
  *  -? or -h : give version and help info
  *
+ *  --cache DIRECTORY : keep the sorted matches of each pattern in
+ *			DIRECTORY (made if need be), and answer a pattern
+ *			already there without searching.  An entry is found
+ *			only for the same database contents (delta segments
+ *			included), pattern as given and as expanded by the
+ *			definition files, and -x, so a changed database or
+ *			definition is never answered from before.  The output
+ *			is the same either way (see rcache_subs.c).
+ *
+ *  --cache-size MEGABYTES : keep the cache to this size, removing the
+ *			least recently used entries.  Default: 256
+ *
+ *  --serve SOCKET : instead of reading patterns from stdin, keep the
+ *			sequences loaded and answer patterns sent over the
+ *			Unix-domain socket SOCKET, any number of clients at
+ *			once (see serve() below).  Each line a client sends is
+ *			a pattern, optionally preceded by -x, -d and -w options
+ *			(then "--" if the pattern begins with "-"), e.g.
+ *			    -x 6 -d my.defs YW1*wAQ
+ *			The answer is the sorted matches, the messages sequery
+ *			would print and the number of matches on lines
+ *			beginning with "# ", and then an empty line.  Nothing
+ *			is written to the -o file.  If the sequence file (or
+ *			one of its indexes, or its delta segments) is
+ *			replaced, it is reloaded before
+ *			the next client is taken on; rebuild it under another
+ *			name and mv it into place, as sequery-mkdb does.
+ *
+ *  --perf FILE : write a line of JSON to FILE (- for stderr) for each
+ *			pattern searched for: the seconds it spent reading
+ *			the definition files, expanding, compiling, searching
+ *			(and, of that, formatting matches) and reporting, and
+ *			the sequences, residues, matcher calls, matches and
+ *			bytes of match lines it went through.  A batch's
+ *			pass over the sequences and the loading of the
+ *			sequence file (with the memory its residues and
+ *			residue-numbering tables take) have lines of their
+ *			own (see perf_subs.c).
+ *
+ *  --trace FILE : write the same phases, and the pieces each thread of
+ *			-j searched, as trace events for chrome://tracing.
+ *
  * Input is always from stdin.  If stdin is a terminal, rather than a file
  *   or pipe, the user is prompted for lines and is given reports on number
  *   of matches found that are suppressed otherwise unless -v is given.
  *   Also, if stdin is a terminal the wilddef and definition files are
- *   re-read before each query: if stdin is not a terminal, they are
- *   read only once per sequery run.
+ *   re-read before a query if they have been changed since it was last
+ *   read: if stdin is not a terminal, they are read only once per
+ *   sequery run.  The last 64 patterns given at a terminal (or by a
+ *   --serve client) are kept compiled, and one given again with the
+ *   same definitions is searched for without being expanded again.
  *
  * Output is always to stdout, and after each pattern (not after each run
- *  of sequery) a copy of the matches is placed in file "/tmp/sequeryXXXXXX" 
- * (XXX=Process ID,  see mktemp(3)).
+ *  of sequery) a copy of the matches is appended to the -o file.
+ *  The matches are sorted in memory (see matchlist_subs.c) by the
+ *  residues matched, then by name: sequery no longer needs sort(1)
+ *  or files in /tmp, except when there are so many matches that they
+ *  have to be sorted in runs on disk.
  *
  * Example of running sequery: 
  *
@@ -133,6 +254,10 @@
  *   Then the command
  *     sequery -q -o search.matches < search.patterns
  *   will test each pattern and write all matches into search.matches.
+ *   When the patterns do not come from a terminal they are all read
+ *   first and then looked for together, in one pass over the sequences
+ *   (see batch_subs.c); the output is the same as if each pattern had
+ *   been searched for in turn.
  *
  * This program was written in the programming language C under the
  * SunOS Unix operating system.
@@ -235,6 +360,8 @@ static char rcsid [] =
 
 #include <stdio.h>
 #include <strings.h>
+#include <string.h>
+#include <stdlib.h>
 #define streq(a,b) (!strcmp((a),(b)))
 
 #include <ctype.h>
@@ -243,16 +370,81 @@ static char rcsid [] =
 #define upper(c) ( (isascii(c) && islower(c)) ? toupper(c) : (c) )
 
 #include "resnum_subs.h" /* defines "seq" structure and access fcns */
+#include "seqdb_subs.h" /* binary sequence images from sequery-mkdb */
+#include "seqfile_subs.h" /* in-core or streamed sequence files */
+#include "delta_subs.h" /* their delta segments */
+#include "pack_subs.h" /* their residues packed as codes */
+#include <stdint.h>
+#include "regex_subs.h" /* pattern parser and DFA */
+#include "bitpar_subs.h" /* bit-parallel fixed-length matcher */
+#include "score_subs.h" /* substitution-matrix scores (-M) */
+#include "matcher_subs.h" /* picks one of them per pattern */
+#include "batch_subs.h" /* many patterns in one pass */
+#include "pool_subs.h" /* threads for -j */
+#include "matchlist_subs.h" /* sorting the matches */
+#include "tally_subs.h" /* ... or just counting them */
+#include "rcache_subs.h" /* matches kept for next time (--cache) */
+#include "kix_subs.h" /* k-mer index from sequery-mkdb -k */
+#include "fmi_subs.h" /* FM-index from sequery-mkdb -f */
+#include "defs_subs.h" /* wild card and substitution files */
+#include "perf_subs.h" /* counters and phase times (--perf, --trace) */
+#include <errno.h>
+#include <getopt.h> /* for --serve */
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 char * pgmname;
 
+/* settings and files shared by main() and the routines reporting matches: */
+static int interactive; /* true if input is a terminal, not pipe or file */
+static int verbose = 0;
+static int quiet = 0;
+
+#define CONTEXT 4
+static int context_pre = CONTEXT;
+static int context_post = CONTEXT;
+
+/* matches of the current pattern, until sorted and written out: */
+static struct matchlist * matches;
+
+/* the sequences being searched, and how many of the database come
+ * before them: numbers the chains for -l and --stats (put_match())
+ */
+static struct seq * numbered;
+static int numbered_from;
+
+#define OUTFILE "sequery.match"
+static char * outfilename = OUTFILE;
+
+static FILE * diagfile; /* where complaints about patterns go */
+
+static int nthreads = 1; /* threads searching the sequences (-j) */
+
+static struct kix * kmer_index; /* of an in-core database, or NULL */
+static struct fmi * fm_index; /* ditto */
+static struct pack * pack; /* the residues of an in-core database, or NULL */
+static struct scoremat * scoremat; /* -M, or NULL */
+static int approx; /* edits allowed by -k */
+static int one_per_seq; /* -u */
+static int tally; /* -c, -l or --stats: TALLY_..., or 0 */
+static struct perf_count counted; /* what a search looked at, with --perf */
+static char * searched; /* ... and how: "scan" or "index" */
+int search_chunk(), index_search();
+char * re_compile(), * re_score();
+struct matcher * re_matcher();
+int re_cached();
+void re_keep();
+
 main(argc, argv)
 int argc;
 char ** argv;
 {
 #define MAXSEQLEN 2048
 #define PATTERNLEN 1024
-#define MAXNSEQ 8000
 
 
 
@@ -261,65 +453,74 @@ char pat1[PATTERNLEN]; /* pattern after first file expansion (digits) */
 char pat2[PATTERNLEN]; /* pattern being searched for */
 int pat_len; /* size of pattern being searched for, before second expansion */
 
-/* interface to regexp(3) library routines, modelled after regex(3) */
+/* interface to the pattern matcher, modelled after regex(3) */
+int search_chunk(), index_search();
 char * re_compile();
-int reg_match();
+char * re_errmsg;
+struct defs * wd, * dd; /* wild cards and substitutions in effect */
+char * key; /* of the matches in the cache */
+char * expanded; /* the pattern, as the cache knows it */
+char scored[PATTERNLEN+32]; /* ... when scored with -M, or with -k */
+struct rcache_hit hit;
 
 /* interface to getopt(3) library routines */
 extern char *optarg;
 extern int optind, opterr;
+static struct option longopts[] = {
+	{ "serve", required_argument, NULL, 'S' },
+	{ "cache", required_argument, NULL, 'C' },
+	{ "cache-size", required_argument, NULL, 'Z' },
+	{ "stats", no_argument, NULL, 'T' },
+	{ "perf", required_argument, NULL, 'P' },
+	{ "trace", required_argument, NULL, 'R' },
+	{ NULL, 0, NULL, 0 }
+	};
+char * servesocket = NULL; /* --serve SOCKET */
+char * cachedirname = NULL; /* --cache DIRECTORY */
+char * scorefilename = NULL; /* -M MATRIX_FILE */
+int threshold, have_threshold = 0; /* -t THRESHOLD */
+long cachesize = RCACHE_SIZE; /* --cache-size MEGABYTES */
+char * perffilename = NULL; /* --perf FILE */
+char * tracefilename = NULL; /* --trace FILE */
+struct perf_query pq; /* the current pattern's, with either */
+double t0; /* when its current phase began */
 
 char * sequery_home();
 
+int batch_search(), search_pattern(), search_chunk(), index_search(), serve();
+void put_match(), report_matches();
+
 char seqfilename[1024];
 FILE * seqfile; /* file from which sequences are read */
-static struct seq seq[MAXNSEQ]; /* in-core array of sequences */
-struct seq * seqp; /* pointer to sequence being examined */
-int in_core = 1; /* for future "big file" version.... */
-int n_seqs; /* number of sequences in core */
-
-int interactive; /* true if input is a terminal, not pipe or file */
+struct seqfile * seqsrc; /* the sequences, in core or streamed */
+int in_core; /* true if all sequences are in core at once */
+long membudget = MEMBUDGET; /* megabytes */
 
 char * wilddeffilename = "wilddef.dat";
 
-/* file for building unsorted list of matches: */
-static char matchfilename[] = "/tmp/sequerywXXXXXX";
-FILE * matchfile;
-
-/* file for building sorted list of matches: */
-static char sortfilename[] = "/tmp/sequeryXXXXXX";
-
 char deffilename[1024];
 
 FILE * testfile; /* for testing access to named files */
 FILE * outfile;
 
-#define OUTFILE "sequery.match"
-char * outfilename = OUTFILE;
-char cat_cmd[256];
 char shell_cmd[256];
-char sort_cmd[256];
 char matrix_header[256];
 
 int errflg=0;
-int verbose = 0;
-int quiet = 0;
 
 int c;
 
-#define CONTEXT 4
-static int context_pre = CONTEXT;
-static int context_post = CONTEXT;
-
 	pgmname = argv[0];
 	interactive = isatty(0);
+	diagfile = stderr;
 
 	/* set defaults or pick up from environment: */
 	strcpy(seqfilename, sequery_home("lib/pdbseq.asc"));
 	strcpy(deffilename, sequery_home("lib/sequery.defs"));
 
 	/* set from command line options: */
-	while (( c = getopt(argc, argv, "s:w:d:x:vqo:h?")) != -1 ) switch(c) {
+	while (( c = getopt_long(argc, argv, "s:w:d:x:m:j:M:t:k:uclvqo:h?",
+	  longopts, NULL)) != -1 ) switch(c) {
 
  case 's':
 	strcpy(seqfilename, optarg); break;
@@ -329,12 +530,48 @@ static int context_post = CONTEXT;
 	strcpy(deffilename, optarg); break;
  case 'x':
 	context_pre = context_post = atoi(optarg); break;
+ case 'm':
+	membudget = atol(optarg); break;
+ case 'j':
+	nthreads = atoi(optarg);
+	if(nthreads < 1) nthreads = 1;
+	if(nthreads > POOL_MAXTHREADS) nthreads = POOL_MAXTHREADS;
+	break;
+ case 'M':
+	scorefilename = optarg; break;
+ case 't':
+	threshold = atoi(optarg);
+	have_threshold = 1;
+	break;
+ case 'k':
+	approx = atoi(optarg); break;
+ case 'u':
+	one_per_seq = 1; break;
+ case 'c':
+ case 'l':
+ case 'T':
+	if(tally != 0) {
+		fprintf(stderr, "%s: only one of -c, -l and --stats\n", pgmname);
+		errflg = 1;
+		}
+	tally = c == 'c' ? TALLY_COUNT : c == 'l' ? TALLY_LIST : TALLY_STATS;
+	break;
  case 'v':
 	verbose = 1; break;
  case 'q':
 	quiet = 1; break;
  case 'o':
         outfilename = optarg; break;
+ case 'S':
+	servesocket = optarg; break;
+ case 'C':
+	cachedirname = optarg; break;
+ case 'Z':
+	cachesize = atol(optarg); break;
+ case 'P':
+	perffilename = optarg; break;
+ case 'R':
+	tracefilename = optarg; break;
  case 'h':
  case '?':
 	fprintf(stderr, "%s: version %s of %s\n",
@@ -349,6 +586,27 @@ static int context_post = CONTEXT;
 		exit(2);
 		}
 
+	if(scorefilename != NULL) {
+		if(servesocket != NULL) {
+			fprintf(stderr, "%s: -M can't be used with --serve\n", pgmname);
+			exit(2);
+			}
+		if(approx > 0) {
+			fprintf(stderr, "%s: -M can't be used with -k\n", pgmname);
+			exit(2);
+			}
+		if((scoremat = score_load(scorefilename)) == NULL) exit(-1);
+		}
+
+	if((perffilename != NULL || tracefilename != NULL) &&
+	  perf_open(perffilename, tracefilename) != 0) exit(-1);
+
+	/* a server's matches go to its clients, and it asks nobody anything */
+	if(servesocket != NULL) {
+		interactive = 0;
+		outfilename = NULL;
+		}
+
 	/* Seems there's no easy way to say you DON'T want to save
 	 * the matches into a logfile, which I think OUGHT to be optional,
 	 * thus the check against /dev/null. M Pique.
@@ -397,13 +655,36 @@ outfile_ok:;
 		}
         else {
                 if(!quiet)printf("Sequence file: %s\n",seqfilename);
+		fclose(seqfile);
         }
 
-	if(in_core) {
-		n_seqs=fget_seq( seq, MAXNSEQ, seqfile);
-		if(verbose) printf("read %d sequences from %s\n",
-		  n_seqs, seqfilename);
+	if(perf_on) t0 = perf_now();
+	seqsrc = seqfile_open(seqfilename, membudget<<20);
+	if(seqsrc==NULL) exit(-1);
+	in_core = seqsrc->in_core;
+	if(verbose) {
+		if(in_core) printf("read %d sequences (%d distinct) from %s\n",
+		  seqsrc->n_seqs, seqsrc->n_distinct, seqfilename);
+		else printf("streaming %s in %ld-byte chunks\n",
+		  seqfilename, seqsrc->bufsize);
+		}
+	/* the indexes are of the sequence file alone, without its deltas */
+	if(in_core && seqsrc->delta == NULL) {
+		kmer_index = kix_open(seqfilename, seqsrc->n_seqs);
+		fm_index = fmi_open(seqfilename, seqsrc->n_seqs);
 		}
+	if(verbose && seqsrc->delta != NULL)
+		printf("applied delta segments from %s%s; indexes not used until compacted (sequery-mkdb -c)\n",
+		  seqfilename, DELTA_SUFFIX);
+	if(verbose && kmer_index != NULL)
+		printf("using k-mer index %s\n", kmer_index->filename);
+	if(verbose && fm_index != NULL)
+		printf("using FM-index %s\n", fm_index->filename);
+	if(in_core) pack = pack_build(seqsrc->seq, seqsrc->n_seqs);
+	if(verbose && pack != NULL)
+		printf("packed %ld residues in %ld bytes, %d bits each\n",
+		  pack->residues, pack->nwords * 8, pack->bits);
+	if(perf_on) perf_load(seqsrc, pack, t0);
 
 	/* check that the two (optional) shorthand files are present, warn
 	 * user if not there or not readable.
@@ -449,211 +730,1331 @@ outfile_ok:;
 	}
 
 		
-	mktemp(matchfilename); /* modifies matchfilename */
-	mktemp(sortfilename); /* modifies sortfilename */
-
-	matchfile = fopen(matchfilename, "w");
+	matches = matchlist_new();
+	/* matches may take a quarter of the memory budget before
+	 * they are sorted on disk
+	 */
+	matchlist_budget((membudget<<20)/4);
 
 	if(outfilename!=NULL && !quiet) printf("Output File: %s\n",outfilename);
 
-	/* build command to strip sort keys and write to stdout */
-	if(quiet)
-	sprintf(sort_cmd, "sort %s | sed 's/^[^ ]* *[^ ]* *//' > %s", 
-	  matchfilename, sortfilename);
-	else
-	sprintf(sort_cmd, "sort %s | sed 's/^[^ ]* *[^ ]* *//' | tee %s", 
-	  matchfilename, sortfilename);
-
-	/* build command to append to sequery.match or other match file */
-	if(outfilename!=NULL) { 
-		if(streq(outfilename, "-"))
-		sprintf(cat_cmd,"cat %s", sortfilename);
-		else
-		sprintf(cat_cmd,"cat %s >> %s", sortfilename, outfilename);
-		}
-	/* note from mp: this whole output processing scheme needs to
-	 * be re-engineered now that we have some idea what's useful.
-	 */
+	/* -c, -l and --stats keep only counts, and leave no files behind */
+	if(tally != 0) {
+		matchlist_tally(tally);
+		cachedirname = NULL;
+		}
+
+	/* a cache that can't be used is only a nuisance */
+	if(cachedirname != NULL && rcache_open(cachedirname, cachesize) == 0)
+		(void) rcache_db(seqfilename);
 
 
-	/* main loop .... */
-	while(interactive && !quiet && fprintf(stdout, " > ") , 
+	if(servesocket != NULL)
+		serve(servesocket, seqsrc, membudget, wilddeffilename, deffilename);
+
+	/* main loop .... (patterns not from a terminal are all read at
+	 * once and searched for together: see batch_search() below;
+	 * peptides scored with -M and patterns allowed edits by -k are
+	 * searched for one at a time)
+	 */
+	if(!interactive && scoremat == NULL && approx == 0)
+		batch_search(seqsrc, wilddeffilename, deffilename);
+	else while(interactive && !quiet && fprintf(stdout, " > ") , 
 	  NULL != gets(pat_in)) {
 		int sequences_examined = 0;
 		int sequences_matched = 0;
 		int matches_found = 0;
 
 		if(strlen(pat_in) == 0) continue;
+		if(perf_on) {
+			perf_begin(&pq, pat_in);
+			t0 = pq.t0;
+			}
 
-		pat_len = replace_wild(wilddeffilename, interactive,
-		  pat_in, pat1); /* sets pat1 */
-		if(replace_defs(deffilename, interactive, 
-		  pat1, pat2)==0) continue; /* sets pat2 */
-		if(pat_len<=0) continue;
-		if(pat_len<=1) {
-			if(!quiet)fprintf(stderr, " too short for safety...\n");
-			continue;
+		if(scoremat != NULL) {
+			/* -M: the pattern is a peptide, and every window of
+			 * its length scoring enough against it is a match
+			 */
+			if(NULL != (re_errmsg = re_score(pat_in, scoremat,
+			  have_threshold ? threshold : score_self(pat_in, scoremat)))) {
+				fprintf(stderr, "%s: %s\n", pgmname, re_errmsg);
+				goto failed;
+				}
+			if(perf_on) t0 = perf_phase(&pq, PERF_COMPILE, t0);
+			strcpy(pat1, pat_in);
+			pat_len = re_matcher(0)->sc->len;
+			if(pat_len<=1) {
+				if(!quiet)fprintf(stderr, " too short for safety...\n");
+				goto failed;
+				}
+			sprintf(pat2, "score >= %d with %.900s",
+			  re_matcher(0)->sc->threshold, scoremat->filename);
+			sprintf(scored, "%s %016llx", pat2,
+			  (unsigned long long) scoremat->hash);
+			expanded = scored;
 			}
+		else {
+			/* read again whichever definition file has changed */
+			wd = defs_get(wilddeffilename, DEFS_WILD, interactive);
+			dd = defs_get(deffilename, DEFS_SUBST, interactive);
+			if(perf_on) t0 = perf_phase(&pq, PERF_DEFS, t0);
+			if(!re_cached(pat_in, wd, dd, pat1, pat2, &pat_len)) {
+				pat_len = replace_wild(wd, pat_in, pat1, sizeof(pat1));
+				if(replace_defs(dd, pat1, pat2, sizeof(pat2))==0) goto failed;
+				if(pat_len<=0) goto failed;
+				if(pat_len<=1) {
+					if(!quiet)fprintf(stderr, " too short for safety...\n");
+					goto failed;
+					}
+				if(perf_on) t0 = perf_phase(&pq, PERF_EXPAND, t0);
 
-		if(NULL!= re_compile(pat2)) {
-			fprintf(stderr, re_compile(pat2));
-			continue;
+				if(NULL!= (re_errmsg = re_compile(pat2))) {
+					fprintf(stderr, "%s: %s\n", pgmname, re_errmsg);
+					goto failed;
+					}
+				re_keep(pat_in, wd, dd, pat1, pat2, pat_len);
+				if(perf_on) t0 = perf_phase(&pq, PERF_COMPILE, t0);
+				}
+			else if(perf_on) t0 = perf_phase(&pq, PERF_EXPAND, t0);
+			expanded = pat2;
+			if(approx > 0) {
+				sprintf(scored, "%s with up to %d edits", pat2, approx);
+				expanded = scored;
+				}
 			}
-		else if(!quiet) fprintf(stdout,"%s (length %d) -> %s\n",
-		  pat1, pat_len,pat2);
+		if(!quiet) fprintf(stdout,"%s (length %d) -> %s\n",
+		  pat1, pat_len, scoremat == NULL ? expanded : pat2);
 		fflush(stdout);
 
-		seqp = &seq[0];
-		if(!in_core) rewind(seqfile);
-  
-		/* loop over sequences to be examined */
-		while ( in_core ?
-		  seqp<&seq[n_seqs] : 
-		  fget_seq( seqp, 1, seqfile) == 1) {
-			int start_index = 0; /* for multiple searches per seq */
-			int any_matches_in_this_seq = 0;
-			int seq_len;
-			int bgn;
-			int match_len;
-			sequences_examined++;
-			seq_len = strlen(seqp->sequence);
-			while( start_index<seq_len &&
-			 reg_match(seqp->sequence+start_index, 
-			  &bgn, &match_len)) {
-				int i;
-				char bgn_resnum[5],end_resnum[5];
-				if(verbose>2)
-				  fprintf(stdout, "%s %s %s\n",seqp->name,
-				 seqp->chain, seqp->sequence);
-
-				matches_found++;
-				any_matches_in_this_seq = 1;
-
-				/* "bgn" is relative to start_index, make
-				 * it absolute...
-				 */
-				bgn += start_index;
-
-				/* ... advance start_index for next search */
-				start_index = bgn + 1;
-
-				/* write out match to use as sort key */
-				for(i=bgn;i<bgn+match_len;i++)
-				  putc(seqp->sequence[i],matchfile);
-				/* print protein name (w/ number after)
-				 * to use as secondary sort key*/
-				 fprintf(matchfile," %s",seqp->name+1);
-				 fprintf(matchfile,"%c",seqp->name[0]);
+		key = rcache_key(pat_in, expanded, context_pre, context_post,
+		  one_per_seq);
+		if(rcache_get(key, &hit)) {
+			if(perf_on) {
+				pq.how = "cache";
+				pq.count.matches = hit.matches_found;
+				}
+			report_matches(NULL, &hit, hit.matches_found,
+			  hit.sequences_matched, hit.sequences_examined, pat_in);
+			}
+		else {
+			memset(&counted, 0, sizeof(counted));
+			sequences_examined = search_pattern(seqsrc, pat_in,
+			  &matches_found, &sequences_matched);
+			if(perf_on) {
+				t0 = perf_phase(&pq, PERF_SCAN, t0);
+				pq.how = searched;
+				pq.count = counted;
+				pq.count.seqs = sequences_examined;
+				pq.count.matches = matches_found;
+				}
+			rcache_put(key, matches, matches_found, sequences_matched,
+			  sequences_examined);
+			report_matches(matches, NULL, matches_found,
+			  sequences_matched, sequences_examined, pat_in);
+			}
+		free(key);
+		if(perf_on) {
+			(void) perf_phase(&pq, PERF_REPORT, t0);
+			perf_end(&pq);
+			}
+		continue;
+
+failed: /* a pattern not searched for is still a query */
+		if(perf_on) {
+			pq.how = "error";
+			perf_end(&pq);
+			}
+		} /* end main loop */
+	perf_close();
+	return 0;
+	}
+
+ static char *
+put_str(p, str)
+char * p, * str;
+{
+	/* copy str to p, return where it ends */
+	while(*str != '\0') *p++ = *str++;
+	return p;
+	}
+
+ static char *
+put_int(p, n)
+char * p;
+int n; /* not negative */
+{
+	/* write n in decimal at p, as "%d" would, return where it ends */
+	char digits[12], * d = &digits[sizeof(digits)];
+
+	do *--d = '0' + n % 10; while((n /= 10) != 0);
+	while(d < &digits[sizeof(digits)]) *p++ = *d++;
+	return p;
+	}
+
+ static char *
+put_fields(p, name, chain, bgn_resnum, end_resnum)
+char * p, * name, * chain, * bgn_resnum, * end_resnum;
+{
+	/* what fprintf(" %s %s %4s to %4s -> ") would write at p */
+	int i;
+
+	*p++ = ' ';
+	p = put_str(p, name);
+	*p++ = ' ';
+	p = put_str(p, chain);
+	*p++ = ' ';
+	for(i = strlen(bgn_resnum); i < 4; i++) *p++ = ' ';
+	p = put_str(p, bgn_resnum);
+	p = put_str(p, " to ");
+	for(i = strlen(end_resnum); i < 4; i++) *p++ = ' ';
+	p = put_str(p, end_resnum);
+	return put_str(p, " -> ");
+	}
+
+ void
+put_match(fp, seqp, bgn, match_len, pat_in, edits)
+FILE * fp;
+struct seq * seqp;
+int bgn, match_len; /* where the match is in seqp->sequence */
+char * pat_in; /* pattern as it was given */
+int edits; /* the match's, with -k, or -1 */
+{
+	/* write one line describing a match, with its sort keys, to fp.
+	 * A broad pattern has hundreds of thousands of matches, so the line
+	 * is put together in a buffer and written at once.
+	 */
+	int i, n;
+	char bgn_resnum[10],end_resnum[10]; /* as long as any in resnum_subs.c */
+	char buf[512], * line, * p, * q;
+	char * s = seqp->sequence;
+
+	/* with -c nothing, with -l and --stats what tally_add() wants */
+	if(tally != 0) {
+		if(tally == TALLY_COUNT) return;
+		n = sizeof(seqp->name) + sizeof(seqp->chain) + match_len + 16;
+		line = n <= sizeof(buf) ? buf : (char *) malloc(n);
+		p = put_str(line, seqp->name);
+		*p++ = '\t';
+		p = put_str(p, seqp->chain);
+		*p++ = '\t';
+		p = put_int(p, numbered_from + (int) (seqp - numbered));
+		if(tally == TALLY_STATS) {
+			*p++ = '\t';
+			memcpy(p, &s[bgn], match_len);
+			p += match_len;
+			}
+		*p++ = '\n';
+		fwrite(line, 1, p - line, fp);
+		if(line != buf) free(line);
+		return;
+		}
+
+	/* get_resnumber() leaves these alone for residues without names
+	 * (before the first "(name)" of a chain with a non-numeric origin):
+	 * show blanks, not whatever the last match left in them.
+	 */
+	bgn_resnum[0] = end_resnum[0] = '\0';
+	(void) get_resnumber(bgn,seqp,bgn_resnum);
+	(void) get_resnumber(bgn+match_len-1,seqp,end_resnum);
+
+	/* room for all of it: keys, name, numbers, context, pattern */
+	n = 2*match_len + 2*sizeof(seqp->name) + sizeof(seqp->chain) +
+	  sizeof(bgn_resnum) + sizeof(end_resnum) +
+	  context_pre + context_post + strlen(pat_in) + 64;
+	line = n <= sizeof(buf) ? buf : (char *) malloc(n);
+	p = line;
+
+	/* write out match to use as sort key */
+	memcpy(p, &s[bgn], match_len);
+	p += match_len;
+	/* print protein name (w/ number after)
+	 * to use as secondary sort key*/
+	*p++ = ' ';
+	for(q = seqp->name+1; *q != '\0'; ) *p++ = *q++;
+	*p++ = seqp->name[0];
 
 /*
-				fprintf(matchfile," %s %s %4s to %4s -> ",
-				  seqp->name, seqp->chain, bgn+1, bgn+match_len-1+1);
+	fprintf(fp," %s %s %4s to %4s -> ",
+	  seqp->name, seqp->chain, bgn+1, bgn+match_len-1+1);
 */
-				(void) get_resnumber(bgn,seqp,bgn_resnum);
-				(void) get_resnumber(bgn+match_len-1,seqp,end_resnum);
-				fprintf(matchfile," %s %s %4s to %4s -> ",
-				  seqp->name, seqp->chain, bgn_resnum, end_resnum);
-
-				/* print part of sequence before match*/
-				for(i=bgn-context_pre;i<bgn;i++) 
-				  putc(i<0?' ':lower(seqp->sequence[i]),matchfile);
-				/* print match */
-				for(i=bgn;i<bgn+match_len;i++)
-				  putc(seqp->sequence[i],matchfile);
-
-				/* print part of sequence after match*/
-				for(i=bgn+match_len;i<bgn+match_len+context_post;i++) 
-				  putc(i>=strlen(seqp->sequence)?' ':lower(seqp->sequence[i]),matchfile);
-				if(0!=strncmp(pat_in,&seqp->sequence[i],strlen(pat_in)))
-				 fprintf(matchfile," matching %s", pat_in);
-				fprintf(matchfile,"\n");
-				}
-			if(any_matches_in_this_seq) sequences_matched++;
-			if(in_core) seqp++;
-			else free(seqp->sequence); /* MPique: suspect bug here, memory leak */
-			}
-		if(verbose || (sequences_matched>0 && interactive) && !quiet)
-		 fprintf(stdout, "%d match%s in %d out of %d sequences:\n",
-		 matches_found, matches_found==1?"":"es",
-		 sequences_matched, sequences_examined);
+	p = put_fields(p, seqp->name, seqp->chain, bgn_resnum, end_resnum);
+
+	/* print part of sequence before match*/
+	for(i=bgn-context_pre;i<bgn;i++) 
+	  *p++ = i<0?' ':lower(s[i]);
+	/* print match */
+	memcpy(p, &s[bgn], match_len);
+	p += match_len;
+
+	/* print part of sequence after match (its length is seqp->len) */
+	for(i=bgn+match_len;i<bgn+match_len+context_post;i++) 
+	  *p++ = i>=seqp->len?' ':lower(s[i]);
+	/* unless the pattern itself follows */
+	if(i>seqp->len)
+	 q = pat_in;
+	else
+	 for(q = pat_in, s += i; *q != '\0' && *q == *s; q++, s++);
+	if(*q != '\0') {
+		p = put_str(p, " matching ");
+		p = put_str(p, pat_in);
+		}
+	if(edits >= 0) {
+		p = put_str(p, " with ");
+		p = put_int(p, edits);
+		p = put_str(p, edits==1?" edit":" edits");
+		}
+	*p++ = '\n';
+	fwrite(line, 1, p - line, fp);
+	if(line != buf) free(line);
+	}
+
+ static int
+write_matches(ml, hit, count, fp)
+struct matchlist * ml;
+struct rcache_hit * hit;
+char * count; /* with -c, -l and --stats, the line of counts */
+FILE * fp;
+{
+	/* write the matches from ml, or the cache if hit is not NULL */
+	if(count != NULL) {
+		fputs(count, fp);
+		if(ml != NULL && matchlist_write(ml, fp) != 0) return -1;
+		return fflush(fp) == EOF || ferror(fp) ? -1 : 0;
+		}
+	return hit != NULL ? rcache_copy(hit, fp) : matchlist_write(ml, fp);
+	}
+
+ void
+report_matches(ml, hit, matches_found, sequences_matched, sequences_examined,
+  pat_in)
+struct matchlist * ml; /* the matches of one pattern, emptied after */
+struct rcache_hit * hit; /* ... or where they are in the cache */
+int matches_found, sequences_matched, sequences_examined;
+char * pat_in; /* the pattern as given */
+{
+	/* write the matches of one pattern, sorted, onto stdout and
+	 * append them to the log file.  With -c, -l and --stats, write
+	 * the counts, then what was tallied of them, even for none.
+	 */
+	FILE * logfile;
+	char * count = NULL;
+
+	if(tally != 0) {
+		count = (char *) malloc(strlen(pat_in) + 128);
+		sprintf(count, "%d match%s in %d out of %d sequences matching %s\n",
+		  matches_found, matches_found==1?"":"es",
+		  sequences_matched, sequences_examined, pat_in);
+		}
 
-		if(sequences_matched>0) {
-			fflush(matchfile);
-			/* sort matchfile into sortfile, print to stdout  */
-			system(sort_cmd); 
+	if(count == NULL &&
+	  (verbose || (sequences_matched>0 && interactive) && !quiet))
+	 fprintf(stdout, "%d match%s in %d out of %d sequences:\n",
+	 matches_found, matches_found==1?"":"es",
+	 sequences_matched, sequences_examined);
 
+	if(sequences_matched>0 || count != NULL) {
+		/* sorted matches, without sort keys, to stdout */
+		if(!quiet && write_matches(ml, hit, count, stdout) != 0) {
+			fprintf(stderr, "Error %d: Can't write matches\n", errno);
+			exit(-1);
+			}
 
-			if(interactive)
-			 if(!quiet) fprintf(stdout, 
-			 "%d match%s in %d out of %d sequences.\n",
-			 matches_found, matches_found==1?"":"es",
-			 sequences_matched, sequences_examined);
+		if(interactive && count == NULL)
+		 if(!quiet) fprintf(stdout, 
+		 "%d match%s in %d out of %d sequences.\n",
+		 matches_found, matches_found==1?"":"es",
+		 sequences_matched, sequences_examined);
 
-			/* append to sequery.match log file  */
-			if(outfilename!=NULL && (errflg=system(cat_cmd)!=0)) {
+		/* append to sequery.match log file  */
+		if(outfilename!=NULL) {
+			if(streq(outfilename, "-")) logfile = stdout;
+			else logfile = fopen(outfilename, "a");
+			if(logfile==NULL || write_matches(ml, hit, count, logfile)!=0 ||
+			  (logfile!=stdout && fclose(logfile)!=0)) {
 				  fprintf(stderr,
-				    "Error %d: Can't append %s to %s\n",
-				    errflg, matchfilename, outfilename);
+				    "Error %d: Can't append matches to %s\n",
+				    errno, outfilename);
 				  exit(-1);
 				  }
+			}
+		}
+	if(ml!=NULL) matchlist_clear(ml);
+	free(count);
+	}
 
-			/* I don't think closing and reopening *ought*
-			 * to be necessary, rewinding ought to be sufficient,
-			 * but it doesn't work correctly for me that way. mp
-			 */
-			fclose(matchfile);
-			matchfile = fopen(matchfilename, "w");
+/* With -j, each chunk of sequences is cut into pieces holding about
+ * the same number of residues, and the pieces are searched by a pool
+ * of threads (pool_subs.c).  Each piece collects its own matches, in
+ * the order a single thread would have found them; the pieces are then
+ * put together in order, so the output does not depend on the number
+ * of threads.  Each thread has its own copy of the matchers.
+ */
+#define PIECES_PER_THREAD 8
+
+struct piece_line { /* batch_search(): one line of a piece's text */
+	int pat; /* pattern it is a match of */
+	int seqno; /* sequence number within the chunk */
+	int len; /* characters in the line */
+	};
+
+struct piece {
+	struct seq * first, * end; /* sequences first..end-1 */
+	FILE * fp; /* matches, as written by put_match() ... */
+	char * text; /* ... into this buffer */
+	size_t size;
+	int matches_found;
+	int sequences_matched;
+	struct piece_line * line; /* batch_search() only */
+	int nlines, linealloc;
+	struct perf_count perf; /* with --perf or --trace: what it looked at */
+	double t0, t1; /* ... when it was searched */
+	int thread; /* ... and by which thread */
+	};
+
+struct search { /* what the threads are to do */
+	struct piece * piece;
+	char * pat_in; /* search_chunk() */
+	struct batch * b; /* batch_search() ... */
+	char ** pat_ins; /* ... its patterns as given */
+	struct matcher *** m; /* ... each thread's matchers */
+	struct batch_hits * h; /* ... and hits */
+	};
+
+ static int
+cut_chunk(chunk, n_chunk, piece)
+struct seq * chunk;
+int n_chunk;
+struct piece piece[]; /* room for nthreads*PIECES_PER_THREAD */
+{
+	/* cut chunk[0..n_chunk) into pieces of about equal numbers of
+	 * residues to search (copies have none), return how many.
+	 */
+	struct seq * seqp;
+	long total = 0, sofar = 0;
+	int npieces, k = 0;
+
+	npieces = nthreads == 1 ? 1 : nthreads * PIECES_PER_THREAD;
+	if(npieces > n_chunk) npieces = n_chunk;
+	for(seqp = chunk; seqp < &chunk[n_chunk]; seqp++)
+		if(!seqp->copy) total += seqp->len;
+
+	memset(piece, 0, npieces * sizeof(struct piece));
+	piece[0].first = chunk;
+	for(seqp = chunk; seqp < &chunk[n_chunk]; seqp++) {
+		if(!seqp->copy) sofar += seqp->len;
+		if(k+1 < npieces && sofar * npieces >= total * (k+1)) {
+			piece[k].end = seqp+1;
+			piece[++k].first = seqp+1;
 			}
-		} /* end main loop */
-	unlink(matchfilename);
-	unlink(sortfilename);
-	return 0;
+		}
+	piece[k].end = &chunk[n_chunk];
+	return k+1;
+	}
+
+ static int
+owners(seqp)
+struct seq * seqp;
+{
+	/* how many sequences a match in seqp stands for: itself and its
+	 * copies, unless only one of them is reported (-u)
+	 */
+	int n = 1;
+
+	if(!one_per_seq)
+		for(seqp = seqp->same; seqp != NULL; seqp = seqp->same) n++;
+	return n;
+	}
+
+ static int
+distinct(seq, n_seqs)
+struct seq * seq;
+int n_seqs;
+{
+	/* how many of seq[0..n_seqs) are examined, as far as the counts
+	 * reported go: with -u, not the copies
+	 */
+	int i, n = 0;
+
+	if(!one_per_seq) return n_seqs;
+	for(i = 0; i < n_seqs; i++) if(!seq[i].copy) n++;
+	return n;
+	}
+
+ static int
+search_seq(m, seqp, fp, pat_in, pf)
+struct matcher * m;
+struct seq * seqp;
+FILE * fp; /* for put_match() */
+char * pat_in; /* pattern as given */
+struct perf_count * pf; /* counted in, with --perf */
+{
+	/* write every match of m in one sequence, and in each of its
+	 * copies, to fp, return how many
+	 */
+	struct seq * o;
+	uint64_t * words; /* its packed residues, if m is to read them */
+	int start_index = 0; /* for multiple searches per seq */
+	int matches_in_this_seq = 0;
+	int seq_len;
+	int bgn;
+	int match_len;
+	int calls = 0;
+	double t;
+
+	seq_len = strlen(seqp->sequence);
+	words = matcher_packed(m) ? pack_words(pack, seqp) : NULL;
+	while( start_index<seq_len && (calls++, words != NULL ?
+	 matcher_match_packed(m, words, pack->bits, start_index, seq_len,
+	  &bgn, &match_len) :
+	 matcher_match(m, seqp->sequence+start_index, seq_len-start_index,
+	  &bgn, &match_len)) && match_len > 0) {
+		matches_in_this_seq++;
+
+		/* "bgn" is relative to start_index, make
+		 * it absolute...
+		 */
+		bgn += start_index;
+
+		/* ... advance start_index for next search (past the
+		 * whole match with -k, or its edits would find it again)
+		 */
+		start_index = m->k > 0 ? bgn + match_len : bgn + 1;
+
+		if(perf_on) t = perf_now();
+		for(o = seqp; o != NULL; o = one_per_seq ? NULL : o->same) {
+			put_match(fp, o, bgn, match_len, pat_in,
+			  m->k > 0 ? m->edits : -1);
+			if(o != seqp) matches_in_this_seq++;
+			}
+		if(perf_on) pf->format += perf_now() - t;
+		}
+	if(perf_on) {
+		pf->residues += seq_len;
+		pf->calls += calls;
+		}
+	return matches_in_this_seq;
+	}
+
+ static void
+search_piece(arg, t, thread)
+void * arg;
+int t, thread;
+{
+	/* one thread's search of piece t for the current pattern */
+	struct search * sp = (struct search *) arg;
+	struct piece * pc = &sp->piece[t];
+	struct matcher * m = re_matcher(thread);
+	struct seq * seqp;
+	int n;
+
+	if(perf_on) pc->t0 = perf_now();
+	pc->fp = open_memstream(&pc->text, &pc->size);
+	for(seqp = pc->first; seqp < pc->end; seqp++) {
+		if(seqp->copy) continue;
+		n = search_seq(m, seqp, pc->fp, sp->pat_in, &pc->perf);
+		pc->matches_found += n;
+		if(n > 0) pc->sequences_matched += owners(seqp);
+		}
+	fclose(pc->fp);
+	if(perf_on) {
+		pc->t1 = perf_now();
+		pc->thread = thread;
+		}
 	}
 
  int
-replace_wild(filename, interactive, pat_in, pat)
-char *filename;
-int interactive; /* re-read file each time if true */
-char pat_in[], pat[];
+search_pattern(seqsrc, pat_in, p_matches_found, p_sequences_matched)
+struct seqfile * seqsrc;
+char * pat_in; /* pattern as given */
+int * p_matches_found, * p_sequences_matched; /* incremented */
 {
-	/* read wild cards from file "wilddef.dat", 
-	 * copies pat_in to pat, replacing "wild card" digits
-	 * with correspondingly-numbered lines from file.
-	 * Returns pattern length.
+	/* look for the pattern last given to re_compile(), adding the
+	 * matches to "matches".  Returns the number of sequences examined.
 	 */
+	struct seq * chunk;
+	int n_chunk, sequences_examined = 0;
+	int seqs_seen = 0; /* before this chunk */
 
-#include <ctype.h>
+	/* rare patterns only where the indexes put them (not those scored
+	 * or allowed edits, which may match anywhere) ...
+	 */
+	if((fm_index != NULL || kmer_index != NULL) && re_matcher(0)->sc == NULL &&
+	  re_matcher(0)->k == 0 &&
+	  index_search(re_matcher(0), seqsrc->seq, pat_in, &matches,
+	  p_matches_found, p_sequences_matched)) {
+		searched = "index";
+		return distinct(seqsrc->seq, seqsrc->n_seqs);
+		}
 
-register char *d, *s;
+	/* ... others in every sequence, a chunk at a time */
+	searched = "scan";
+	seqfile_rewind(seqsrc);
+	while ((n_chunk = seqfile_next(seqsrc, &chunk)) > 0) {
+		numbered = chunk;
+		numbered_from = seqs_seen;
+		*p_matches_found += search_chunk(chunk, n_chunk, pat_in,
+		  p_sequences_matched);
+		sequences_examined += distinct(chunk, n_chunk);
+		seqs_seen += n_chunk;
+		}
+	return sequences_examined;
+	}
 
-#define MAXWILDS 12
-#define WILDLEN 100
-static char wild[MAXWILDS][WILDLEN+1];
-FILE * wildfile;
-static int nwilds;
-char buf[200];
+ int
+search_chunk(chunk, n_chunk, pat_in, p_sequences_matched)
+struct seq * chunk;
+int n_chunk;
+char * pat_in; /* pattern as given */
+int * p_sequences_matched; /* incremented */
+{
+	/* search chunk[0..n_chunk) for the pattern last given to
+	 * re_compile(), adding the matches to "matches".
+	 * Returns the number of matches.
+	 */
+	static struct piece * piece;
+	struct search search;
+	int npieces, k, matches_found = 0;
+
+	if(piece == NULL) piece = (struct piece *)
+	  malloc(nthreads * PIECES_PER_THREAD * sizeof(struct piece));
+	npieces = cut_chunk(chunk, n_chunk, piece);
+	search.piece = piece;
+	search.pat_in = pat_in;
+	pool_run(nthreads, npieces, search_piece, &search);
+
+	for(k = 0; k < npieces; k++) {
+		matchlist_addtext(matches, piece[k].text, piece[k].size);
+		free(piece[k].text);
+		matches_found += piece[k].matches_found;
+		*p_sequences_matched += piece[k].sequences_matched;
+		if(perf_on) {
+			piece[k].perf.bytes = piece[k].size;
+			perf_add(&counted, &piece[k].perf);
+			perf_span("piece", piece[k].thread+1, 0, piece[k].t0, piece[k].t1);
+			}
+		}
+	return matches_found;
+	}
 
-static int firstcall = 1;
+ int
+index_search(m, seq, pat_in, p_ml, p_matches_found, p_sequences_matched)
+struct matcher * m;
+struct seq * seq; /* the whole (in-core) database */
+char * pat_in; /* pattern as given */
+struct matchlist ** p_ml; /* made if need be */
+int * p_matches_found, * p_sequences_matched; /* incremented */
+{
+	/* look for m only where the FM-index, or failing that the k-mer
+	 * index, says it can be, adding the matches to *p_ml.  Returns 0,
+	 * having done nothing, if neither is any help with this pattern
+	 * (see fmi_subs.c and kix_subs.c).
+	 */
+	struct kix_cand * cand, * c;
+	struct seq * seqp, * o;
+	unsigned char * s;
+	int how, ncand, n, j, seq_len = 0, len_seq = -1, last_seq = -1;
+	FILE * fp;
+	char * text;
+	size_t size;
+	double t;
+
+	how = KIX_SCAN;
+	if(fm_index != NULL)
+		how = fmi_plan(fm_index, &m->re, m->sa != NULL, &cand, &ncand);
+	if(how == KIX_SCAN && kmer_index != NULL)
+		how = kix_plan(kmer_index, &m->re, m->sa != NULL, &cand, &ncand);
+	if(how == KIX_SCAN) return 0;
+
+	numbered = seq;
+	numbered_from = 0;
+	fp = open_memstream(&text, &size);
+	for(c = cand; c < &cand[ncand]; c++) {
+		seqp = &seq[c->seq];
+		/* the index has copies too, but they are found in the first */
+		if(seqp->copy) continue;
+		if(how == KIX_SEQUENCES) {
+			n = search_seq(m, seqp, fp, pat_in, &counted);
+			*p_matches_found += n;
+			if(n > 0) *p_sequences_matched += owners(seqp);
+			continue;
+			}
 
-if(interactive || firstcall) {
-	for(nwilds=0;nwilds<MAXWILDS;nwilds++) strcpy(wild[nwilds],"");
+		/* KIX_POSITIONS: a fixed-length match can only begin here */
+		if(c->seq != len_seq) {
+			seq_len = strlen(seqp->sequence);
+			len_seq = c->seq;
+			}
+		s = (unsigned char *) seqp->sequence + c->start;
+		if(c->start + m->sa->len > seq_len) continue;
+		if(perf_on) {
+			counted.calls++;
+			counted.residues += m->sa->len;
+			}
+		for(j = 0; j < m->sa->len; j++)
+			if(!((m->sa->mask[s[j]] >> j) & 1)) break;
+		if(j < m->sa->len) continue;
+		if(perf_on) t = perf_now();
+		for(o = seqp; o != NULL; o = one_per_seq ? NULL : o->same)
+			put_match(fp, o, c->start, m->sa->len, pat_in, -1);
+		if(perf_on) counted.format += perf_now() - t;
+		*p_matches_found += owners(seqp);
+		if(c->seq != last_seq) *p_sequences_matched += owners(seqp);
+		last_seq = c->seq;
+		}
+	fclose(fp);
+	free(cand);
+	counted.bytes += size;
 
-	wildfile = fopen(filename, "r");
-	if(wildfile == NULL) nwilds = 0;
-	else {
-		nwilds=0;
-		while(nwilds<MAXWILDS) {
-			if(NULL==fgets(buf, WILDLEN, wildfile)) break;
-			if(buf[0]=='\n') continue; /* skip empties */
-			if(buf[0]=='#') continue; /* skip comments */
-			if(1==sscanf(buf, "%s", wild[nwilds])) nwilds++;
+	if(size > 0) {
+		if(*p_ml == NULL) *p_ml = matchlist_new();
+		matchlist_addtext(*p_ml, text, size);
+		}
+	free(text);
+	return 1;
+	}
+
+ static void
+batch_piece(arg, t, thread)
+void * arg;
+int t, thread;
+{
+	/* one thread's search of piece t for a whole batch of patterns */
+	struct search * sp = (struct search *) arg;
+	struct piece * pc = &sp->piece[t];
+	struct batch_hits * h = &sp->h[thread];
+	struct batch_hit * hit;
+	struct piece_line * l;
+	struct seq * seqp, * o;
+	long pos = 0, newpos;
+	int len;
+	double when;
+
+	if(perf_on) pc->t0 = perf_now();
+	pc->fp = open_memstream(&pc->text, &pc->size);
+	for(seqp = pc->first; seqp < pc->end; seqp++) {
+		if(seqp->copy) continue;
+		len = strlen(seqp->sequence);
+		batch_scan(sp->b, sp->m[thread], h, seqp->sequence, len);
+		if(perf_on) {
+			pc->perf.calls++;
+			pc->perf.residues += len;
+			when = perf_now();
+			}
+		/* each copy's lines together, for the count of sequences */
+		for(o = seqp; o != NULL; o = one_per_seq ? NULL : o->same) {
+			for(hit = h->hit; hit < &h->hit[h->nhits]; hit++) {
+				put_match(pc->fp, o, hit->bgn, hit->len,
+				  sp->pat_ins[hit->pat], -1);
+				if(pc->nlines == pc->linealloc) {
+					pc->linealloc = pc->linealloc ? 2*pc->linealloc : 256;
+					pc->line = (struct piece_line *) realloc(pc->line,
+					  pc->linealloc * sizeof(struct piece_line));
+					}
+				l = &pc->line[pc->nlines++];
+				newpos = ftell(pc->fp);
+				l->pat = hit->pat;
+				l->seqno = o - sp->piece[0].first;
+				l->len = newpos - pos;
+				pos = newpos;
+				}
+			}
+		if(perf_on) pc->perf.format += perf_now() - when;
+		}
+	fclose(pc->fp);
+	if(perf_on) {
+		pc->t1 = perf_now();
+		pc->thread = thread;
+		}
+	}
+
+ int
+batch_search(seqsrc, wilddeffilename, deffilename)
+struct seqfile * seqsrc;
+char * wilddeffilename, * deffilename;
+{
+	/* Read every pattern from the (non-terminal) standard input first,
+	 * look for all of them in a single pass over the sequences, then
+	 * report each pattern in turn exactly as the main loop would have
+	 * if it had searched for them one at a time.  Complaints about a
+	 * pattern are held back until its turn comes, so they still
+	 * appear among the matches in the same places.
+	 * Returns the number of patterns read.
+	 */
+struct query {
+	char * pat_in; /* as given */
+	char * pat1, * pat2; /* after each expansion, if it compiled */
+	int pat_len;
+	long diag_bgn; /* where its complaints begin in diag_buf */
+	struct matchlist * ml; /* its matches */
+	int matches_found;
+	int sequences_matched;
+	int last_seq; /* last sequence matched */
+	char * key; /* of its matches in the cache */
+	struct rcache_hit * hit; /* where they are there, or NULL */
+	struct perf_query perf; /* with --perf or --trace */
+	} * query = NULL, * q;
+struct matcher ** m = NULL; /* compiled pattern, NULL if skipped */
+struct matcher ** scan; /* ... and NULL if already searched for */
+int nq = 0, nalloc = 0, nsearch = 0;
+char pat_in[PATTERNLEN], pat1[PATTERNLEN], pat2[PATTERNLEN];
+char * nl; /* ending pat_in */
+int c, too_long;
+char * diag_buf;
+size_t diag_size;
+long diag_end;
+char * msg;
+struct defs * wd, * dd;
+struct batch * b;
+struct search search;
+struct piece * piece;
+struct piece_line * l;
+struct seq * chunk;
+int n_chunk, npieces, i, k, t;
+size_t off;
+int sequences_examined = 0;
+int seqs_seen = 0; /* before this chunk: numbers its sequences */
+struct perf_query pass; /* the pass over the sequences, with --perf */
+double when; /* a phase began */
+
+	diagfile = open_memstream(&diag_buf, &diag_size);
+
+	while(NULL != fgets(pat_in, sizeof(pat_in), stdin)) {
+		too_long = 0;
+		if((nl = strchr(pat_in, '\n')) != NULL) *nl = '\0';
+		else if(strlen(pat_in) == sizeof(pat_in) - 1) {
+			/* no pattern is this long: skip the rest of the line */
+			while((c = getchar()) != EOF && c != '\n') ;
+			too_long = 1;
+			}
+		if(nq == nalloc) {
+			nalloc = nalloc ? 2 * nalloc : 64;
+			query = (struct query *) realloc(query,
+			  nalloc * sizeof(struct query));
+			m = (struct matcher **) realloc(m,
+			  nalloc * sizeof(struct matcher *));
+			}
+		q = &query[nq];
+		memset(q, 0, sizeof(struct query));
+		q->pat_in = strdup(pat_in);
+		q->diag_bgn = ftell(diagfile);
+		q->last_seq = -1;
+		m[nq++] = NULL;
+
+		if(too_long) {
+			fprintf(diagfile, "%s: pattern too long\n", pgmname);
+			continue;
+			}
+
+		/* as in the main loop */
+		if(strlen(pat_in) == 0) continue;
+		if(perf_on) {
+			perf_begin(&q->perf, q->pat_in);
+			when = q->perf.t0;
+			}
+
+		wd = defs_get(wilddeffilename, DEFS_WILD, interactive);
+		dd = defs_get(deffilename, DEFS_SUBST, interactive);
+		if(perf_on) when = perf_phase(&q->perf, PERF_DEFS, when);
+		q->pat_len = replace_wild(wd, pat_in, pat1, sizeof(pat1));
+		if(replace_defs(dd, pat1, pat2, sizeof(pat2))==0) continue;
+		if(q->pat_len<=0) continue;
+		if(q->pat_len<=1) {
+			if(!quiet)fprintf(diagfile, " too short for safety...\n");
+			continue;
+			}
+		if(perf_on) when = perf_phase(&q->perf, PERF_EXPAND, when);
+
+		if(NULL!= (msg = matcher_compile(pat2, &m[nq-1]))) {
+			fprintf(diagfile, "%s: %s\n", pgmname, msg);
+			continue;
+			}
+		if(perf_on) (void) perf_phase(&q->perf, PERF_COMPILE, when);
+		q->pat1 = strdup(pat1);
+		q->pat2 = strdup(pat2);
+		q->key = rcache_key(pat_in, pat2, context_pre, context_post,
+		  one_per_seq);
+		q->hit = (struct rcache_hit *) malloc(sizeof(struct rcache_hit));
+		if(!rcache_get(q->key, q->hit)) {
+			free(q->hit);
+			q->hit = NULL;
+			}
+		nsearch++;
+		}
+	fflush(diagfile);
+
+	/* patterns with matches in the cache are not looked for at all,
+	 * those the indexes can place are looked for only there, and the
+	 * others are left to the pass over all the sequences
+	 */
+	scan = (struct matcher **) malloc((nq ? nq : 1) * sizeof(struct matcher *));
+	for(i = 0; i < nq; i++) {
+		scan[i] = m[i];
+		q = &query[i];
+		if(m[i] == NULL) continue;
+		if(perf_on) {
+			memset(&counted, 0, sizeof(counted));
+			when = perf_now();
+			q->perf.how = "batch";
+			}
+		if(q->hit != NULL) {
+			scan[i] = NULL;
+			nsearch--;
+			if(perf_on) q->perf.how = "cache";
+			}
+		else if((fm_index != NULL || kmer_index != NULL) &&
+		  index_search(m[i], seqsrc->seq, q->pat_in, &q->ml,
+		  &q->matches_found, &q->sequences_matched)) {
+			scan[i] = NULL;
+			nsearch--;
+			if(perf_on) {
+				(void) perf_phase(&q->perf, PERF_SCAN, when);
+				q->perf.how = "index";
+				q->perf.count = counted;
+				}
+			}
+		}
+
+	/* one pass over the sequences for all the other patterns */
+	if(perf_on && nsearch > 0) {
+		perf_begin(&pass, NULL);
+		pass.how = "batch";
+		memset(&counted, 0, sizeof(counted));
+		}
+	b = batch_build(scan, nq);
+	if(perf_on && nsearch > 0) when = perf_phase(&pass, PERF_COMPILE, pass.t0);
+	if(nsearch > 0) {
+		search.b = b;
+		search.pat_ins = (char **) malloc(nq * sizeof(char *));
+		for(i = 0; i < nq; i++) search.pat_ins[i] = query[i].pat_in;
+		search.m = (struct matcher ***)
+		  malloc(nthreads * sizeof(struct matcher **));
+		search.h = (struct batch_hits *)
+		  calloc(nthreads, sizeof(struct batch_hits));
+		search.m[0] = scan;
+		for(t = 1; t < nthreads; t++) search.m[t] = batch_clone(b);
+		search.piece = piece = (struct piece *)
+		  malloc(nthreads * PIECES_PER_THREAD * sizeof(struct piece));
+
+		seqfile_rewind(seqsrc);
+		while ((n_chunk = seqfile_next(seqsrc, &chunk)) > 0) {
+			numbered = chunk;
+			numbered_from = seqs_seen;
+			npieces = cut_chunk(chunk, n_chunk, piece);
+			pool_run(nthreads, npieces, batch_piece, &search);
+
+			/* hand each line to its pattern, in order */
+			for(k = 0; k < npieces; k++) {
+				off = 0;
+				for(l = piece[k].line; l < &piece[k].line[piece[k].nlines]; l++) {
+					q = &query[l->pat];
+					if(q->ml == NULL) q->ml = matchlist_new();
+					if(l->len > 0) /* nothing at all with -c */
+						matchlist_add(q->ml, piece[k].text + off,
+						  l->len - 1); /* not the newline */
+					off += l->len;
+					q->perf.count.bytes += l->len;
+					q->matches_found++;
+					if(q->last_seq != seqs_seen + l->seqno) {
+						q->sequences_matched++;
+						q->last_seq = seqs_seen + l->seqno;
+						}
+					}
+				free(piece[k].text);
+				free(piece[k].line);
+				if(perf_on) {
+					piece[k].perf.bytes = piece[k].size;
+					perf_add(&counted, &piece[k].perf);
+					perf_span("piece", piece[k].thread+1, pass.n,
+					  piece[k].t0, piece[k].t1);
+					}
+				}
+			sequences_examined += distinct(chunk, n_chunk);
+			seqs_seen += n_chunk;
+			}
+
+		for(t = 1; t < nthreads; t++) batch_unclone(b, search.m[t]);
+		for(t = 0; t < nthreads; t++) free(search.h[t].hit);
+		free(search.m);
+		free(search.h);
+		free(search.pat_ins);
+		free(piece);
+		}
+	batch_free(b);
+	free(scan);
+	if(perf_on && nsearch > 0) {
+		(void) perf_phase(&pass, PERF_SCAN, when);
+		pass.count = counted;
+		pass.count.seqs = sequences_examined;
+		for(i = 0; i < nq; i++)
+			if(m[i] != NULL && streq(query[i].perf.how, "batch"))
+				pass.count.matches += query[i].matches_found;
+		perf_end(&pass);
+		}
+	if(fm_index != NULL || kmer_index != NULL)
+		sequences_examined = distinct(seqsrc->seq, seqsrc->n_seqs);
+
+	/* report, pattern by pattern */
+	for(i = 0; i < nq; i++) {
+		q = &query[i];
+		diag_end = i+1 < nq ? query[i+1].diag_bgn : (long) diag_size;
+		fwrite(diag_buf + q->diag_bgn, 1, diag_end - q->diag_bgn,
+		  stderr);
+		if(m[i] != NULL) {
+			if(perf_on) when = perf_now();
+			if(!quiet) fprintf(stdout,"%s (length %d) -> %s\n",
+			  q->pat1, q->pat_len, q->pat2);
+			fflush(stdout);
+			if(q->hit != NULL) {
+				report_matches(NULL, q->hit, q->hit->matches_found,
+				  q->hit->sequences_matched,
+				  q->hit->sequences_examined, q->pat_in);
+				}
+			else {
+				rcache_put(q->key, q->ml, q->matches_found,
+				  q->sequences_matched, sequences_examined);
+				report_matches(q->ml, NULL, q->matches_found,
+				  q->sequences_matched, sequences_examined, q->pat_in);
+				}
+			if(perf_on) {
+				(void) perf_phase(&q->perf, PERF_REPORT, when);
+				q->perf.count.matches = q->hit != NULL ?
+				  q->hit->matches_found : q->matches_found;
+				if(q->hit == NULL) q->perf.count.seqs = sequences_examined;
+				perf_end(&q->perf);
+				}
+			matchlist_free(q->ml);
+			free(q->key);
+			free(q->hit);
+			matcher_free(m[i]);
+			free(q->pat1);
+			free(q->pat2);
+			}
+		else if(perf_on && q->perf.n > 0) {
+			/* not searched for, but still a query */
+			q->perf.how = "error";
+			perf_end(&q->perf);
+			}
+		free(q->pat_in);
+		}
+
+	fclose(diagfile);
+	free(diag_buf);
+	diagfile = stderr;
+	free(query);
+	free(m);
+	return nq;
+	}
+
+ static void
+db_stamp(seqfilename, stamp)
+char * seqfilename;
+long stamp[16];
+{
+	/* identify the versions of the sequence file, its indexes and
+	 * delta segments
+	 */
+	static char * suffix[4] = { "", ".kix", ".fmi", DELTA_SUFFIX };
+	char name[1024+8];
+	struct stat st;
+	int i;
+
+	memset(stamp, 0, 16 * sizeof(long));
+	for(i = 0; i < 4; i++) {
+		sprintf(name, "%s%s", seqfilename, suffix[i]);
+		if(stat(name, &st) != 0) continue;
+		stamp[4*i] = st.st_dev;
+		stamp[4*i+1] = st.st_ino;
+		stamp[4*i+2] = st.st_mtime;
+		stamp[4*i+3] = st.st_size;
+		}
+	}
+
+ static void
+serve_client(fd, seqsrc, wilddeffilename, deffilename)
+int fd; /* connected socket */
+struct seqfile * seqsrc;
+char * wilddeffilename, * deffilename; /* unless the client says otherwise */
+{
+	/* answer one client's patterns, one a line, until it hangs up.
+	 * Each line may begin with -x, -d and -w options, as on the
+	 * command line, for that pattern only; "--" ends the options.
+	 * The answer is the sorted matches, then any messages and the
+	 * count of matches on lines beginning with "# ", then an empty line.
+	 */
+	FILE * in, * out;
+	char line[PATTERNLEN+2048];
+	char pat1[PATTERNLEN], pat2[PATTERNLEN];
+	char * pat_in, * wild, * defs, * arg, * msg, * s;
+	struct defs * wd, * dd;
+	char * key, * expanded;
+	char scored[PATTERNLEN+32]; /* pat2 with -k */
+	struct rcache_hit hit;
+	char * diag_buf;
+	size_t diag_size;
+	int context = context_pre;
+	int opt, ok, pat_len;
+	int matches_found, sequences_matched, sequences_examined;
+	int defined;
+	struct perf_query pq;
+	double t;
+
+	in = fdopen(fd, "r");
+	out = fdopen(dup(fd), "w");
+
+	/* a streamed database needs a file offset of its own */
+	if(!seqsrc->in_core &&
+	  (seqsrc = seqfile_open(seqsrc->filename, 4 * seqsrc->bufsize)) == NULL)
+		return;
+
+	while(fgets(line, sizeof(line), in) != NULL) {
+		if((s = strchr(line, '\n')) != NULL) *s = '\0';
+		else if(strlen(line) == sizeof(line) - 1) {
+			/* the rest of a line too long to read: no pattern fits */
+			while((opt = getc(in)) != EOF && opt != '\n') ;
+			fprintf(out, "# pattern too long\n\n");
+			if(fflush(out) == EOF) break;
+			continue;
+			}
+		if((s = strchr(line, '\r')) != NULL) *s = '\0';
+		context_pre = context_post = context;
+		wild = wilddeffilename;
+		defs = deffilename;
+		ok = 1;
+
+		/* options for this pattern */
+		for(s = line; ; ) {
+			while(isspace(*s)) s++;
+			if(s[0] != '-' || s[1] == '\0') break;
+			opt = s[1];
+			s += 2;
+			if(opt == '-') break;
+			if(*s == '\0' || isspace(*s)) /* -x 6, not -x6 */
+				while(isspace(*s)) s++;
+			arg = s;
+			while(*s && !isspace(*s)) s++;
+			if(*s) *s++ = '\0';
+			switch(opt) {
+ case 'x':
+			context_pre = context_post = atoi(arg); break;
+ case 'd':
+			defs = arg; break;
+ case 'w':
+			wild = arg; break;
+ default:
+			ok = 0; break;
+				}
+			}
+		while(isspace(*s)) s++;
+		pat_in = s;
+		if(!ok) {
+			fprintf(out, "# usage: [-x N] [-d DEFINITION_FILE] [-w WILDDEFS_FILE] [--] PATTERN\n\n");
+			if(fflush(out) == EOF) break;
+			continue;
+			}
+		if(strlen(pat_in) >= PATTERNLEN) {
+			fprintf(out, "# pattern too long\n\n");
+			if(fflush(out) == EOF) break;
+			continue;
+			}
+
+		/* as in the main loop, with the definition files read again if changed */
+		diagfile = open_memstream(&diag_buf, &diag_size);
+		ok = 0;
+		matches_found = sequences_matched = sequences_examined = 0;
+		if(strlen(pat_in) > 0) {
+			if(perf_on) {
+				perf_begin(&pq, pat_in);
+				t = pq.t0;
+				}
+			wd = defs_get(wild, DEFS_WILD, 1);
+			dd = defs_get(defs, DEFS_SUBST, 1);
+			if(perf_on) t = perf_phase(&pq, PERF_DEFS, t);
+			if(re_cached(pat_in, wd, dd, pat1, pat2, &pat_len)) ok = 1;
+			else {
+				pat_len = replace_wild(wd, pat_in, pat1, sizeof(pat1));
+				defined = replace_defs(dd, pat1, pat2, sizeof(pat2));
+				if(perf_on) t = perf_phase(&pq, PERF_EXPAND, t);
+				if(defined==0) ;
+				else if(pat_len<=0) ;
+				else if(pat_len<=1)
+					fprintf(diagfile, " too short for safety...\n");
+				else if(NULL != (msg = re_compile(pat2)))
+					fprintf(diagfile, "%s: %s\n", pgmname, msg);
+				else {
+					re_keep(pat_in, wd, dd, pat1, pat2, pat_len);
+					ok = 1;
+					}
+				if(perf_on) t = perf_phase(&pq, PERF_COMPILE, t);
+				}
+			if(ok) {
+				expanded = pat2;
+				if(approx > 0) {
+					sprintf(scored, "%s with up to %d edits", pat2, approx);
+					expanded = scored;
+					}
+				fprintf(diagfile, "%s (length %d) -> %s\n",
+				  pat1, pat_len, expanded);
+				key = rcache_key(pat_in, expanded, context_pre,
+				  context_post, one_per_seq);
+				if(rcache_get(key, &hit)) {
+					matches_found = hit.matches_found;
+					sequences_matched = hit.sequences_matched;
+					sequences_examined = hit.sequences_examined;
+					if(sequences_matched > 0) rcache_copy(&hit, out);
+					if(perf_on) pq.how = "cache";
+					}
+				else {
+					memset(&counted, 0, sizeof(counted));
+					sequences_examined = search_pattern(seqsrc, pat_in,
+					  &matches_found, &sequences_matched);
+					if(perf_on) {
+						t = perf_phase(&pq, PERF_SCAN, t);
+						pq.how = searched;
+						pq.count = counted;
+						pq.count.seqs = sequences_examined;
+						}
+					rcache_put(key, matches, matches_found,
+					  sequences_matched, sequences_examined);
+					if(sequences_matched > 0 &&
+					  matchlist_write(matches, out) != 0)
+						fprintf(diagfile, "%s: can't write all the matches\n",
+						  pgmname);
+					matchlist_clear(matches);
+					}
+				free(key);
+				}
+			if(perf_on) {
+				(void) perf_phase(&pq, PERF_REPORT, t);
+				pq.count.matches = matches_found;
+				if(!ok) pq.how = "error";
+				perf_end(&pq);
+				}
 			}
-		fclose(wildfile);
+		fclose(diagfile);
+		diagfile = stderr;
+
+		for(s = diag_buf; s < diag_buf + diag_size; s = arg + 1) {
+			if((arg = memchr(s, '\n', diag_buf + diag_size - s)) == NULL)
+				arg = diag_buf + diag_size;
+			fprintf(out, "# %.*s\n", (int) (arg - s), s);
+			}
+		free(diag_buf);
+		if(ok) fprintf(out, "# %d match%s in %d out of %d sequences.\n",
+		  matches_found, matches_found==1?"":"es",
+		  sequences_matched, sequences_examined);
+		putc('\n', out);
+		if(fflush(out) == EOF) break;
 		}
+	fclose(in);
+	fclose(out);
+	}
+
+ int
+serve(sockname, seqsrc, membudget, wilddeffilename, deffilename)
+char * sockname; /* Unix-domain socket to listen on */
+struct seqfile * seqsrc; /* the sequences, as loaded */
+long membudget; /* megabytes, for reloading them */
+char * wilddeffilename, * deffilename;
+{
+	/* --serve: keep the sequences loaded and answer patterns sent over
+	 * a socket.  Each client is served by a process of its own, which
+	 * shares the sequences with this one, so many can be served at once.
+	 * When the sequence file or one of its indexes changes, it is loaded
+	 * afresh before the next client is taken on; clients already being
+	 * served go on with the one they started with.  Does not return.
+	 */
+	struct sockaddr_un addr;
+	struct seqfile * newsrc;
+	long stamp[16], now[16];
+	double t0; /* when a reload began, with --perf */
+	char * seqfilename = seqsrc->filename;
+	int sock, fd;
+
+	if(strlen(sockname) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: socket name %s is too long\n",
+		  pgmname, sockname);
+		exit(-1);
+		}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, sockname);
+	(void) unlink(sockname);
+	if((sock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+	  bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	  listen(sock, 64) < 0) {
+		perror(sockname);
+		exit(-1);
+		}
+	signal(SIGCHLD, SIG_IGN); /* no zombies */
+	signal(SIGPIPE, SIG_IGN); /* a client hanging up is not fatal */
+	db_stamp(seqfilename, stamp);
+	if(!quiet) printf("%s: serving %s on %s\n", pgmname, seqfilename, sockname);
+
+	for(;;) {
+		fflush(stdout);
+		fflush(stderr);
+		if((fd = accept(sock, NULL, NULL)) < 0) {
+			if(errno != EINTR) perror(sockname);
+			continue;
+			}
+
+		db_stamp(seqfilename, now);
+		if(memcmp(now, stamp, sizeof(now)) != 0) {
+			memcpy(stamp, now, sizeof(now));
+			if(perf_on) t0 = perf_now();
+			/* if it can't be loaded, carry on with the old one */
+			if((newsrc = seqfile_open(seqfilename, membudget<<20)) != NULL) {
+				pack_free(pack);
+				seqfile_close(seqsrc);
+				seqsrc = newsrc;
+				pack = seqsrc->in_core ?
+				  pack_build(seqsrc->seq, seqsrc->n_seqs) : NULL;
+				kix_close(kmer_index);
+				fmi_close(fm_index);
+				kmer_index = NULL;
+				fm_index = NULL;
+				if(seqsrc->in_core && seqsrc->delta == NULL) {
+					kmer_index = kix_open(seqfilename, seqsrc->n_seqs);
+					fm_index = fmi_open(seqfilename, seqsrc->n_seqs);
+					}
+				(void) rcache_db(seqfilename);
+				if(perf_on) perf_load(seqsrc, pack, t0);
+				if(!quiet) printf("%s: reloaded %s\n", pgmname, seqfilename);
+				fflush(stdout);
+				}
+			}
+		/* so the client starts with them read */
+		(void) defs_get(wilddeffilename, DEFS_WILD, 1);
+		(void) defs_get(deffilename, DEFS_SUBST, 1);
 
-	firstcall = 0;
+		switch(fork()) {
+ case -1:
+			perror(pgmname);
+			break;
+ case 0:
+			close(sock);
+			serve_client(fd, seqsrc, wilddeffilename, deffilename);
+			exit(0);
+			}
+		close(fd);
+		}
 	}
 
+ int
+replace_wild(wd, pat_in, pat, size)
+struct defs *wd; /* wild cards, from defs_get() */
+char pat_in[], pat[];
+int size; /* of pat */
+{
+	/* copies pat_in to pat, replacing "wild card" digits
+	 * with correspondingly-numbered lines from file "wilddef.dat".
+	 * Returns pattern length, or 0 if it would not fit in pat.
+	 */
+
+#include <ctype.h>
+
+register char *d, *s;
+
 	/* expand pattern by wildcards (represented by integers 0-9) */
 	s = pat_in; /* src */
 	d = pat; /* dest */
@@ -682,15 +2083,21 @@ if(interactive || firstcall) {
    Start counting wilddef replacement index at 1. i.e. 1 is replaced by
    the first line in wilddef
 */
-			if(*s-'1' > nwilds-1) {
+			if(*s-'1' > wd->n-1 || *s == '0') {
 				/* error */
-				fprintf(stderr," wildcard entry %c not defined\n", *s);
+				fprintf(diagfile," wildcard entry %c not defined\n", *s);
+				pat[0] = '\0'; /* error exit */
+				return 0;
+				}
+			c = wd->text[*s-'1'];
+			if((d - pat) + strlen(c) + 3 > size) {
+				fprintf(diagfile,"%s: pattern too long when expanded\n",
+				 pgmname);
 				pat[0] = '\0'; /* error exit */
 				return 0;
 				}
 			/* make a new string, surrounded by [ ] */
 			strcat(d,"[");
-			c = wild[*s-'1'];
 			while(*c) {
 				static char a[2];
 				a[0] = *c;
@@ -700,6 +2107,12 @@ if(interactive || firstcall) {
 			strcat(d,"]");
 			d = &pat[strlen(pat)]; /* first unoccupied char */
 			}
+		else if((d - pat) + 2 > size) {
+			fprintf(diagfile,"%s: pattern too long when expanded\n",
+			 pgmname);
+			pat[0] = '\0'; /* error exit */
+			return 0;
+			}
 		else *d++ = *s;
 		s++;
 		*d='\0'; /* keep dest string terminated, for strcat */
@@ -708,63 +2121,24 @@ if(interactive || firstcall) {
 	}
 
  int
-replace_defs(filename, interactive, pat_in, pat)
-char *filename;
-int interactive; /* re-read file each time if true */
+replace_defs(dd, pat_in, pat, size)
+struct defs *dd; /* substitutions, from defs_get() */
 char pat_in[], pat[];
+int size; /* of pat, at most PATTERNLEN */
 {
-	/* read string substitution definitions from file "sequery.defs", 
-	 * copies pat_in to pat, replacing lower-case letters with 
-	 * expansions suitable for "ed"-style regular
-	 * expressions.
+	/* copies pat_in to pat, replacing lower-case letters with 
+	 * expansions from file "sequery.defs" suitable for "ed"-style
+	 * regular expressions.
 	 *
-	 * Returns pattern length.
+	 * Returns pattern length, or 0 if it would not fit in pat.
 	 */
 
 register char *d, *s;
 
 #include <ctype.h>
 
-#define MAXDEFNS 40
-#define DEFNLEN 100
-#define KEYLEN 1
-static char key[MAXDEFNS][KEYLEN+1];
-static char defn[MAXDEFNS][DEFNLEN+1];
-FILE * defnfile;
-static int ndefns;
-char buf[200];
 char output_buf[PATTERNLEN];
-int linenumber;
 int in_brackets = 0; /* boolean */
-static int firstcall = 1;
-
-
-if(interactive || firstcall ) {
-	for(ndefns=0;ndefns<MAXDEFNS;ndefns++) key[ndefns][0] = defn[ndefns][0] = '\0';
-
-	defnfile = fopen(filename, "r");
-	if(defnfile == NULL) ndefns = 0;
-	else {
-		ndefns=0;
-		linenumber=0;
-		while(ndefns<MAXDEFNS) {
-			if(NULL==fgets(buf, DEFNLEN, defnfile)) break;
-			linenumber++;
-			if(buf[0] == '\n') continue; /* skip empties */
-			if(buf[0] == '#') continue; /* skip comments */
-			if(2==sscanf(buf, "%1s %s", 
-			  key[ndefns], defn[ndefns])) ndefns++;
-			else {
-				fprintf(stderr,
-			"%s: format problem in file %s, line %d :%s",
-				pgmname, filename, linenumber, buf);
-				fprintf(stderr," line ignored.\n");
-				}
-			}
-		fclose(defnfile);
-		}
-	firstcall = 0;
-	}
 
 	/* count characters in pattern */
 	s = pat_in;
@@ -775,6 +2149,13 @@ if(interactive || firstcall ) {
 	while ( *s ) {
 		while(isspace(*s)) s++;
 
+		if((d - output_buf) + 2 > size) {
+			fprintf(diagfile,"%s: pattern too long when expanded\n",
+			 pgmname);
+			pat[0] = '\0'; /* error exit */
+			return 0;
+			}
+
 		if(*s=='[') in_brackets++;
 		if(*s==']') in_brackets--;
 
@@ -788,21 +2169,27 @@ if(interactive || firstcall ) {
 		else if(isascii(*s) && islower(*s)) {
 			/* substitute it from file entry */
 			int i;
-			for(i=0;i<ndefns;i++) if(upper(*s) == upper(key[i][0])) break;
-			if(i == ndefns) {
+			for(i=0;i<dd->n;i++) if(upper(*s) == upper(dd->key[i])) break;
+			if(i == dd->n) {
 				/* error */
-				fprintf(stderr,"%s: %c not defined in %s\n",
-				 pgmname, *s, filename);
+				fprintf(diagfile,"%s: %c not defined in %s\n",
+				 pgmname, *s, dd->filename);
+				pat[0] = '\0'; /* error exit */
+				return 0;
+				}
+			if((d - output_buf) + strlen(dd->text[i]) + 1 > size) {
+				fprintf(diagfile,"%s: pattern too long when expanded\n",
+				 pgmname);
 				pat[0] = '\0'; /* error exit */
 				return 0;
 				}
 			if(in_brackets) {
 				/* remove this layer of brackets - messy. mp */
-				sprintf(d, "%s", defn[i]+1);
+				sprintf(d, "%s", dd->text[i]+1);
 				d = &output_buf[strlen(output_buf)-2];
 				}
 			else {
-				sprintf(d, "%s", defn[i]);
+				sprintf(d, "%s", dd->text[i]);
 				d = &output_buf[strlen(output_buf)-1];
 				}
 			}
@@ -816,61 +2203,152 @@ if(interactive || firstcall ) {
 	return strlen(pat);
 	}
 
-/* remainder of this source file is interface to REGEXP(3) : M Pique */
-#define INIT register char *sp = instring;
-#define GETC() *sp++
-#define PEEKC() *sp
-#define UNGETC(c) --sp
-#define RETURN(c) return
-#define ERROR(c) re_error(c)
-
-#define ESIZE 2048
-static char expbuf[ESIZE];
+/* remainder of this source file is the interface to the pattern
+ * matchers in matcher_subs.c, which replaced REGEXP(3). It keeps the
+ * old calling convention of re_compile(); re_matcher() hands out the
+ * compiled pattern for matcher_match(), which replaced reg_match().
+ * Each thread searching (-j) gets its own copy.
+ */
+static struct matcher * matcher[POOL_MAXTHREADS]; /* the current pattern */
+static int matcher_kept; /* ... belongs to the pattern cache */
 
-#include <regexp.h>
+/* the patterns an interactive sequery or a --serve client was last given,
+ * expanded and compiled, so one asked for again is neither.  A pattern
+ * is known by what was typed and by the hashes of the definition files
+ * it was expanded with, which between them determine the expansion.
+ */
+#define PATCACHE 64
+static struct patcache {
+	char * pat_in; /* NULL if unused */
+	uint64_t wild_hash, defs_hash;
+	char * pat1, * pat2;
+	int pat_len;
+	struct matcher * m[POOL_MAXTHREADS];
+	unsigned long used; /* when last wanted, for the oldest to go */
+	} patcache[PATCACHE];
+static unsigned long patcache_clock;
 
  char  *
 re_compile(instring)
 char * instring;
 {
-	compile(instring, expbuf, expbuf+ESIZE, '\0');
-	return NULL; /* OK */
-	}
-re_error(code)
- int code;
- {
- char * msg;
- extern char * pgmname;
- switch(code) {
-	case 11: msg = "Range endpoint too large."; break;
-	case 16: msg = "Bad number."; break;
-	case 25: msg = "``\\ digit'' out of range."; break;
-	case 36: msg = "Illegal or missing delimiter."; break;
-	case 41: msg = "No remembered search string."; break;
-	case 42: msg = "\\( \\) imbalance."; break;
-	case 43: msg = "Too many \\(."; break;
-	case 44: msg = "More than 2 numbers  given  in \\{ \\}."; break;
-	case 45: msg = "} expected after \\."; break;
-	case 46: msg = "First number exceeds second in \\{ \\}."; break;
-	case 49: msg = "[] imbalance."; break;
-	case 50: msg = "Regular expression too long."; break;
+	/* compile instring, return NULL if OK, otherwise an error message */
+	char * msg;
+	int t;
+
+	for(t = 0; t < nthreads; t++) {
+		if(!matcher_kept) matcher_free(matcher[t]);
+		matcher[t] = NULL;
+		}
+	matcher_kept = 0;
+	if(NULL != (msg = matcher_compile(instring, &matcher[0]))) return msg;
+	if(NULL != (msg = matcher_approx(matcher[0], approx))) {
+		matcher_free(matcher[0]);
+		matcher[0] = NULL;
+		return msg;
+		}
+	for(t = 1; t < nthreads; t++) matcher[t] = matcher_clone(matcher[0]);
+	return NULL;
 	}
-	fprintf(stderr,"%s: %s\n", pgmname, msg);
+
+ char  *
+re_score(peptide, mat, threshold)
+char * peptide;
+struct scoremat * mat;
+int threshold;
+{
+	/* as re_compile(), for the windows scoring at least "threshold"
+	 * against "peptide" with "mat" (-M)
+	 */
+	char * msg;
+	int t;
+
+	for(t = 0; t < nthreads; t++) {
+		if(!matcher_kept) matcher_free(matcher[t]);
+		matcher[t] = NULL;
+		}
+	matcher_kept = 0;
+	if(NULL != (msg = matcher_score(peptide, mat, threshold, &matcher[0])))
+		return msg;
+	for(t = 1; t < nthreads; t++) matcher[t] = matcher_clone(matcher[0]);
+	return NULL;
 	}
+
  int
- reg_match(string, p_bgn, p_len)
- char * string;
- int * p_bgn, *p_len;
+re_cached(pat_in, wd, dd, pat1, pat2, pat_len)
+char * pat_in;
+struct defs * wd, * dd; /* the definitions it would be expanded with */
+char pat1[], pat2[];
+int * pat_len;
+{
+	/* if pat_in was compiled with these definitions not long ago, make it
+	 * the current pattern again, set pat1, pat2 and *pat_len as
+	 * replace_wild() and replace_defs() would, and return 1.
+	 * Otherwise return 0.
+	 */
+	struct patcache * pc;
+	int t;
+
+	for(pc = patcache; pc < &patcache[PATCACHE]; pc++)
+		if(pc->pat_in != NULL && pc->wild_hash == wd->hash &&
+		  pc->defs_hash == dd->hash && strcmp(pc->pat_in, pat_in) == 0)
+			break;
+	if(pc == &patcache[PATCACHE]) return 0;
+
+	for(t = 0; t < nthreads; t++) {
+		if(!matcher_kept) matcher_free(matcher[t]);
+		matcher[t] = pc->m[t];
+		}
+	matcher_kept = 1;
+	pc->used = ++patcache_clock;
+	strcpy(pat1, pc->pat1);
+	strcpy(pat2, pc->pat2);
+	*pat_len = pc->pat_len;
+	return 1;
+	}
+
+ void
+re_keep(pat_in, wd, dd, pat1, pat2, pat_len)
+char * pat_in;
+struct defs * wd, * dd;
+char pat1[], pat2[];
+int pat_len;
+{
+	/* put the current pattern, just compiled by re_compile(), in the
+	 * cache in place of the one least recently wanted
+	 */
+	struct patcache * pc, * oldest;
+	int t;
+
+	if(matcher_kept) return;
+	oldest = patcache;
+	for(pc = patcache; pc < &patcache[PATCACHE]; pc++)
+		if(pc->used < oldest->used) oldest = pc;
+	pc = oldest;
+	if(pc->pat_in != NULL) {
+		free(pc->pat_in);
+		free(pc->pat1);
+		free(pc->pat2);
+		for(t = 0; t < nthreads; t++) matcher_free(pc->m[t]);
+		}
+	pc->pat_in = strdup(pat_in);
+	pc->wild_hash = wd->hash;
+	pc->defs_hash = dd->hash;
+	pc->pat1 = strdup(pat1);
+	pc->pat2 = strdup(pat2);
+	pc->pat_len = pat_len;
+	for(t = 0; t < nthreads; t++) pc->m[t] = matcher[t];
+	pc->used = ++patcache_clock;
+	matcher_kept = 1;
+	}
+
+ struct matcher *
+re_matcher(thread)
+ int thread;
  {
- extern char *loc1, *loc2, *locs;
-	if(step(string, expbuf)) {
-		/* match */
-		*p_bgn = loc1 - string;
-		*p_len = loc2 - loc1;
-		return loc2-loc1;
-		}
-	else return 0;
+	/* the compiled pattern for thread number "thread" to use */
+	return matcher[thread];
 	}
-/* End of interface to REGEXP(3). Do not put other source code here. 
+/* End of interface to the pattern matcher. Do not put other source code here. 
  * (as a matter of style...) Mike Pique 
  */
@@ -0,0 +1,696 @@
+/* sequery-bench:
+ *  time sequery on made-up sequence files of several sizes, so that a
+ *  change to it can be judged by numbers.
+ *
+ * Usage:
+ *	sequery-bench [-v] [-n RUNS] [-x SCALES] [-s SEED_FILE]
+ *	  [-d DIRECTORY] [-o RESULTS] [-b BASELINE] [-t PERCENT]
+ *
+ *  For each scale in SCALES (default "1,10,100"), a sequence file of
+ *  that many times the residues of SEED_FILE (default lib/pdbseq.asc)
+ *  is written in DIRECTORY (default /tmp/sequery-bench).  Its chains
+ *  have the lengths and residue composition of SEED_FILE's, some of
+ *  its entries are homo-oligomers (identical chains), and one chain in
+ *  eight is numbered irregularly: from an origin other than 1, with
+ *  gaps, and with insertion codes, written "(52)" and "(52A)" as
+ *  sequery-pdbseq writes them.  The same files are made every time.
+ *  The patterns are those of examples/example.patterns and 40 more made
+ *  up of residues, lower-case abbreviations from lib/sequery.defs,
+ *  wild-card digits from examples/example.wilddef.dat, and X.
+ *
+ *  Each time is the median of RUNS runs (default 3) of bin/sequery:
+ *	load		with no patterns: reading the sequence file
+ *	expand		the patterns against a single chain, less its load:
+ *			expanding and compiling them
+ *	count		the patterns with -c: load, expansion and search
+ *	full		the patterns with their matches written out
+ *	query		each pattern sent by itself to sequery --serve
+ *  and from them scan = count - load - expand, output = full - count.
+ *
+ *  The results are written to RESULTS (default standard output), a
+ *  line "NAME VALUE" for each, e.g. "10x.query_p90_ms 4.210".  Names
+ *  ending in _s, _ms and _kb (seconds, milliseconds, and kilobytes of
+ *  peak resident memory) are better smaller, those ending in _per_s
+ *  better larger.  Given a BASELINE of earlier results, each is
+ *  compared with it on the standard error, and if any is more than
+ *  PERCENT (default 10) worse the exit status is 1.  Differences of a
+ *  few milliseconds or a megabyte are not held against anything.
+ */
+#ifndef lint
+static char rcsid[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "resnum_subs.h"
+#include "seqfile_subs.h"
+
+#define MAXSCALES 16
+#define MAXPATTERNS 1024
+#define PATTERNLEN 256
+#define GENERATED 40	/* patterns made up */
+#define MAXRESULTS 512
+
+char * pgmname;
+char * sequery_home();
+
+static int verbose = 0;
+static int runs = 3;
+static char * dirname = "/tmp/sequery-bench";
+static char sequery[1024], defsfile[1024], wildfile[1024];
+static char sockname[1024+16];	/* for sequery --serve */
+
+/* what the seed file is like */
+static int * seed_len;
+static int n_seed;
+static long seed_residues;
+static char residue_table[4096];	/* residues in proportion */
+static char defined[32];		/* letters with abbreviations */
+static int n_wild;			/* wild-card lines */
+
+static char * pattern[MAXPATTERNS];
+static int n_patterns;
+
+static char * result_name[MAXRESULTS];
+static double result_value[MAXRESULTS];
+static int n_results;
+
+static uint64_t rng_state;
+
+ static uint64_t
+rng(void)
+{
+	/* xorshift64*, so the files and patterns are the same everywhere */
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 2685821657736338717ULL;
+}
+
+ static int
+pick(int n)
+{
+	/* 0..n-1 */
+	return (int) ((rng() >> 33) % n);
+}
+
+ static void
+result(char *scale, char *name, double value)
+{
+	char buf[128];
+
+	sprintf(buf, "%s%s%s", scale, *scale ? "." : "", name);
+	result_name[n_results] = strdup(buf);
+	result_value[n_results++] = value;
+}
+
+ static void
+read_seed(char *seedfilename)
+{
+	/* the chain lengths and residue composition of the seed file */
+	struct seq *seq;
+	long count[256], sofar = 0;
+	int i, c, k = 0;
+	char *s;
+
+	if((seq = seqfile_load_all(seedfilename, &n_seed)) == NULL) exit(-1);
+	if(n_seed == 0) {
+		fprintf(stderr, "%s: no sequences in %s\n", pgmname, seedfilename);
+		exit(-1);
+		}
+	memset(count, 0, sizeof(count));
+	seed_len = (int *) malloc(n_seed * sizeof(int));
+	for(i = 0; i < n_seed; i++) {
+		seed_len[i] = seq[i].len;
+		seed_residues += seq[i].len;
+		for(s = seq[i].sequence; *s != '\0'; s++) count[(unsigned char) *s]++;
+		}
+	for(c = 0; c < 256; c++) {
+		if(!isupper(c)) continue;
+		sofar += count[c];
+		while(k < sofar * (long) sizeof(residue_table) / seed_residues &&
+		  k < sizeof(residue_table))
+			residue_table[k++] = c;
+		}
+	while(k < sizeof(residue_table)) residue_table[k++] = 'A';
+}
+
+ static void
+read_definitions(void)
+{
+	/* the letters sequery.defs abbreviates, and how many wild cards */
+	char line[1024];
+	FILE *f;
+	int n = 0;
+
+	if((f = fopen(defsfile, "r")) != NULL) {
+		while(fgets(line, sizeof(line), f) != NULL)
+			if(isupper(line[0]) && isspace(line[1]) && n+1 < sizeof(defined))
+				defined[n++] = line[0];
+		fclose(f);
+		}
+	if((f = fopen(wildfile, "r")) != NULL) {
+		while(fgets(line, sizeof(line), f) != NULL && n_wild < 9)
+			if(!isspace(line[0])) n_wild++;
+		fclose(f);
+		}
+}
+
+ static void
+entry_name(int k, char *name)
+{
+	/* the k'th entry's, as PDB codes go: a digit and three of 0-9a-z */
+	static char alnum[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+	name[0] = '1' + (k / (36*36*36)) % 9;
+	name[1] = alnum[(k / (36*36)) % 36];
+	name[2] = alnum[(k / 36) % 36];
+	name[3] = alnum[k % 36];
+	name[4] = '\0';
+}
+
+ static void
+put_chain(FILE *f, char *name, char *chain, char *s, int *num, char *sfx,
+  int len)
+{
+	/* one chain in the form sequery-pdbseq writes */
+	char buf[32];
+	int i, col = 19, next = num[0], width;
+
+	fprintf(f, "%s %1s %4d%1s %5d ", name, chain, num[0], "", len);
+	for(i = 0; i < len; i++) {
+		if(num[i] != next || sfx[i] != '\0') {
+			if(sfx[i] != '\0') sprintf(buf, "(%d%c)", num[i], sfx[i]);
+			else sprintf(buf, "(%d)", num[i]);
+			width = strlen(buf);
+			col += width;
+			if(col > 68) {
+				fputs("\n                   ", f);
+				col = 19 + width;
+				}
+			fputs(buf, f);
+			/* the residue after an inserted one is numbered too */
+			next = sfx[i] != '\0' ? -999 : num[i];
+			}
+		if(col > 68) {
+			fputs("\n                   ", f);
+			col = 19;
+			}
+		putc(s[i], f);
+		col++;
+		next++;
+		}
+	putc('\n', f);
+}
+
+ static void
+fill_chain(char *s, int *num, char *sfx, int len)
+{
+	/* the residues of a chain, and their numbers: one chain in eight
+	 * starts elsewhere than 1 and has gaps and inserted residues
+	 */
+	int i, irregular = pick(8) == 0;
+
+	for(i = 0; i < len; i++) {
+		s[i] = residue_table[pick(sizeof(residue_table))];
+		sfx[i] = '\0';
+		if(i == 0) num[i] = irregular ? 1 + pick(300) : 1;
+		else if(irregular && pick(50) == 0) num[i] = num[i-1] + 2 + pick(20);
+		else if(irregular && pick(60) == 0 && sfx[i-1] < 'Z') {
+			num[i] = num[i-1];
+			sfx[i] = sfx[i-1] != '\0' ? sfx[i-1] + 1 : 'A';
+			}
+		else num[i] = num[i-1] + 1;
+		}
+}
+
+ static long
+make_db(char *filename, long target, int *p_chains)
+{
+	/* write a sequence file of about "target" residues, return how
+	 * many it has
+	 */
+	char name[8], chain[2];
+	char *s = NULL, *sfx = NULL;
+	int *num = NULL;
+	int alloc = 0, len = 0, nchains, homo, c, i;
+	long total = 0;
+	FILE *f;
+
+	if((f = fopen(filename, "w")) == NULL) {
+		perror(filename);
+		exit(-1);
+		}
+	rng_state = 0x5e90e27ULL + target;
+	*p_chains = 0;
+	for(i = 0; total < target; i++) {
+		entry_name(i, name);
+		nchains = pick(10) < 6 ? 1 : 2 + pick(3);
+		homo = nchains > 1 && pick(2) == 0;
+		for(c = 0; c < nchains; c++) {
+			if(c == 0 || !homo) {
+				len = seed_len[pick(n_seed)];
+				if(len > alloc) {
+					alloc = len;
+					s = (char *) realloc(s, alloc);
+					sfx = (char *) realloc(sfx, alloc);
+					num = (int *) realloc(num, alloc * sizeof(int));
+					}
+				fill_chain(s, num, sfx, len);
+				}
+			chain[0] = nchains == 1 && pick(2) == 0 ? '_' : 'A' + c;
+			chain[1] = '\0';
+			put_chain(f, name, chain, s, num, sfx, len);
+			total += len;
+			++*p_chains;
+			}
+		}
+	if(fclose(f) != 0) {
+		perror(filename);
+		exit(-1);
+		}
+	free(s);
+	free(sfx);
+	free(num);
+	return total;
+}
+
+ static void
+make_patterns(char *examplefilename, char *patternfilename)
+{
+	/* the examples, and more made up like them */
+	char line[PATTERNLEN], *s;
+	FILE *f;
+	int i, j, n, r;
+
+	if((f = fopen(examplefilename, "r")) != NULL) {
+		while(fgets(line, sizeof(line), f) != NULL && n_patterns < MAXPATTERNS) {
+			if((s = strchr(line, '\n')) != NULL) *s = '\0';
+			if(line[0] != '\0') pattern[n_patterns++] = strdup(line);
+			}
+		fclose(f);
+		}
+	rng_state = 0x9a77e2ULL;
+	for(i = 0; i < GENERATED && n_patterns < MAXPATTERNS; i++) {
+		n = 3 + pick(6);
+		for(j = 0; j < n; j++) {
+			r = pick(20);
+			if(r >= 11 && r < 15 && defined[0] != '\0')
+				line[j] = tolower(defined[pick(strlen(defined))]);
+			else if(r >= 15 && r < 18 && n_wild > 0)
+				line[j] = '1' + pick(n_wild);
+			else if(r >= 18 && j > 0 && j < n-1)
+				line[j] = 'X';
+			else line[j] = residue_table[pick(sizeof(residue_table))];
+			}
+		line[n] = '\0';
+		pattern[n_patterns++] = strdup(line);
+		}
+
+	if((f = fopen(patternfilename, "w")) == NULL) {
+		perror(patternfilename);
+		exit(-1);
+		}
+	for(i = 0; i < n_patterns; i++) fprintf(f, "%s\n", pattern[i]);
+	if(fclose(f) != 0) {
+		perror(patternfilename);
+		exit(-1);
+		}
+}
+
+ static void
+redirect(int fd, char *filename, int flags)
+{
+	int f;
+
+	if((f = open(filename, flags, 0666)) < 0) {
+		perror(filename);
+		_exit(127);
+		}
+	dup2(f, fd);
+	close(f);
+}
+
+ static double
+seconds(struct timeval *t0, struct timeval *t1)
+{
+	return (t1->tv_sec - t0->tv_sec) + (t1->tv_usec - t0->tv_usec) / 1e6;
+}
+
+ static pid_t
+start(char **args, char *in, char *out)
+{
+	/* start sequery with args, its standard input from "in" and its
+	 * output to "out"
+	 */
+	pid_t pid;
+
+	if((pid = fork()) < 0) {
+		perror("fork");
+		exit(-1);
+		}
+	if(pid == 0) {
+		redirect(0, in, O_RDONLY);
+		redirect(1, out, O_WRONLY|O_CREAT|O_TRUNC);
+		redirect(2, "/dev/null", O_WRONLY);
+		execv(args[0], args);
+		_exit(127);
+		}
+	return pid;
+}
+
+ static double
+run(char **args, char *in, char *out, long *p_kb)
+{
+	/* run sequery to the end, return the seconds it took and set *p_kb
+	 * to its peak resident memory
+	 */
+	struct timeval t0, t1;
+	struct rusage ru;
+	int status;
+	pid_t pid;
+
+	gettimeofday(&t0, NULL);
+	pid = start(args, in, out);
+	if(wait4(pid, &status, 0, &ru) < 0 || !WIFEXITED(status) ||
+	  WEXITSTATUS(status) != 0) {
+		fprintf(stderr, "%s: %s failed\n", pgmname, args[0]);
+		exit(-1);
+		}
+	gettimeofday(&t1, NULL);
+	*p_kb = ru.ru_maxrss;
+	return seconds(&t0, &t1);
+}
+
+ static int
+compare_doubles(const void *p, const void *q)
+{
+	double a = *(double *) p, b = *(double *) q;
+
+	return a < b ? -1 : a > b;
+}
+
+ static double
+median_run(char *db, char *option, char *in, long *p_kb)
+{
+	/* the median time of "runs" runs of sequery on db with the given
+	 * option (or none); *p_kb is set to the most memory any took
+	 */
+	char *args[16];
+	double t[64];
+	long kb;
+	int i, n = 0;
+
+	args[n++] = sequery;
+	args[n++] = "-q";
+	args[n++] = "-o";
+	args[n++] = "-";
+	args[n++] = "-s";
+	args[n++] = db;
+	args[n++] = "-d";
+	args[n++] = defsfile;
+	args[n++] = "-w";
+	args[n++] = wildfile;
+	if(option != NULL) args[n++] = option;
+	args[n] = NULL;
+
+	*p_kb = 0;
+	for(i = 0; i < runs; i++) {
+		t[i] = run(args, in, "/dev/null", &kb);
+		if(kb > *p_kb) *p_kb = kb;
+		}
+	qsort(t, runs, sizeof(double), compare_doubles);
+	return t[runs/2];
+}
+
+ static void
+serve_queries(char *scale, char *db, long residues)
+{
+	/* send each pattern by itself to sequery --serve, "runs" times,
+	 * and note how long each took
+	 */
+	char line[PATTERNLEN+2], buf[1<<16];
+	char *args[16];
+	struct sockaddr_un addr;
+	struct timeval t0, t1;
+	struct rusage ru;
+	double *lat, sum = 0;
+	int fd, status, n = 0, r, i;
+	pid_t pid;
+	FILE *in;
+
+	unlink(sockname);
+	args[0] = sequery;
+	args[1] = "-s";
+	args[2] = db;
+	args[3] = "-d";
+	args[4] = defsfile;
+	args[5] = "-w";
+	args[6] = wildfile;
+	args[7] = "--serve";
+	args[8] = sockname;
+	args[9] = NULL;
+
+	/* it is loaded when it answers */
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, sockname);
+	gettimeofday(&t0, NULL);
+	pid = start(args, "/dev/null", "/dev/null");
+	for(;;) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) break;
+		close(fd);
+		if(waitpid(pid, &status, WNOHANG) == pid) {
+			fprintf(stderr, "%s: %s --serve failed\n", pgmname, sequery);
+			exit(-1);
+			}
+		usleep(1000);
+		}
+	gettimeofday(&t1, NULL);
+	result(scale, "serve_load_s", seconds(&t0, &t1));
+
+	in = fdopen(fd, "r");
+	lat = (double *) malloc(runs * n_patterns * sizeof(double));
+	for(r = 0; r < runs; r++)
+		for(i = 0; i < n_patterns; i++) {
+			sprintf(line, "%s\n", pattern[i]);
+			gettimeofday(&t0, NULL);
+			if(write(fd, line, strlen(line)) < 0) {
+				perror(sockname);
+				exit(-1);
+				}
+			/* the answer ends with an empty line */
+			while(fgets(buf, sizeof(buf), in) != NULL && strcmp(buf, "\n") != 0) ;
+			gettimeofday(&t1, NULL);
+			lat[n] = seconds(&t0, &t1);
+			sum += lat[n++];
+			}
+	fclose(in);
+	kill(pid, SIGTERM);
+	wait4(pid, &status, 0, &ru);
+	unlink(sockname);
+
+	qsort(lat, n, sizeof(double), compare_doubles);
+	result(scale, "query_p50_ms", 1000 * lat[(int) (0.50 * (n-1) + 0.5)]);
+	result(scale, "query_p90_ms", 1000 * lat[(int) (0.90 * (n-1) + 0.5)]);
+	result(scale, "query_p99_ms", 1000 * lat[(int) (0.99 * (n-1) + 0.5)]);
+	result(scale, "query_max_ms", 1000 * lat[n-1]);
+	result(scale, "scan_residues_per_s", sum > 0 ? residues * (double) n / sum : 0);
+	result(scale, "serve_kb", ru.ru_maxrss);
+	free(lat);
+}
+
+ static int
+ends(char *name, char *suffix)
+{
+	int n = strlen(name), k = strlen(suffix);
+
+	return n >= k && strcmp(name + n - k, suffix) == 0;
+}
+
+ static int
+compare_baseline(char *filename, double percent)
+{
+	/* report each result against the baseline's, return how many are
+	 * worse by more than "percent"
+	 */
+	char line[256], name[128];
+	double base, value, change, slack;
+	int i, worse = 0, bad;
+	FILE *f;
+
+	if((f = fopen(filename, "r")) == NULL) {
+		fprintf(stderr, "%s: no baseline %s (copy results there to make one)\n",
+		  pgmname, filename);
+		return 0;
+		}
+	fprintf(stderr, "%-28s %14s %14s %8s\n", "", "baseline", "now", "change");
+	while(fgets(line, sizeof(line), f) != NULL) {
+		if(line[0] == '#' || sscanf(line, "%127s %lf", name, &base) != 2)
+			continue;
+		for(i = 0; i < n_results; i++)
+			if(strcmp(result_name[i], name) == 0) break;
+		if(i == n_results) continue;
+		value = result_value[i];
+		change = base != 0 ? 100 * (value - base) / base : 0;
+
+		/* the sizes of the files and corpus must be the same */
+		if(!ends(name, "_s") && !ends(name, "_ms") && !ends(name, "_kb")) {
+			if(value != base)
+				fprintf(stderr, "%s: %s was %g, now %g: not comparable\n",
+				  pgmname, name, base, value);
+			continue;
+			}
+		if(ends(name, "_per_s")) bad = change < -percent;
+		else {
+			slack = ends(name, "_kb") ? 1024 : ends(name, "_ms") ? 5 : 0.005;
+			bad = change > percent && value - base > slack;
+			}
+		fprintf(stderr, "%-28s %14.6g %14.6g %+7.1f%%%s\n",
+		  name, base, value, change, bad ? "  worse" : "");
+		worse += bad;
+		}
+	fclose(f);
+	return worse;
+}
+
+ int
+main(int argc, char **argv)
+{
+	extern char *optarg;
+	extern int optind;
+	char *scales = "1,10,100", *seedfilename = NULL;
+	char *resultfilename = NULL, *baselinefilename = NULL;
+	char db[1024+32], patternfilename[1024+32], scale[32], *s;
+	double percent = 10, load, count, full, expand;
+	long residues, kb;
+	int scale_n[MAXSCALES], n_scales = 0, chains, errflg = 0, c, k;
+	FILE *out = stdout;
+
+	pgmname = argv[0];
+	while((c = getopt(argc, argv, "vn:x:s:d:o:b:t:")) != -1) switch(c) {
+ case 'v':
+	verbose = 1; break;
+ case 'n':
+	runs = atoi(optarg);
+	if(runs < 1) runs = 1;
+	if(runs > 64) runs = 64;
+	break;
+ case 'x':
+	scales = optarg; break;
+ case 's':
+	seedfilename = optarg; break;
+ case 'd':
+	dirname = optarg; break;
+ case 'o':
+	resultfilename = optarg; break;
+ case 'b':
+	baselinefilename = optarg; break;
+ case 't':
+	percent = atof(optarg); break;
+ default:
+	errflg = 1; break;
+	}
+	for(s = scales; *s != '\0' && n_scales < MAXSCALES; ) {
+		if((scale_n[n_scales++] = strtol(s, &s, 10)) <= 0) errflg = 1;
+		if(*s == ',') s++;
+		else if(*s != '\0') {
+			errflg = 1;
+			break;
+			}
+		}
+	if(errflg || optind != argc) {
+		fprintf(stderr, "usage: %s [-v] [-n runs] [-x scale,...] [-s seed_file]\n",
+		  pgmname);
+		fprintf(stderr, "       [-d directory] [-o results] [-b baseline] [-t percent]\n");
+		exit(2);
+		}
+
+	strcpy(sequery, sequery_home("bin/sequery"));
+	strcpy(defsfile, sequery_home("lib/sequery.defs"));
+	strcpy(wildfile, sequery_home("examples/example.wilddef.dat"));
+	if(seedfilename == NULL) seedfilename = strdup(sequery_home("lib/pdbseq.asc"));
+	if(access(sequery, X_OK) != 0) {
+		perror(sequery);
+		exit(-1);
+		}
+	if(mkdir(dirname, 0777) != 0 && access(dirname, W_OK) != 0) {
+		perror(dirname);
+		exit(-1);
+		}
+	/* as sequery would refuse it, before anything is timed */
+	sprintf(sockname, "%s/bench.sock", dirname);
+	if(strlen(sockname) >= sizeof(((struct sockaddr_un *) 0)->sun_path)) {
+		fprintf(stderr, "%s: socket name %s is too long\n",
+		  pgmname, sockname);
+		exit(-1);
+		}
+
+	read_seed(seedfilename);
+	read_definitions();
+	sprintf(patternfilename, "%s/patterns", dirname);
+	make_patterns(sequery_home("examples/example.patterns"), patternfilename);
+	result("", "patterns", n_patterns);
+
+	/* expanding and compiling: the patterns against one chain */
+	sprintf(db, "%s/bench-tiny.asc", dirname);
+	(void) make_db(db, 1, &chains);
+	load = median_run(db, NULL, "/dev/null", &kb);
+	count = median_run(db, "-c", patternfilename, &kb);
+	expand = count > load ? count - load : 0;
+	result("", "expand_s", expand);
+
+	for(k = 0; k < n_scales; k++) {
+		sprintf(scale, "%dx", scale_n[k]);
+		sprintf(db, "%s/bench-%s.asc", dirname, scale);
+		residues = make_db(db, scale_n[k] * seed_residues, &chains);
+		if(verbose) fprintf(stderr, "%s: %s, %ld residues in %d chains\n",
+		  pgmname, db, residues, chains);
+		result(scale, "residues", residues);
+		result(scale, "chains", chains);
+
+		load = median_run(db, NULL, "/dev/null", &kb);
+		result(scale, "load_s", load);
+		result(scale, "load_kb", kb);
+		count = median_run(db, "-c", patternfilename, &kb);
+		result(scale, "count_s", count);
+		result(scale, "scan_s", count > load + expand ? count - load - expand : 0);
+		full = median_run(db, NULL, patternfilename, &kb);
+		result(scale, "full_s", full);
+		result(scale, "output_s", full > count ? full - count : 0);
+		result(scale, "full_kb", kb);
+		serve_queries(scale, db, residues);
+		}
+
+	if(resultfilename != NULL && (out = fopen(resultfilename, "w")) == NULL) {
+		perror(resultfilename);
+		exit(-1);
+		}
+	fprintf(out, "# sequery-bench: %d runs each, seed %s\n", runs, seedfilename);
+	for(k = 0; k < n_results; k++)
+		fprintf(out, "%s %.6g\n", result_name[k], result_value[k]);
+	if(out != stdout && fclose(out) != 0) {
+		perror(resultfilename);
+		exit(-1);
+		}
+
+	if(baselinefilename != NULL && compare_baseline(baselinefilename, percent) > 0)
+		return 1;
+	return 0;
+}
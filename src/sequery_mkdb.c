@@ -0,0 +1,263 @@
+/* sequery-mkdb:
+ *  compile an ASCII sequence file (pdbseq.asc, pdbComplete.asc, ...) into
+ *  a binary image that sequery and matchextractpdb map at start-up
+ *  instead of re-reading the ASCII file.
+ *
+ * Usage:
+ *	sequery-mkdb [-v] [-k] [-f] SEQUENCE_FILE [IMAGE_FILE]
+ *	sequery-mkdb [-v] -a DELTA_FILE SEQUENCE_FILE
+ *	sequery-mkdb [-v] -c SEQUENCE_FILE
+ *
+ *  IMAGE_FILE defaults to SEQUENCE_FILE with a trailing ".asc" replaced
+ *  by ".sqdb" (or ".sqdb" appended).  The image is then given to sequery
+ *  exactly like an ASCII file:  sequery -s lib/pdbseq.sqdb
+ *
+ *  -k also writes a k-mer index of the image, IMAGE_FILE.kix, which
+ *  sequery uses to look for rare patterns only where they can occur
+ *  (see kix_subs.c).  -f writes an FM-index, IMAGE_FILE.fmi, with
+ *  which sequery finds short patterns in time depending only on how
+ *  often they occur (see fmi_subs.c).  Given an image as SEQUENCE_FILE,
+ *  -k and -f write just its indexes, SEQUENCE_FILE.kix and .fmi.
+ *
+ *  -a appends the chains and tombstones of DELTA_FILE to the delta
+ *  file of SEQUENCE_FILE (SEQUENCE_FILE.delta, see delta_subs.h) as a
+ *  new segment, which sequery then applies as it reads SEQUENCE_FILE;
+ *  SEQUENCE_FILE may be an ASCII file or an image.  -c compacts the
+ *  database: the segments are merged into SEQUENCE_FILE (and any
+ *  indexes of it made again) and the delta file removed.  An ASCII file
+ *  keeps its records just as they were written.  An image made from an
+ *  ASCII file with delta segments has them merged in.
+ *
+ *  Each file is written under a temporary name and renamed into place,
+ *  so it can be rebuilt while sequery --serve is using the old one.
+ *
+ *  Images are specific to the byte order of the machine that made them,
+ *  and must be rebuilt whenever their ASCII source changes; sequery
+ *  ignores an index that no longer matches its image.
+ */
+#ifndef lint
+static char rcsid[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "resnum_subs.h"
+#include "seqdb_subs.h"
+#include "seqfile_subs.h"
+#include "regex_subs.h"
+#include "kix_subs.h"
+#include "fmi_subs.h"
+#include "delta_subs.h"
+
+char * pgmname;
+
+/* the ASCII sequence file being compacted, for write_text() */
+static char *compact_text;
+static long compact_size;
+static struct delta *compact_delta;
+
+ static int
+write_image(FILE *out, char *seqfilename, struct seq *seq, int n_seqs)
+{
+	return seqdb_write(out, seq, n_seqs);
+}
+
+ static int
+write_text(FILE *out, char *seqfilename, struct seq *seq, int n_seqs)
+{
+	return delta_write_text(out, compact_delta, compact_text, compact_size);
+}
+
+ static int
+exists(char *filename)
+{
+	struct stat st;
+
+	return stat(filename, &st) == 0;
+}
+
+ static void
+write_file(char *filename,
+  int (*writer)(FILE *out, char *imagefilename, struct seq *seq, int n_seqs),
+  char *imagefilename, struct seq *seq, int n_seqs, int verbose)
+{
+	/* write "filename" with writer(), under a temporary name that is
+	 * then renamed: a running sequery that has the old file mapped
+	 * keeps it, and one starting up never sees half a file
+	 */
+	char tmpfilename[1024+16];
+	FILE *f;
+
+	sprintf(tmpfilename, "%s.new", filename);
+	if((f = fopen(tmpfilename, "w")) == NULL) {
+		perror(tmpfilename);
+		exit(-1);
+		}
+	if((*writer)(f, imagefilename, seq, n_seqs) != 0 || fclose(f) != 0 ||
+	  rename(tmpfilename, filename) != 0) {
+		perror(filename);
+		unlink(tmpfilename);
+		exit(-1);
+		}
+	if(verbose) printf("wrote %s\n", filename);
+}
+
+ static void
+compact_database(char *seqfilename, int verbose)
+{
+	/* -c: merge the delta segments of "seqfilename" into it */
+	char deltafilename[1024+16], indexfilename[1024+8];
+	struct stat st, now;
+	struct seq *seq;
+	FILE *f;
+	int n_seqs, n_segs = 0;
+
+	sprintf(deltafilename, "%s%s", seqfilename, DELTA_SUFFIX);
+	if(stat(deltafilename, &st) < 0 ||
+	  (compact_delta = delta_open(seqfilename, &n_segs)) == NULL) {
+		if(stat(seqfilename, &now) < 0) {
+			perror(seqfilename);
+			exit(-1);
+			}
+		if(verbose) printf("%s has no delta segments\n", seqfilename);
+		if(n_segs < 0) exit(-1);
+		return;
+		}
+
+	if(seqdb_is_image(seqfilename)) {
+		if((seq = seqfile_load_all(seqfilename, &n_seqs)) == NULL) exit(-1);
+		write_file(seqfilename, write_image, seqfilename, seq, n_seqs, verbose);
+		sprintf(indexfilename, "%s.kix", seqfilename);
+		if(exists(indexfilename))
+			write_file(indexfilename, kix_write, seqfilename, seq, n_seqs, verbose);
+		sprintf(indexfilename, "%s.fmi", seqfilename);
+		if(exists(indexfilename))
+			write_file(indexfilename, fmi_write, seqfilename, seq, n_seqs, verbose);
+		}
+	else {
+		if((f = fopen(seqfilename, "r")) == NULL || fstat(fileno(f), &now) < 0) {
+			perror(seqfilename);
+			exit(-1);
+			}
+		compact_size = now.st_size;
+		compact_text = malloc(compact_size + 1);
+		if(compact_size > 0 && fread(compact_text, compact_size, 1, f) != 1) {
+			perror(seqfilename);
+			exit(-1);
+			}
+		fclose(f);
+		write_file(seqfilename, write_text, seqfilename, NULL, 0, verbose);
+		}
+	if(verbose) printf("merged %d delta segments into %s\n", n_segs, seqfilename);
+
+	/* applying the segments again would change nothing, so a delta file
+	 * appended to meanwhile is left for next time rather than lost
+	 */
+	if(stat(deltafilename, &now) == 0 && now.st_ino == st.st_ino &&
+	  now.st_mtime == st.st_mtime && now.st_size == st.st_size) {
+		if(unlink(deltafilename) != 0) perror(deltafilename);
+		else if(verbose) printf("removed %s\n", deltafilename);
+		}
+	else fprintf(stderr, "%s: %s changed while compacting, left in place\n",
+	  pgmname, deltafilename);
+}
+
+ int
+main(int argc, char **argv)
+{
+	extern char *optarg;
+	extern int optind;
+	char imagefilename[1024];
+	char *seqfilename, *deltafilename = NULL;
+	char indexfilename[1024+8];
+	struct seq *seq;
+	int n_seqs, n;
+	int verbose = 0;
+	int kmers = 0, fmindex = 0, compact = 0;
+	int errflg = 0;
+	int c;
+
+	pgmname = argv[0];
+	while((c = getopt(argc, argv, "vkfa:c")) != -1) switch(c) {
+ case 'v':
+	verbose = 1; break;
+ case 'k':
+	kmers = 1; break;
+ case 'f':
+	fmindex = 1; break;
+ case 'a':
+	deltafilename = optarg; break;
+ case 'c':
+	compact = 1; break;
+ default:
+	errflg = 1; break;
+	}
+	if((deltafilename != NULL || compact) &&
+	  (kmers || fmindex || argc - optind != 1 || (deltafilename != NULL && compact)))
+		errflg = 1;
+	if(errflg || argc - optind < 1 || argc - optind > 2) {
+		fprintf(stderr, "usage: %s [-v] [-k] [-f] sequence_file [image_file]\n",
+		  pgmname);
+		fprintf(stderr, "       %s [-v] -a delta_file sequence_file\n", pgmname);
+		fprintf(stderr, "       %s [-v] -c sequence_file\n", pgmname);
+		exit(2);
+		}
+	seqfilename = argv[optind];
+	/* the names made from these, with ".sqdb", ".delta", ".new" and
+	 * so on, must fit in the buffers they are made in
+	 */
+	if(strlen(seqfilename) + 5 >= sizeof(imagefilename) ||
+	  (argc - optind == 2 && strlen(argv[optind+1]) >= sizeof(imagefilename))) {
+		fprintf(stderr, "%s: file name too long\n", pgmname);
+		exit(2);
+		}
+
+	if(deltafilename != NULL) {
+		if((n = delta_append(seqfilename, deltafilename)) < 0) exit(-1);
+		if(verbose) printf("appended %s to %s%s as segment %d\n",
+		  deltafilename, seqfilename, DELTA_SUFFIX, n);
+		return 0;
+		}
+	if(compact) {
+		compact_database(seqfilename, verbose);
+		return 0;
+		}
+
+	if(argc - optind == 2) strcpy(imagefilename, argv[optind+1]);
+	else {
+		n = strlen(seqfilename);
+		strcpy(imagefilename, seqfilename);
+		if(n > 4 && 0 == strcmp(seqfilename+n-4, ".asc"))
+			imagefilename[n-4] = '\0';
+		strcat(imagefilename, ".sqdb");
+		}
+
+	if(seqdb_is_image(seqfilename)) {
+		if((kmers || fmindex) && argc - optind == 1) {
+			/* index an existing image */
+			strcpy(imagefilename, seqfilename);
+			if((seq = seqfile_load(seqfilename, &n_seqs)) == NULL) exit(-1);
+			goto indexes;
+			}
+		fprintf(stderr, "%s: %s is already an image\n", pgmname, seqfilename);
+		exit(-1);
+		}
+	if((seq = seqfile_load_all(seqfilename, &n_seqs)) == NULL) exit(-1);
+	if(verbose) printf("read %d sequences from %s\n", n_seqs, seqfilename);
+
+	write_file(imagefilename, write_image, imagefilename, seq, n_seqs, verbose);
+
+indexes:
+	/* after the image is complete, so the indexes record its final time */
+	sprintf(indexfilename, "%s.kix", imagefilename);
+	if(kmers) write_file(indexfilename, kix_write, imagefilename, seq, n_seqs, verbose);
+	sprintf(indexfilename, "%s.fmi", imagefilename);
+	if(fmindex) write_file(indexfilename, fmi_write, imagefilename, seq, n_seqs, verbose);
+	return 0;
+}
@@ -0,0 +1,570 @@
+/* sequery-pdbseq:
+ *  build a sequence file (pdbseq.asc format), an image of one, or both,
+ *  straight from PDB coordinate files, in place of share/genpdbseq and
+ *  share/genpdbselectseq.awk.
+ *
+ * Usage:
+ *	sequery-pdbseq [-v] [-j THREADS] [-l LIST_FILE] [-a ASCII_FILE]
+ *	  [-i IMAGE_FILE] [PDB_FILE ...]
+ *	sequery-pdbseq -d [-v] [-j THREADS] [-l LIST_FILE] [-a DELTA_FILE]
+ *	  [PDB_FILE ...]
+ *
+ *  The PDB files are those named as arguments and then, with -l, those
+ *  listed one per line in LIST_FILE ("-" for standard input), so a
+ *  whole PDB mirror can be given without expanding "*".  A line of the
+ *  list may give a chain ID after the file name ("_" for a blank one);
+ *  then only that chain is taken from the file, as genpdbselectseq.awk
+ *  does for the chains of a PDB_select list.
+ *
+ *  The sequence file is written to ASCII_FILE, and an image of it, as
+ *  sequery-mkdb would make, to IMAGE_FILE; with neither, the sequence
+ *  file goes to standard output.  -j reads and converts that many PDB
+ *  files at once (default 1).  The output is the same, byte for byte,
+ *  as that of
+ *	genpdbseq PDB_FILE ... > ASCII_FILE
+ *  with the files in the order given, whatever the number of threads.
+ *
+ *  -d writes instead a delta segment for sequery-mkdb -a, so that only
+ *  the PDB files that have changed need be read: the chains of each
+ *  file come after a tombstone for its entry, "-NAME" (or for just the
+ *  chain, if the list selects one), and replace what the database had.
+ *  A line "-NAME [CHAIN]" of the list, for an entry made obsolete, is
+ *  copied as it is.
+ *
+ * Each file is mapped, its CA records gathered into chains and the
+ * chains written out exactly as the nawk program in genpdbseq does,
+ * including its handling of alternate locations, duplicate chains and
+ * residue numbers given as "(100A)".  Where that program leans on awk
+ * (numbers read with strtod(3), missing columns read as ""), so does
+ * this one.
+ */
+#ifndef lint
+static char rcsid[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "resnum_subs.h"
+#include "seqdb_subs.h"
+#include "seqfile_subs.h"
+#include "pdbx_subs.h"
+#include "pool_subs.h"
+
+char * pgmname;
+
+/* one-letter codes of the residue names, as in genpdbseq's table t[];
+ * each name is known in lower case, capitalized and upper case
+ */
+static struct { char *name; char code; } restab[] = {
+	{"ala",'A'}, {"arg",'R'}, {"asn",'N'}, {"asp",'D'}, {"cys",'C'},
+	{"gln",'Q'}, {"glu",'E'}, {"gly",'G'}, {"his",'H'}, {"hip",'H'},
+	{"hid",'H'}, {"hie",'H'}, {"ile",'I'}, {"ilu",'I'}, {"leu",'L'},
+	{"lys",'K'}, {"met",'M'}, {"phe",'F'}, {"pro",'P'}, {"ser",'S'},
+	{"thr",'T'}, {"trp",'W'}, {"tyr",'Y'}, {"val",'V'},
+	{"abu",'X'}, {"acd",'U'}, {"alb",'X'}, {"ali",'U'}, {"aro",'U'},
+	{"asx",'B'}, {"bas",'U'}, {"bet",'X'}, {"cyh",'C'}, {"csh",'C'},
+	{"css",'C'}, {"cyx",'C'}, {"glx",'Z'}, {"aib",'X'}, {"unk",'U'},
+	{"ace",'J'}, {"for",'J'}, {"hse",'X'}, {"hyl",'X'}, {"hyp",'X'},
+	{"orn",'X'}, {"pca",'X'}, {"pga",'X'}, {"pr0",'P'}, {"prz",'P'},
+	{"sar",'X'}, {"tau",'X'}, {"thy",'X'}, {"try",'W'},
+	};
+#define NRESTAB (sizeof(restab)/sizeof(restab[0]))
+
+static struct rescode { uint32_t key; char code; } rescode[3*NRESTAB];
+static int n_rescodes;
+
+ static uint32_t
+res_key(char *s)
+{
+	return (unsigned char) s[0] << 16 | (unsigned char) s[1] << 8 |
+	  (unsigned char) s[2];
+}
+
+ static int
+rescode_cmp(const void *a, const void *b)
+{
+	uint32_t ka = ((struct rescode *) a)->key, kb = ((struct rescode *) b)->key;
+
+	return ka < kb ? -1 : ka > kb;
+}
+
+ static void
+make_rescodes(void)
+{
+	char form[3][4];
+	int i, f, k;
+
+	for(i = 0; i < NRESTAB; i++) {
+		for(k = 0; k < 4; k++) {
+			char c = restab[i].name[k];
+
+			form[0][k] = c;
+			form[1][k] = k == 0 && c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+			form[2][k] = c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+			}
+		for(f = 0; f < 3; f++) {
+			if(f > 0 && strcmp(form[f], form[f-1]) == 0) continue;
+			rescode[n_rescodes].key = res_key(form[f]);
+			rescode[n_rescodes++].code = restab[i].code;
+			}
+		}
+	qsort(rescode, n_rescodes, sizeof(struct rescode), rescode_cmp);
+}
+
+ static int
+one_letter(char *type)
+{
+	/* code of residue name "type", 'U' if unknown as in genpdbseq */
+	struct rescode key, *rc;
+
+	if(strlen(type) != 3) return 'U';
+	key.key = res_key(type);
+	rc = (struct rescode *) bsearch(&key, rescode, n_rescodes,
+	  sizeof(struct rescode), rescode_cmp);
+	return rc == NULL ? 'U' : rc->code;
+}
+
+/* text being written for one PDB file */
+struct text {
+	char *s;
+	size_t len, max;
+	};
+
+ static void
+put_text(struct text *t, char *s, size_t len)
+{
+	if(t->len + len > t->max) {
+		while(t->len + len > t->max) t->max = t->max ? 2 * t->max : 4096;
+		t->s = realloc(t->s, t->max);
+		}
+	memcpy(t->s + t->len, s, len);
+	t->len += len;
+}
+
+ static void
+put_str(struct text *t, char *s)
+{
+	put_text(t, s, strlen(s));
+}
+
+ static long
+awk_int(double d)
+{
+	/* d as awk's printf %d has it */
+	if(d >= INT_MAX) return INT_MAX;
+	if(d > -INT_MAX) return (long) d;
+	return -INT_MAX;
+}
+
+ static int
+awk_ne(double a, double b)
+{
+	/* a != b as awk compares numbers, to which NaN equals anything */
+	return a < b || a > b;
+}
+
+ static char *
+awk_str(double d, char *buf)
+{
+	/* d as awk turns a number into a string */
+	if(d > -LONG_MAX && d < LONG_MAX && d == (long) d) sprintf(buf, "%ld", (long) d);
+	else sprintf(buf, "%.6g", d);
+	return buf;
+}
+
+/* what genpdbseq gathers for each "chain" of a file: the residues of
+ * its CA records, indexed from 1 (0 is used only by the rare alternate
+ * location at the start of a chain)
+ */
+struct chain {
+	int id;		/* column 22 when last seen, or -1 if the record had none */
+	int len;	/* residues */
+	int max;	/* room in the arrays */
+	int n_set;	/* residues 0..n_set-1 have been set at some time */
+	double *num;	/* residue number, columns 23-26 as awk reads them */
+	char *suffix;	/* column 27, or '\0' if the record had none */
+	char (*type)[4];/* residue name, columns 18-20 */
+	};
+
+struct file {
+	char *filename;
+	int select;	/* the one chain wanted, ' ' for blank, or -1 for all */
+	int removed;	/* -d: not a file but an entry to remove, "-NAME [CHAIN]" */
+	struct text out;
+	int failed;
+	};
+
+static int delta_mode;	/* -d: write a delta segment for sequery-mkdb -a */
+
+ static struct chain *
+get_chain(struct chain **chains, int *n_alloc, int k)
+{
+	if(k >= *n_alloc) {
+		int n = *n_alloc;
+
+		*n_alloc = k + 1 > 2 * n ? k + 1 : 2 * n;
+		*chains = (struct chain *) realloc(*chains, *n_alloc * sizeof(struct chain));
+		memset(*chains + n, 0, (*n_alloc - n) * sizeof(struct chain));
+		}
+	return &(*chains)[k];
+}
+
+ static void
+column(char *line, int len, int col, int width, char *buf)
+{
+	/* awk's substr(line, col, width) into buf */
+	int n = 0;
+
+	for(col--; n < width && col < len; col++) buf[n++] = line[col];
+	buf[n] = '\0';
+}
+
+ static void
+convert(struct file *fp)
+{
+	/* gather the CA records of one PDB file and write its chains */
+	struct chain *chains = NULL, *cp, *cq;
+	int n_alloc = 0, nchains = 0, chain = -1, res_index = -1;
+	char *text, *line, *end, buf[64], name[8], idstr[2], sufstr[2];
+	struct stat st;
+	size_t size;
+	int len, col, c, j, i, width, unique, id;
+	double rnum, prev, next_res_num;
+
+	if((text = pdbx_map_file(fp->filename, &st)) == NULL) {
+		fp->failed = 1;
+		return;
+		}
+	size = st.st_size;
+	for(line = text; line < text + size; line = end + 1) {
+		if((end = memchr(line, '\n', text + size - line)) == NULL) end = text + size;
+		len = end - line;
+
+		if((len >= 3 && strncmp(line, "TER", 3) == 0) ||
+		  (len >= 6 && strncmp(line, "ENDMDL", 6) == 0)) {
+			nchains++;
+			continue;
+			}
+		if(len < 16 || strncmp(line, "ATOM", 4) != 0 ||
+		  strncmp(line + 12, " CA ", 4) != 0)
+			continue;
+		c = len >= 22 ? (unsigned char) line[21] : -1;
+		if(fp->select >= 0 && c != fp->select) continue;
+		if(c != chain) {
+			nchains++;
+			chain = c;
+			}
+		cp = get_chain(&chains, &n_alloc, nchains);
+		cp->id = chain;
+		column(line, len, 23, 4, buf);
+		rnum = strtod(buf, NULL);
+
+		/* handle rare multiple CA occupancies; genpdbseq compares with
+		 * res_num[chain,res_index], which is a residue of chain number
+		 * "chain" only if the chain ID is a digit, and 0 otherwise
+		 */
+		prev = 0;
+		if(chain >= '0' && chain <= '9' && res_index >= 0) {
+			cq = get_chain(&chains, &n_alloc, chain - '0');
+			if(res_index < cq->n_set) prev = cq->num[res_index];
+			cp = &chains[nchains];
+			}
+		if((len < 17 || line[16] != ' ') && !awk_ne(prev, rnum)) cp->len--;
+
+		res_index = ++cp->len;
+		if(res_index >= cp->max) {
+			cp->max = cp->max ? 2 * cp->max : 256;
+			cp->num = (double *) realloc(cp->num, cp->max * sizeof(double));
+			cp->suffix = realloc(cp->suffix, cp->max);
+			cp->type = (char (*)[4]) realloc(cp->type, cp->max * sizeof(*cp->type));
+			}
+		while(cp->n_set < res_index) { /* set only by the decrement above */
+			cp->num[cp->n_set] = 0;
+			cp->suffix[cp->n_set] = '\0';
+			cp->type[cp->n_set++][0] = '\0';
+			}
+		if(cp->n_set == res_index) cp->n_set++;
+		cp->num[res_index] = rnum;
+		column(line, len, 18, 3, cp->type[res_index]);
+		column(line, len, 27, 1, buf);
+		cp->suffix[res_index] = buf[0];
+		}
+	pdbx_unmap_file(text, size);
+
+	/* entry name: substr(FILENAME,length(FILENAME)-7,4) */
+	len = strlen(fp->filename);
+	i = len - 7;
+	j = i + 3;
+	if(i < 1) i = 1;
+	if(j > len) j = len;
+	for(col = 0; i <= j; i++) name[col++] = fp->filename[i-1];
+	name[col] = '\0';
+
+	/* in a delta, the chains replace all those of the entry (or the
+	 * one chain selected) that the database had before
+	 */
+	if(delta_mode) {
+		put_str(&fp->out, "-");
+		put_str(&fp->out, name);
+		if(fp->select >= 0) {
+			buf[0] = ' ';
+			buf[1] = fp->select == ' ' ? '_' : fp->select;
+			put_text(&fp->out, buf, 2);
+			}
+		put_str(&fp->out, "\n");
+		}
+
+	for(c = 1; c <= nchains && c < n_alloc; c++) {
+		cp = &chains[c];
+		if(cp->len == 0) continue;
+		/* remove duplicate chains (same numbering) */
+		unique = 1;
+		for(j = 1; j < c && unique; j++) {
+			cq = &chains[j];
+			if(cq->len != cp->len) continue;
+			for(i = 1; i <= cp->len; i++)
+				if(awk_ne(cp->num[i], cq->num[i]) || cp->suffix[i] != cq->suffix[i])
+					break;
+			if(i > cp->len) unique = 0;
+			}
+		if(!unique) continue;
+
+		/* chain ID " " is written as "_", and none at all as " " */
+		id = cp->id == ' ' ? '_' : cp->id;
+		idstr[0] = id < 0 ? '\0' : id;
+		idstr[1] = '\0';
+		sufstr[0] = cp->suffix[1];
+		sufstr[1] = '\0';
+		put_str(&fp->out, name);
+		sprintf(buf, " %1s %4ld%1s %5d ", idstr, awk_int(cp->num[1]), sufstr,
+		  cp->len);
+		put_str(&fp->out, buf);
+
+		next_res_num = cp->num[1];
+		col = 19;
+		for(i = 1; i <= cp->len; i++) {
+			if(awk_ne(next_res_num, cp->num[i]) || cp->suffix[i] != ' ') {
+				char numbuf[64], suffix[2];
+
+				next_res_num = cp->num[i];
+				suffix[0] = cp->suffix[i] == ' ' ? '\0' : cp->suffix[i];
+				suffix[1] = '\0';
+				width = 2 + strlen(awk_str(next_res_num, numbuf)) + strlen(suffix);
+				col += width;
+				if(col > 68) {
+					put_str(&fp->out, "\n                   ");
+					col = 19 + width;
+					}
+				sprintf(numbuf, "(%ld%s)", awk_int(next_res_num), suffix);
+				put_str(&fp->out, numbuf);
+				/* force resync after any suffixed residue */
+				if(suffix[0] != '\0') next_res_num = -999;
+				}
+			if(col > 68) {
+				put_str(&fp->out, "\n                   ");
+				col = 19;
+				}
+			buf[0] = one_letter(cp->type[i]);
+			put_text(&fp->out, buf, 1);
+			col++;
+			next_res_num++;
+			}
+		put_str(&fp->out, "\n");
+		}
+
+	for(c = 0; c < n_alloc; c++) {
+		free(chains[c].num);
+		free(chains[c].suffix);
+		free(chains[c].type);
+		}
+	free(chains);
+}
+
+ static void
+convert_task(void *arg, int t, int thread)
+{
+	struct file *fp = &((struct file *) arg)[t];
+
+	if(fp->removed) {
+		put_str(&fp->out, fp->filename);
+		put_str(&fp->out, "\n");
+		}
+	else convert(fp);
+}
+
+ static struct file *
+add_file(struct file *files, int *n_files, int *max_files, char *filename, int select)
+{
+	if(*n_files == *max_files) {
+		*max_files = *max_files ? 2 * *max_files : 1024;
+		files = (struct file *) realloc(files, *max_files * sizeof(struct file));
+		}
+	memset(&files[*n_files], 0, sizeof(struct file));
+	files[*n_files].filename = strdup(filename);
+	files[(*n_files)++].select = select;
+	return files;
+}
+
+ static struct file *
+read_list(char *listfilename, struct file *files, int *n_files, int *max_files)
+{
+	/* add the files, and chains, named in a list file, and with -d
+	 * the entries to be removed
+	 */
+	char line[2048], filename[2048], chain[2048], *s;
+	FILE *f;
+	int n;
+
+	if(strcmp(listfilename, "-") == 0) f = stdin;
+	else if((f = fopen(listfilename, "r")) == NULL) {
+		perror(listfilename);
+		exit(-1);
+		}
+	while(fgets(line, sizeof(line), f) != NULL) {
+		if((n = sscanf(line, "%s %s", filename, chain)) < 1) continue;
+		if(filename[0] == '-') {
+			if(!delta_mode) {
+				fprintf(stderr, "%s: %s: \"%s\" removes an entry, which needs -d\n",
+				  pgmname, listfilename, filename);
+				exit(-1);
+				}
+			if((s = strchr(line, '\n')) != NULL) *s = '\0';
+			files = add_file(files, n_files, max_files, line, -1);
+			files[*n_files - 1].removed = 1;
+			continue;
+			}
+		files = add_file(files, n_files, max_files, filename,
+		  n < 2 ? -1 : chain[0] == '_' ? ' ' : (unsigned char) chain[0]);
+		}
+	if(f != stdin) fclose(f);
+	return files;
+}
+
+ static void
+write_ascii(FILE *out, struct file *files, int n_files)
+{
+	int i;
+
+	for(i = 0; i < n_files; i++)
+		if(files[i].out.len > 0) fwrite(files[i].out.s, 1, files[i].out.len, out);
+}
+
+ static void
+write_file(char *filename, struct file *files, int n_files, char *text,
+  size_t size, int verbose)
+{
+	/* write "filename", under a temporary name that is then renamed as
+	 * sequery-mkdb does: the ASCII text of the files, or if "text" is
+	 * given, an image of it
+	 */
+	char tmpfilename[1024+16];
+	struct seq *seq;
+	FILE *f, *in;
+	int n_seqs, err;
+
+	sprintf(tmpfilename, "%s.new", filename);
+	if((f = fopen(tmpfilename, "w")) == NULL) {
+		perror(tmpfilename);
+		exit(-1);
+		}
+	if(text == NULL) {
+		write_ascii(f, files, n_files);
+		err = ferror(f);
+		}
+	else {
+		/* read the text back as sequery-mkdb reads a sequence file */
+		if(size == 0) {
+			seq = (struct seq *) malloc(sizeof(struct seq));
+			n_seqs = 0;
+			}
+		else if((in = fmemopen(text, size, "r")) == NULL ||
+		  (seq = seqfile_read(in, &n_seqs)) == NULL) {
+			fprintf(stderr, "%s: out of memory making %s\n", pgmname, filename);
+			unlink(tmpfilename);
+			exit(-1);
+			}
+		else fclose(in);
+		err = seqdb_write(f, seq, n_seqs);
+		}
+	if(err != 0 || fclose(f) != 0 || rename(tmpfilename, filename) != 0) {
+		perror(filename);
+		unlink(tmpfilename);
+		exit(-1);
+		}
+	if(verbose) fprintf(stderr, "wrote %s\n", filename);
+}
+
+ int
+main(int argc, char **argv)
+{
+	extern char *optarg;
+	extern int optind;
+	char *listfilename = NULL, *asciifilename = NULL, *imagefilename = NULL;
+	struct file *files = NULL;
+	struct text all;
+	int n_files = 0, max_files = 0, nthreads = 1, verbose = 0;
+	int errflg = 0, i, c;
+
+	pgmname = argv[0];
+	while((c = getopt(argc, argv, "vdj:l:a:i:")) != -1) switch(c) {
+ case 'v':
+	verbose = 1; break;
+ case 'd':
+	delta_mode = 1; break;
+ case 'j':
+	nthreads = atoi(optarg);
+	if(nthreads < 1) nthreads = 1;
+	if(nthreads > POOL_MAXTHREADS) nthreads = POOL_MAXTHREADS;
+	break;
+ case 'l':
+	listfilename = optarg; break;
+ case 'a':
+	asciifilename = optarg; break;
+ case 'i':
+	imagefilename = optarg; break;
+ default:
+	errflg = 1; break;
+	}
+	if(delta_mode && imagefilename != NULL) errflg = 1; /* no image of tombstones */
+	if(errflg || (optind == argc && listfilename == NULL)) {
+		fprintf(stderr, "usage: %s [-v] [-j threads] [-l list_file] [-a ascii_file] [-i image_file] [pdb_file ...]\n",
+		  pgmname);
+		fprintf(stderr, "       %s -d [-v] [-j threads] [-l list_file] [-a delta_file] [pdb_file ...]\n",
+		  pgmname);
+		exit(2);
+		}
+	for(i = optind; i < argc; i++)
+		files = add_file(files, &n_files, &max_files, argv[i], -1);
+	if(listfilename != NULL)
+		files = read_list(listfilename, files, &n_files, &max_files);
+
+	make_rescodes();
+	pool_run(nthreads, n_files, convert_task, files);
+	for(i = 0; i < n_files; i++)
+		if(files[i].failed)
+			fprintf(stderr, "%s: cannot read %s\n", pgmname, files[i].filename);
+	if(verbose) fprintf(stderr, "converted %d PDB files\n", n_files);
+
+	if(asciifilename == NULL && imagefilename == NULL) {
+		write_ascii(stdout, files, n_files);
+		return fflush(stdout) == 0 ? 0 : -1;
+		}
+	if(asciifilename != NULL)
+		write_file(asciifilename, files, n_files, NULL, 0, verbose);
+	if(imagefilename != NULL) {
+		memset(&all, 0, sizeof(all));
+		for(i = 0; i < n_files; i++)
+			if(files[i].out.len > 0) put_text(&all, files[i].out.s, files[i].out.len);
+		put_text(&all, "", 1);
+		write_file(imagefilename, files, n_files, all.s, all.len - 1, verbose);
+		}
+	return 0;
+}
@@ -0,0 +1,195 @@
+/* tally_subs.c:
+ *  count the matches of one pattern by chain and by residue, instead of
+ *  keeping them; see tally_subs.h.
+ *
+ * A batch job that wants to know only how many chains a pattern is in,
+ * or which residues it picks out at each position, used to have every
+ * match formatted, sorted and written, only to read it all back.  The
+ * chains are found again in a small hash table as each match comes, so
+ * what is left to do is little more than the search itself.
+ */
+#ifndef lint
+static char rcs_id[] =
+ "@(#) $Header$";
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "tally_subs.h"
+
+ struct tally *
+tally_new(int mode)
+{
+	struct tally *t;
+
+	t = (struct tally *) calloc(1, sizeof(struct tally));
+	t->mode = mode;
+	return t;
+}
+
+ static void
+rehash(struct tally *t)
+{
+	/* make the hash table twice the size, at least twice the chains */
+	struct tally_chain *cp;
+	uint64_t h;
+	char *s;
+	int j, i;
+
+	t->hashsize = t->hashsize ? 2 * t->hashsize : 256;
+	free(t->hash);
+	t->hash = (int *) calloc(t->hashsize, sizeof(int));
+	for(i = 0; i < t->nchains; i++) {
+		cp = &t->chain[i];
+		h = 14695981039346656037ULL;
+		for(s = t->text + cp->key; s < t->text + cp->key + cp->len; s++)
+			h = (h ^ (unsigned char) *s) * 1099511628211ULL;
+		for(j = h & (t->hashsize-1); t->hash[j] != 0; j = (j+1) & (t->hashsize-1)) ;
+		t->hash[j] = i+1;
+		}
+}
+
+ static struct tally_chain *
+find_chain(struct tally *t, char *name, int len)
+{
+	/* the entry of chain name[0..len), made if need be */
+	struct tally_chain *cp;
+	uint64_t h = 14695981039346656037ULL;
+	char *s;
+	int j;
+
+	if(2 * t->nchains >= t->hashsize) rehash(t);
+	for(s = name; s < name + len; s++)
+		h = (h ^ (unsigned char) *s) * 1099511628211ULL;
+	for(j = h & (t->hashsize-1); t->hash[j] != 0; j = (j+1) & (t->hashsize-1)) {
+		cp = &t->chain[t->hash[j]-1];
+		if(cp->len == len && memcmp(t->text + cp->key, name, len) == 0)
+			return cp;
+		}
+
+	if(t->nchains == t->chainalloc) {
+		t->chainalloc = t->chainalloc ? 2 * t->chainalloc : 256;
+		t->chain = (struct tally_chain *) realloc(t->chain,
+		  t->chainalloc * sizeof(struct tally_chain));
+		}
+	if(t->textlen + len > t->textalloc) {
+		t->textalloc = 2 * t->textalloc + len + 4096;
+		t->text = (char *) realloc(t->text, t->textalloc);
+		}
+	t->hash[j] = ++t->nchains;
+	cp = &t->chain[t->nchains-1];
+	cp->key = t->textlen;
+	cp->len = len;
+	cp->hits = 0;
+	cp->seqno = -1;
+	memcpy(t->text + t->textlen, name, len);
+	t->textlen += len;
+	return cp;
+}
+
+ void
+tally_add(struct tally *t, char *line, int len)
+{
+	/* count one match, given as a line (without its newline) */
+	struct tally_chain *cp;
+	char *end = line + len, *s;
+	int j, seqno = 0;
+
+	/* the name and chain: up to the second tab */
+	s = memchr(line, '\t', len);
+	if(s != NULL) s = memchr(s+1, '\t', end - (s+1));
+	if(s == NULL) s = end;
+	cp = find_chain(t, line, s - line);
+	cp->hits++;
+
+	/* then where it is */
+	if(s < end)
+		for(s++; s < end && *s >= '0' && *s <= '9'; s++)
+			seqno = 10 * seqno + (*s - '0');
+	if(cp->seqno < 0 || seqno < cp->seqno) cp->seqno = seqno;
+	if(t->mode != TALLY_STATS || s == end) return;
+
+	/* the residues, one position after another */
+	for(j = 0, s++; s < end; s++, j++) {
+		if(j == t->posalloc) {
+			t->posalloc = t->posalloc ? 2 * t->posalloc : 64;
+			t->freq = (long (*)[256]) realloc(t->freq,
+			  t->posalloc * sizeof(*t->freq));
+			}
+		if(j == t->npos) memset(t->freq[t->npos++], 0, sizeof(*t->freq));
+		t->freq[j][(unsigned char) *s]++;
+		}
+}
+
+ static int
+by_seqno(const void *a, const void *b)
+{
+	const struct tally_chain *x = *(struct tally_chain **) a;
+	const struct tally_chain *y = *(struct tally_chain **) b;
+
+	if(x->seqno != y->seqno) return x->seqno < y->seqno ? -1 : 1;
+	return x->key < y->key ? -1 : x->key > y->key;
+}
+
+ int
+tally_write(struct tally *t, FILE *fp)
+{
+	/* write what has been counted onto fp.  For TALLY_LIST, a line
+	 * "NAME CHAIN" for each chain matched; for TALLY_STATS, a line
+	 * "position J: R N R N ..." for each position of the matches,
+	 * giving how many times each residue R was matched there, then a
+	 * line "NAME CHAIN N match(es)" for each chain.  Chains are in the
+	 * order of their sequences in the database, so the same however
+	 * it was searched.  Returns 0, or -1 if fp could not take it.
+	 */
+	struct tally_chain *cp, **order;
+	int i, j, c;
+
+	if(t->mode == TALLY_STATS)
+		for(j = 0; j < t->npos; j++) {
+			fprintf(fp, "position %d:", j+1);
+			for(c = 0; c < 256; c++)
+				if(t->freq[j][c] != 0) fprintf(fp, " %c %ld", c, t->freq[j][c]);
+			putc('\n', fp);
+			}
+	/* sorted aside, as the hash table holds indexes into chain[] */
+	order = (struct tally_chain **)
+	  malloc((t->nchains ? t->nchains : 1) * sizeof(struct tally_chain *));
+	for(i = 0; i < t->nchains; i++) order[i] = &t->chain[i];
+	qsort(order, t->nchains, sizeof(struct tally_chain *), by_seqno);
+	for(i = 0; i < t->nchains; i++) {
+		cp = order[i];
+		for(j = 0; j < cp->len; j++)
+			putc(t->text[cp->key+j] == '\t' ? ' ' : t->text[cp->key+j], fp);
+		if(t->mode == TALLY_STATS)
+			fprintf(fp, " %d match%s", cp->hits, cp->hits==1?"":"es");
+		putc('\n', fp);
+		}
+	free(order);
+	if(fflush(fp) == EOF || ferror(fp)) return -1;
+	return 0;
+}
+
+ void
+tally_clear(struct tally *t)
+{
+	/* forget everything counted, keeping the space for more */
+	t->textlen = 0;
+	t->nchains = 0;
+	t->npos = 0;
+	if(t->hash != NULL) memset(t->hash, 0, t->hashsize * sizeof(int));
+}
+
+ void
+tally_free(struct tally *t)
+{
+	if(t == NULL) return;
+	free(t->text);
+	free(t->chain);
+	free(t->hash);
+	free(t->freq);
+	free(t);
+}
@@ -0,0 +1,46 @@
+/* tally_subs.h:
+ *  a summary of the matches of one pattern, kept instead of the matches
+ *  themselves when only the summary is wanted (sequery -c, -l, --stats).
+ *
+ * Each match is given as a line "NAME<tab>CHAIN<tab>SEQNO", SEQNO being
+ * where its sequence is in the database (0 for the first), followed
+ * with TALLY_STATS by "<tab>RESIDUES", the residues matched.  The
+ * chains are kept with the number of matches in each; with TALLY_STATS,
+ * so is how often each residue was matched at each position of the
+ * pattern.  Nothing is sorted or written anywhere until the tally is
+ * written out, when the chains are put in the order of the database,
+ * whatever order they were matched in.
+ * Requires <stdio.h>.
+ */
+
+static char tally_subs_h_rcsid[] =
+ "@(#) $Header$";
+
+#define TALLY_COUNT 1	/* -c: no lines at all, just the counts */
+#define TALLY_LIST 2	/* -l: the chains matched */
+#define TALLY_STATS 3	/* --stats: and the residues at each position */
+
+struct tally_chain {
+	long key;		/* "NAME<tab>CHAIN" is text[key..key+len) */
+	int len;
+	int hits;		/* matches in the chain */
+	int seqno;		/* where it is in the database */
+	};
+
+struct tally {
+	int mode;		/* TALLY_LIST or TALLY_STATS */
+	char *text;		/* the chains' names */
+	long textlen, textalloc;
+	struct tally_chain *chain;
+	int nchains, chainalloc;
+	int *hash;		/* 1 + index in chain[] of each slot, or 0 */
+	int hashsize;
+	long (*freq)[256];	/* freq[j][c]: residue c at position j */
+	int npos, posalloc;
+	};
+
+struct tally * tally_new(int mode);
+void tally_add(struct tally *t, char *line, int len);
+int tally_write(struct tally *t, FILE *fp);
+void tally_clear(struct tally *t);
+void tally_free(struct tally *t);